@@ -0,0 +1,73 @@
+#pragma once
+
+// Tiny timing harness for the host benchmarks. Each measurement repeats the body until
+// it has run for at least MIN_SAMPLE_NS and keeps the best of BENCH_SAMPLES runs, which
+// is stable enough to spot regressions between commits on the same machine. Correctness
+// checks go through check(), so a failing one fails the run.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#define BENCH_SAMPLES 5
+#define MIN_SAMPLE_NS 20000000ull
+
+namespace bench
+{
+    /// Values are written here so the optimizer cannot drop the work being timed.
+    inline volatile int32_t sink;
+
+    inline uint64_t nowNs()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Time a batch of work.
+     *
+     * @param itemsPerCall Number of items (LEDs, calls, frames...) processed by one call of body.
+     * @param body Callable performing the work.
+     * @return Best observed nanoseconds per item.
+     */
+    template <typename F>
+    double nsPerItem(size_t itemsPerCall, F &&body)
+    {
+        double best = 1e30;
+        for (int sample = 0; sample < BENCH_SAMPLES; sample++)
+        {
+            uint64_t calls = 0;
+            uint64_t start = nowNs(), elapsed;
+            do
+            {
+                body();
+                calls++;
+                elapsed = nowNs() - start;
+            } while (elapsed < MIN_SAMPLE_NS / BENCH_SAMPLES);
+
+            double ns = (double)elapsed / (calls * itemsPerCall);
+            if (ns < best)
+                best = ns;
+        }
+        return best;
+    }
+
+    /// Correctness checks that failed so far; main() exits non-zero when there are any.
+    inline int failures;
+
+    /**
+     * @brief Record the outcome of a correctness check.
+     *
+     * @return pass or fail, the word the table prints for it.
+     */
+    inline const char *check(bool ok, const char *pass = "ok", const char *fail = "FAIL")
+    {
+        failures += !ok;
+        return ok ? pass : fail;
+    }
+
+    inline void section(const char *title)
+    {
+        printf("\n== %s ==\n", title);
+    }
+}
@@ -0,0 +1,2638 @@
+// Host benchmarks for the LED driver and fixed point math ([env:native] in platformio.ini).
+//
+//   pio run -e native && .pio/build/native/program [section...]
+//
+// With no arguments every section runs. Times are host nanoseconds: compare them
+// between commits on the same machine, not against the 48 MHz target.
+
+#include <Arduino.h>
+#include "LEDSPI.h"
+#include "FixedPoint.cpp"
+#include "Plasma.cpp"
+#include "FrameScheduler.cpp"
+#include "LEDTiming.h"
+#if !LED_SPI_CLOCKED
+#include "LEDParallel.h"
+#endif
+#include "StreamReceiver.cpp"
+#include "Compositor.cpp"
+#include "Noise.cpp"
+#include "FlashAnimation.cpp"
+#include "../tools/AnimationEncoder.h"
+#include <CH32X035_USBSerial.h>
+
+#include "Bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+static const size_t LED_COUNTS[] = {21, 60, 150, 300};
+static const uint8_t DITHER_DEPTHS[] = {0, 1, 2, 3};
+
+/// Deterministic pseudo-random inputs so runs are comparable.
+static uint32_t nextRandom()
+{
+    static uint32_t state = 0x12345678;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void benchFixedPoint()
+{
+    bench::section("Fixed point (ns/call)");
+
+    const size_t N = 4096;
+    static Fixed8 a[N], b[N], angles[N], roots[N];
+    for (size_t i = 0; i < N; i++)
+    {
+        a[i] = (Fixed8)(nextRandom() % (64 * FP_FIXED_VAL)) - 32 * FP_FIXED_VAL;
+        b[i] = (Fixed8)(nextRandom() % (64 * FP_FIXED_VAL)) - 32 * FP_FIXED_VAL;
+        angles[i] = (Fixed8)(nextRandom() % (16 * FP_2PI)) - 8 * FP_2PI;
+        // Spread the sqrt inputs over every magnitude range sqrtFP special cases
+        roots[i] = (Fixed8)(nextRandom() >> (1 + nextRandom() % 31));
+    }
+
+    printf("%-10s %8.2f\n", "add", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += add(a[i], b[i]); bench::sink = s; }));
+    printf("%-10s %8.2f\n", "sub", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += sub(a[i], b[i]); bench::sink = s; }));
+    printf("%-10s %8.2f\n", "mult", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += mult(a[i], b[i]); bench::sink = s; }));
+
+    // Fixed<> against the functions above on the same inputs
+    static Q8 qa[N], qb[N];
+    bool same = true;
+    for (size_t i = 0; i < N; i++)
+    {
+        qa[i] = Q8::fromRaw(a[i]);
+        qb[i] = Q8::fromRaw(b[i]);
+        same &= (qa[i] * qb[i]).raw() == mult(a[i], b[i]) && (qa[i] + qb[i]).raw() == add(a[i], b[i]);
+    }
+    static_assert(Q8(0.5).raw() == 128 && Q8(-1.25).raw() == -320, "float literals convert at compile time");
+    static_assert(satMul(Q8(30000), Q8(30000)) == Q8::max(), "satMul clamps");
+    printf("%-10s %8.2f\n", "Q8 +", bench::nsPerItem(N, [&] { Q8 s; for (size_t i = 0; i < N; i++) s += qa[i] + qb[i]; bench::sink = s.raw(); }));
+    printf("%-10s %8.2f\n", "Q8 -", bench::nsPerItem(N, [&] { Q8 s; for (size_t i = 0; i < N; i++) s += qa[i] - qb[i]; bench::sink = s.raw(); }));
+    printf("%-10s %8.2f   %s\n", "Q8 *", bench::nsPerItem(N, [&] { Q8 s; for (size_t i = 0; i < N; i++) s += qa[i] * qb[i]; bench::sink = s.raw(); }),
+           same ? "(same results as mult/add)" : "(DIFFERS from mult/add)");
+    printf("%-10s %8.2f\n", "satMul", bench::nsPerItem(N, [&] { Q8 s; for (size_t i = 0; i < N; i++) s += satMul(qa[i], qb[i]); bench::sink = s.raw(); }));
+    printf("%-10s %8.2f\n", "sinFP", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += sinFP(angles[i]); bench::sink = s; }));
+    printf("%-10s %8.2f\n", "cosFP", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += cosFP(angles[i]); bench::sink = s; }));
+    printf("%-10s %8.2f\n", "sqrtFP", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += sqrtFP(roots[i]); bench::sink = s; }));
+}
+
+/// sinFP() as it was before the folded table lookup: 17 entry table, abs(), % and sign multiplies.
+static Fixed8 legacySinFP(AngleHz x)
+{
+    // The original table: a 5th order polynomial, truncated
+    static Fixed8 LUT[18];
+    if (!LUT[16])
+    {
+        for (int i = 0; i <= 16; i++)
+        {
+            double xRad = i * 16 * M_PI_2 / FP_FIXED_VAL;
+            LUT[i] = xRad * (1.0 + xRad * xRad * (-0.166592452584 + xRad * xRad * 0.00809167377688)) * FP_FIXED_VAL;
+        }
+    }
+    int sign = x < 0 ? -1 : 1;
+    x = abs(x);
+    int xFrac = x & FP_FRACTION_MASK;
+    int xInt = x >> FP_FIXED_BITS;
+    if (xInt % 2 == 1)
+        xFrac = FP_FIXED_VAL - xFrac;
+    size_t a = xFrac / 16;
+    size_t offset = xFrac & 15;
+    Fixed8 sinVal = (offset * LUT[a + 1] + (16 - offset) * LUT[a]) / 16;
+    if (xInt % 4 >= 2)
+        sign *= -1;
+    return sinVal * sign;
+}
+
+/// Print max/RMS error against sin() over several turns, both signs, and the cost per call.
+template <typename F>
+static void sinAccuracy(const char *name, F sinFn, const AngleHz *angles, size_t n)
+{
+    double maxError = 0, sumSquares = 0;
+    int count = 0;
+    for (AngleHz x = -4 * FP_2PI; x < 4 * FP_2PI; x++, count++)
+    {
+        double error = fabs(sinFn(x) - sin(x * M_PI_2 / FP_FIXED_VAL) * FP_FIXED_VAL);
+        maxError = std::max(maxError, error);
+        sumSquares += error * error;
+    }
+    double ns = bench::nsPerItem(n, [&] { int32_t s = 0; for (size_t i = 0; i < n; i++) s += sinFn(angles[i]); bench::sink = s; });
+    printf("%-16s %10.3f %10.3f %8.2f\n", name, maxError, sqrt(sumSquares / count), ns);
+}
+
+static void benchSin()
+{
+    bench::section("sinFP accuracy vs cost (error in 1/256 steps)");
+    printf("%-16s %10s %10s %8s\n", "variant", "max err", "rms err", "ns/call");
+
+    const size_t N = 4096;
+    static AngleHz angles[N];
+    static Fixed8 out[N];
+    for (size_t i = 0; i < N; i++)
+        angles[i] = (AngleHz)(nextRandom() % (16 * FP_2PI)) - 8 * FP_2PI;
+
+    sinAccuracy("legacy 16+interp", legacySinFP, angles, N);
+    sinAccuracy("fold 8 entries", sinFPLut<3>, angles, N);
+    sinAccuracy("fold 16 entries", sinFPLut<4>, angles, N);
+    sinAccuracy("fold 32 entries", sinFPLut<5>, angles, N);
+    sinAccuracy("fold 64 entries", sinFPLut<6>, angles, N);
+    sinAccuracy("fold 256 direct", sinFPLut<8>, angles, N);
+    printf("%-16s %10s %10s %8.2f\n", "sinFP_batch", "", "",
+           bench::nsPerItem(N, [&] { sinFP_batch(angles, out, N); bench::sink = out[N - 1]; }));
+}
+
+/// sqrtFP() before the digit-by-digit root: four Newton variants with a divide per step.
+static Fixed8 legacySqrtFP(Fixed8 x)
+{ 
+    if (x < 0)
+        x = -x; // Return the sqrt of the magnitude of the value
+
+    if (x == 0)
+        return 0;
+    
+    Fixed8 xn;
+    // Choose a good starting guess based on highest bit set
+           if (x & 0xFF000000) {
+        xn = x >> 12;
+    } else if (x & 0x00FF0000) {
+        xn = x >> 6;
+    } else if (x & 0x0000FF00) {
+        xn = x >> 2;
+    } else {
+        xn = x << 2;
+    }
+
+    // If the input value is big enough it would overflow if we used the regular Newton's algorithm,
+    //  use a slightly altered version, less-accurate version to keep it within a 32-bit int
+
+    if (x & (INT32_MAX - (INT32_MAX >> 2))) 
+    {
+        // If the two highest bits are set, Newton's algorithm can overflow when adding to x
+        // Use the most conservative formula to prevent overflow
+        for (int i = 0; i < 6; i++)
+        {
+            // Newton's algorithm, taking into account the fixed point shift
+            //  6 iterations are always enough with a good starting guess
+            xn = (xn / FP_FIXED_VAL + x / xn) * (FP_FIXED_VAL / 2);
+        
+        }
+    } else if (x & (INT32_MAX - (INT32_MAX >> (FP_FIXED_BITS - 1))))
+    {
+        // If one of the bits in the top 7-bits is set, it can overflow when multiplying by FP_FIXED_VAL / 2
+        // Use a modified formula to prevent overflow, this one divides xn 
+        for (int i = 0; i < 6; i++)
+        {
+            // Newton's algorithm, taking into account the fixed point shift
+            //  6 iterations are always enough with a good starting guess
+
+
+            Fixed8 xn_2 = xn >> (FP_FIXED_BITS / 2);
+            xn = (xn_2 * xn_2 + x) / xn * (FP_FIXED_VAL / 2);
+        
+        }
+    }
+    else if (x & (INT32_MAX - (INT32_MAX >> (FP_FIXED_BITS)))) {
+        // Slightly less accurate than the main formula, but because we multiply by FP_FIXED_VAL / 2
+        // Instead of FP_FIXED_VAL, we get one extra bit before overflow
+        // Only use this if the 8-th highest bit is set
+         for (int i = 0; i < 5; i++)
+        {
+            // Newton's algorithm, taking into account the fixed point shift
+            // 6 iterations are always enough with a good starting guess
+            xn = (xn + 1) / 2 + x * (FP_FIXED_VAL / 2) / xn;
+        }
+    } else
+    {
+        // Fastest and most accurate Newton's method formula, use this when there is no chance of overflow
+        for (int i = 0; i < 5; i++)
+        {
+            // Newton's algorithm, taking into account the fixed point shift
+            // 6 iterations are always enough with a good starting guess
+            xn = (xn + x * FP_FIXED_VAL / xn + 1) / 2;
+        }
+    }
+
+    return xn;
+}
+
+struct RootCheck
+{
+    double maxSqrt = 0, maxRsqrt = 0;
+    uint64_t checked = 0;
+
+    void check(Fixed8 x)
+    {
+        double root = sqrt((double)x * FP_FIXED_VAL);
+        maxSqrt = std::max(maxSqrt, fabs(sqrtFP(x) - root));
+        maxRsqrt = std::max(maxRsqrt, fabs(rsqrtFP(x) - FP_FIXED_VAL * FP_FIXED_VAL / root));
+        checked++;
+    }
+};
+
+/**
+ * @brief Check sqrtFP/rsqrtFP/hypotFP against double precision over [1, 2^31) and time the
+ * roots, overall and per input class.
+ *
+ * @param exhaustive Check every positive Fixed8. Otherwise every input below 2^20 and
+ *                   a random spread of larger ones.
+ */
+static void checkRoots(bool exhaustive)
+{
+    RootCheck roots;
+    if (exhaustive)
+    {
+        for (uint32_t x = 1; x <= INT32_MAX; x++)
+            roots.check(x);
+    }
+    else
+    {
+        for (Fixed8 x = 1; x < (1 << 20); x++)
+            roots.check(x);
+        for (int i = 0; i < (1 << 20); i++)
+            roots.check(1 + (nextRandom() >> (1 + nextRandom() % 12)));
+    }
+
+    // Random pairs of every size, and the extremes of the sum of squares
+    double maxHypot = 0;
+    auto checkHypot = [&](Fixed8 a, Fixed8 b) {
+        double exact = std::min(hypot((double)a, (double)b), (double)INT32_MAX);
+        maxHypot = std::max(maxHypot, fabs(hypotFP(a, b) - exact));
+    };
+    for (int i = 0; i < (1 << 20); i++)
+        checkHypot(nextRandom(), nextRandom() >> (nextRandom() % 32));
+    for (Fixed8 a : {0, 1, 65535, 65536, INT32_MAX, INT32_MIN})
+        for (Fixed8 b : {0, -1, 46341, INT32_MAX, INT32_MIN})
+            checkHypot(a, b);
+
+    // sqrtFP and hypotFP round to nearest; rsqrtFP gets a little slack for its Newton steps
+    bool within = roots.maxSqrt <= 0.5 && maxHypot <= 0.5 && roots.maxRsqrt <= 0.51;
+    printf("%llu inputs: sqrtFP max err %.3f, rsqrtFP max err %.3f, hypotFP max err %.3f (steps of 1/256), within bounds: %s\n",
+           (unsigned long long)roots.checked, roots.maxSqrt, roots.maxRsqrt, maxHypot, bench::check(within, "yes", "NO"));
+
+    const size_t N = 4096;
+    static Fixed8 inputs[N];
+    for (size_t i = 0; i < N; i++)
+        inputs[i] = 1 + (nextRandom() >> (1 + nextRandom() % 31));
+    printf("%-14s %8s\n", "function", "ns/call");
+    printf("%-14s %8.2f\n", "legacy sqrtFP", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += legacySqrtFP(inputs[i]); bench::sink = s; }));
+    printf("%-14s %8.2f\n", "sqrtFP", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += sqrtFP(inputs[i]); bench::sink = s; }));
+    printf("%-14s %8.2f\n", "rsqrtFP", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i < N; i++) s += rsqrtFP(inputs[i]); bench::sink = s; }));
+    printf("%-14s %8.2f\n", "hypotFP", bench::nsPerItem(N, [&] { int32_t s = 0; for (size_t i = 0; i + 1 < N; i++) s += hypotFP(inputs[i], inputs[i + 1]); bench::sink = s; }));
+
+    // Constant time: the cost per call must not depend on the input. Each class is timed on
+    // its own, so a data dependent loop or branch shows as a spread between classes. Host
+    // ns, the best of several runs; the legacy root is there to show what a spread looks like
+    struct InputClass
+    {
+        const char *name;
+        Fixed8 low, high; // Inputs are spread over [low, high]
+    };
+    const InputClass CLASSES[] = {
+        {"zero", 0, 0},
+        {"tiny", 1, 255},
+        {"units", 256, 65535},
+        {"large", 1 << 16, 1 << 24},
+        {"huge", 1 << 24, INT32_MAX},
+    };
+    printf("%-14s", "ns/call by");
+    for (const InputClass &inputClass : CLASSES)
+        printf(" %7s", inputClass.name);
+    printf(" %7s %6s\n", "max/min", "flat");
+    const size_t CLASS_COUNT = sizeof(CLASSES) / sizeof(CLASSES[0]);
+    static Fixed8 classInputs[CLASS_COUNT][N];
+    for (size_t c = 0; c < CLASS_COUNT; c++)
+        for (size_t i = 0; i < N; i++)
+            classInputs[c][i] = CLASSES[c].low + (Fixed8)(nextRandom() % ((uint32_t)(CLASSES[c].high - CLASSES[c].low) + 1));
+    auto spread = [&](const char *name, bool checked, size_t firstClass, auto root) {
+        // Many short passes round robin over the classes, the best of each: a slow patch of
+        // the host spoils a few passes of every class rather than all of one
+        double ns[CLASS_COUNT];
+        std::fill(ns, ns + CLASS_COUNT, 1e30);
+        for (int round = 0; round < 300; round++)
+            for (size_t c = firstClass; c < CLASS_COUNT; c++)
+            {
+                uint64_t start = bench::nowNs();
+                int32_t s = 0;
+                for (size_t i = 0; i < N; i++)
+                    s += root(classInputs[c][i]);
+                bench::sink = s;
+                ns[c] = std::min(ns[c], (double)(bench::nowNs() - start) / N);
+            }
+        double low = *std::min_element(ns + firstClass, ns + CLASS_COUNT);
+        double high = *std::max_element(ns + firstClass, ns + CLASS_COUNT);
+        printf("%-14s", name);
+        for (size_t c = 0; c < CLASS_COUNT; c++)
+            c < firstClass ? printf(" %7s", "-") : printf(" %7.2f", ns[c]);
+        printf(" %7.2f %6s\n", high / low, checked ? bench::check(high / low < 1.5, "yes", "NO") : "-");
+    };
+    // rsqrtFP() returns early for x <= 0, its one input outside the domain
+    spread("legacy sqrtFP", false, 0, [](Fixed8 x) { return legacySqrtFP(x); });
+    spread("sqrtFP", true, 0, [](Fixed8 x) { return sqrtFP(x); });
+    spread("rsqrtFP", true, 1, [](Fixed8 x) { return rsqrtFP(x); });
+    spread("hypotFP(x, x)", true, 0, [](Fixed8 x) { return hypotFP(x, x); });
+}
+
+static void benchRoots()
+{
+    bench::section("Square roots: error and cost (sampled; 'sqrtfull' checks all 2^31 inputs)");
+    checkRoots(false);
+}
+
+static void benchRootsExhaustive()
+{
+    bench::section("Square roots: exhaustive check over every positive Fixed8");
+    checkRoots(true);
+}
+
+static void benchEncode()
+{
+    bench::section("setLED + show() encode (ns/LED)");
+    printf("%6s", "LEDs");
+    for (uint8_t depth : DITHER_DEPTHS)
+        printf("  dither=%u", depth);
+    printf("\n");
+
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        printf("%6zu", numLEDs);
+        for (uint8_t depth : DITHER_DEPTHS)
+        {
+            LEDSim::reset();
+            LED_SPI_CH32 leds(numLEDs, depth);
+            int color = 0;
+            double ns = bench::nsPerItem(numLEDs, [&] {
+                for (size_t i = 0; i < numLEDs; i++, color++)
+                    leds.setLED(i, color & 0xFF, (color >> 1) & 0xFF, (color >> 2) & 0xFF);
+                leds.show();
+            });
+            printf("  %8.2f", ns);
+        }
+        printf("\n");
+    }
+}
+
+static void benchBulkEncode()
+{
+    bench::section("Bulk vs per-LED, each followed by show() (ns/LED; frame us = setPixels over the strip)");
+    printf("%6s %6s %10s %10s %10s %12s %8s\n", "LEDs", "dither", "setLED", "setPixels", "fill", "frame us", "same");
+
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        for (uint8_t depth : DITHER_DEPTHS)
+        {
+            // Two alternating frames so every LED is dirty on every commit
+            std::vector<RGB> pixels[2] = {std::vector<RGB>(numLEDs), std::vector<RGB>(numLEDs)};
+            for (auto &frame : pixels)
+                for (RGB &pixel : frame)
+                    pixel = {(uint8_t)nextRandom(), (uint8_t)nextRandom(), (uint8_t)nextRandom()};
+
+            LEDSim::reset();
+            LED_SPI_CH32 perLED(numLEDs, depth);
+            LED_SPI_CH32 bulk(numLEDs, depth);
+
+            int frame = 0;
+            double setLEDns = bench::nsPerItem(numLEDs, [&] {
+                const std::vector<RGB> &p = pixels[frame++ & 1];
+                for (size_t i = 0; i < numLEDs; i++)
+                    perLED.setLED(i, p[i].r, p[i].g, p[i].b);
+                perLED.show();
+            });
+            double bulkNs = bench::nsPerItem(numLEDs, [&] {
+                bulk.setPixels(pixels[frame++ & 1].data(), numLEDs);
+                bulk.show();
+            });
+            double fillNs = bench::nsPerItem(numLEDs, [&] {
+                bulk.fill(0, numLEDs, pixels[frame++ & 1][0]);
+                bulk.show();
+            });
+
+            // Both paths must produce identical DMA buffers
+            for (size_t i = 0; i < numLEDs; i++)
+                perLED.setLED(i, pixels[0][i].r, pixels[0][i].g, pixels[0][i].b);
+            perLED.show();
+            bulk.setPixels(pixels[0].data(), numLEDs);
+            bulk.show();
+            bool same = !memcmp(perLED._DMABuffer, bulk._DMABuffer, perLED._DMABufferSize * perLED._numDitherBuffers) &&
+                        !memcmp(perLED._LEDColors, bulk._LEDColors, perLED._LEDColorsSize * sizeof(uint32_t));
+
+            printf("%6zu %6u %10.2f %10.2f %10.2f %12.2f %8s\n", numLEDs, depth, setLEDns, bulkNs, fillNs,
+                   bulkNs * numLEDs / 1000, bench::check(same, "yes", "NO"));
+        }
+    }
+}
+
+/// quantize() before the color lookup: linear, with the level split done per call.
+static uint32_t legacyQuantize(Fixed8 colorChannel, size_t numDitherBuffers)
+{
+    const int FRACTION_MAX = FP_FRACTION_MASK;
+    uint32_t ditherBins = (1 << numDitherBuffers) - 1;
+    colorChannel = CLAMP(colorChannel, 0, FRACTION_MAX);
+    uint32_t colorInteger = colorChannel * MAX_BRIGHTNESS / FRACTION_MAX;
+    uint32_t colorFractional = (colorChannel * MAX_BRIGHTNESS) % FRACTION_MAX * ditherBins;
+    colorFractional = (colorFractional + (1 << (COLOR_BIT_DEPTH - 1))) >> COLOR_BIT_DEPTH;
+    return colorInteger << 16 | colorFractional;
+}
+
+/// computeColorLUT() before it moved to 32-bit divides: the same exact fractions in 64 bits.
+static void legacyComputeColorLUT(uint16_t lut[LED_CHANNELS][256], uint8_t brightness, uint8_t numDitherBuffers, LED_SPI_Dither ditherMode)
+{
+    const uint64_t denominator = 65535ull * 255;
+    uint32_t ditherBins = (1 << numDitherBuffers) - 1;
+    uint32_t fractionBits = numDitherBuffers > COLOR_BIT_DEPTH ? COLOR_BIT_DEPTH : numDitherBuffers;
+    for (size_t channel = 0; channel < LED_CHANNELS; channel++)
+    {
+        for (int value = 0; value < 256; value++)
+        {
+            uint64_t numerator = (uint64_t)LED_SPI_COLOR_TABLE.levels[channel][value] * brightness * MAX_BRIGHTNESS;
+            uint32_t colorInteger, colorFractional;
+            if (ditherMode == LED_SPI_DITHER_SIGMA_DELTA)
+            {
+                uint32_t scaled = ((numerator << fractionBits) + denominator / 2) / denominator;
+                colorInteger = scaled >> fractionBits;
+                colorFractional = (scaled & ((1 << fractionBits) - 1)) << (COLOR_BIT_DEPTH - fractionBits);
+            }
+            else
+            {
+                colorInteger = numerator / denominator;
+                colorFractional = (numerator % denominator * ditherBins + denominator / 2) / denominator;
+            }
+            lut[channel][value] = colorInteger << 8 | colorFractional;
+        }
+    }
+}
+
+static void benchColor()
+{
+    bench::section("Color lookup: gamma/white balance/brightness vs exact, and cost per channel");
+    printf("gamma %.2f, white balance %d/%d/%d, MAX_BRIGHTNESS %d\n", (double)LED_SPI_GAMMA, LED_SPI_WHITE_R,
+           LED_SPI_WHITE_G, LED_SPI_WHITE_B, MAX_BRIGHTNESS);
+    printf("%-12s %6s %10s %14s %10s %10s\n", "dither", "depth", "brightness", "max err/step", "monotonic", "ok");
+
+    const double WHITE[3] = {LED_SPI_WHITE_R / 255.0, LED_SPI_WHITE_G / 255.0, LED_SPI_WHITE_B / 255.0};
+    const uint8_t DEPTHS[] = {0, 3, 7};
+    const uint8_t BRIGHTNESS[] = {255, 128, 17, 0};
+    for (LED_SPI_Dither ditherMode : {LED_SPI_DITHER_BINARY, LED_SPI_DITHER_SIGMA_DELTA})
+    {
+        for (uint8_t depth : DEPTHS)
+        {
+            LEDSim::reset();
+            LED_SPI_CH32 leds(1, depth, LED_SPI_STREAMING);
+            leds.setDitherMode(ditherMode);
+            for (uint8_t brightness : BRIGHTNESS)
+            {
+                leds.setBrightness(brightness);
+
+                // One dither step is the smallest level difference the scheme can show
+                double stepsPerLevel = ditherMode == LED_SPI_DITHER_BINARY ? (1 << (depth + 1)) - 1 : 1 << std::min(depth + 1, 8);
+                double maxError = 0;
+                bool monotonic = true;
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    double previous = -1;
+                    for (int value = 0; value < 256; value++)
+                    {
+                        uint32_t color = LED_SPI_CH32::quantize(leds._colorLUT[channel], value);
+                        double fraction = ditherMode == LED_SPI_DITHER_BINARY ? (color & 0xFFFF) / stepsPerLevel : (color & 0xFF) / 256.0;
+                        double level = (color >> 16) + fraction;
+                        double exact = pow(value / 255.0, LED_SPI_GAMMA) * WHITE[channel] * brightness / 255.0 * MAX_BRIGHTNESS;
+                        maxError = std::max(maxError, fabs(level - exact) * stepsPerLevel);
+                        monotonic &= level >= previous;
+                        previous = level;
+                    }
+                }
+                // Half a step from rounding, plus the 1/65535 resolution of the gamma table, which
+                // is most of a step with MAX_BRIGHTNESS 255 and deep dithering
+                double tableError = 0.5 * MAX_BRIGHTNESS * stepsPerLevel / 65535;
+                bool ok = maxError <= 0.51 + tableError && monotonic;
+                printf("%-12s %6u %10u %14.3f %10s %10s\n", ditherMode == LED_SPI_DITHER_BINARY ? "binary" : "sigma-delta",
+                       depth, brightness, maxError, bench::check(monotonic, "yes", "NO"), bench::check(ok, "yes", "NO"));
+            }
+            leds.stop();
+        }
+    }
+
+    // The lookup replaces a divide and a modulo per channel
+    LEDSim::reset();
+    LED_SPI_CH32 leds(1, 3);
+    const size_t N = 4096;
+    static int values[N];
+    for (size_t i = 0; i < N; i++)
+        values[i] = nextRandom() & 0xFF;
+    volatile size_t numDitherBuffers = leds._numDitherBuffers; // Not a constant in the driver either
+    double legacyNs = bench::nsPerItem(N, [&] { uint32_t s = 0; size_t n = numDitherBuffers; for (size_t i = 0; i < N; i++) s += legacyQuantize(values[i], n); bench::sink = s; });
+    double lookupNs = bench::nsPerItem(N, [&] { uint32_t s = 0; for (size_t i = 0; i < N; i++) s += LED_SPI_CH32::quantize(leds._colorLUT[1], values[i]); bench::sink = s; });
+    printf("ns/channel: linear arithmetic %.2f, corrected lookup %.2f\n", legacyNs, lookupNs);
+
+    // setBrightness() rebuilds the whole lookup: the same tables as with 64-bit divides, at
+    // every brightness, dither depth and mode
+    static uint16_t lut[LED_CHANNELS][256], legacyLUT[LED_CHANNELS][256];
+    bool same = true;
+    for (LED_SPI_Dither ditherMode : {LED_SPI_DITHER_BINARY, LED_SPI_DITHER_SIGMA_DELTA})
+        for (uint8_t buffers = 1; buffers <= 8; buffers++)
+            for (int brightness = 0; brightness < 256; brightness++)
+            {
+                LED_SPI_CH32::computeColorLUT(lut, brightness, buffers, ditherMode);
+                legacyComputeColorLUT(legacyLUT, brightness, buffers, ditherMode);
+                same &= !memcmp(lut, legacyLUT, sizeof(lut));
+            }
+    volatile uint8_t brightness = 200;
+    double legacyUs = bench::nsPerItem(1, [&] { legacyComputeColorLUT(legacyLUT, brightness, 4, LED_SPI_DITHER_BINARY); bench::sink = legacyLUT[1][128]; }) / 1000;
+    double lutUs = bench::nsPerItem(1, [&] { LED_SPI_CH32::computeColorLUT(lut, brightness, 4, LED_SPI_DITHER_BINARY); bench::sink = lut[1][128]; }) / 1000;
+    printf("setBrightness() lookup rebuild, %d entries: 64-bit divides %.2f us, 32-bit %.2f us, same tables: %s\n",
+           (int)LED_CHANNELS * 256, legacyUs, lutUs, bench::check(same, "yes", "NO"));
+}
+
+/// Wire bytes of a streaming driver after start(), from the same point for every driver.
+static std::vector<uint8_t> streamedWire(LED_SPI_CH32 &leds, size_t bytes)
+{
+    leds.start();
+    LEDSim::capture = true;
+    LEDSim::run(bytes);
+    LEDSim::capture = false;
+    leds.stop();
+    return LEDSim::wire;
+}
+
+static void benchPalette()
+{
+    bench::section("Palette mode: 16 entries vs direct color (ns/LED for a full frame, us per palette change)");
+    printf("%6s %6s %10s %10s %12s %10s %10s %8s %8s\n", "LEDs", "dither", "direct", "palette", "entry+show", "color RAM",
+           "pal RAM", "same", "stream");
+
+    const size_t ENTRIES = 16;
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        for (uint8_t depth : {0, 3})
+        {
+            RGB colors[ENTRIES];
+            for (RGB &color : colors)
+                color = {(uint8_t)nextRandom(), (uint8_t)nextRandom(), (uint8_t)nextRandom()};
+            // Two alternating frames so every LED is dirty on every commit
+            std::vector<uint8_t> frames[2] = {std::vector<uint8_t>(numLEDs), std::vector<uint8_t>(numLEDs)};
+            for (size_t i = 0; i < numLEDs; i++)
+            {
+                frames[0][i] = nextRandom() % ENTRIES;
+                frames[1][i] = (frames[0][i] + 1 + nextRandom() % (ENTRIES - 1)) % ENTRIES;
+            }
+
+            LEDSim::reset();
+            LED_SPI_CH32 direct(numLEDs, depth);
+            LED_SPI_CH32 palette(numLEDs, depth, LED_SPI_BUFFERED, ENTRIES);
+            for (size_t entry = 0; entry < ENTRIES; entry++)
+                palette.setPaletteColor(entry, colors[entry]);
+
+            int frame = 0;
+            double directNs = bench::nsPerItem(numLEDs, [&] {
+                const std::vector<uint8_t> &f = frames[frame++ & 1];
+                for (size_t i = 0; i < numLEDs; i++)
+                    direct.setLED(i, colors[f[i]].r, colors[f[i]].g, colors[f[i]].b);
+                direct.show();
+            });
+            double paletteNs = bench::nsPerItem(numLEDs, [&] {
+                palette.setIndices(frames[frame++ & 1].data(), numLEDs);
+                palette.show();
+            });
+            int step = 0;
+            double entryNs = bench::nsPerItem(1, [&] {
+                step++;
+                palette.setPaletteColor(step % ENTRIES, colors[(step * 7) % ENTRIES]);
+                palette.show();
+            });
+
+            // Both drivers must produce identical DMA buffers for the same picture
+            for (size_t entry = 0; entry < ENTRIES; entry++)
+                palette.setPaletteColor(entry, colors[entry]);
+            for (size_t i = 0; i < numLEDs; i++)
+                direct.setLED(i, colors[frames[0][i]].r, colors[frames[0][i]].g, colors[frames[0][i]].b);
+            direct.show();
+            palette.setIndices(frames[0].data(), numLEDs);
+            palette.show();
+            bool same = !memcmp(direct._DMABuffer, palette._DMABuffer, direct._DMABufferSize * direct._numDitherBuffers);
+
+            // Streaming copies palette patterns in the ISR, the wire must not change
+            const size_t WIRE_BYTES = 4 * (numLEDs * LED_BYTES_PER_LED + 2 * STREAM_HALF_BYTES);
+            LEDSim::reset();
+            LED_SPI_CH32 directStream(numLEDs, depth, LED_SPI_STREAMING);
+            for (size_t i = 0; i < numLEDs; i++)
+                directStream.setLED(i, colors[frames[0][i]].r, colors[frames[0][i]].g, colors[frames[0][i]].b);
+            std::vector<uint8_t> directWire = streamedWire(directStream, WIRE_BYTES);
+            LEDSim::reset();
+            LED_SPI_CH32 paletteStream(numLEDs, depth, LED_SPI_STREAMING, ENTRIES);
+            for (size_t entry = 0; entry < ENTRIES; entry++)
+                paletteStream.setPaletteColor(entry, colors[entry]);
+            paletteStream.setIndices(frames[0].data(), numLEDs);
+            bool stream = streamedWire(paletteStream, WIRE_BYTES) == directWire;
+
+            size_t colorRAM = numLEDs * LED_CHANNELS * sizeof(uint32_t);
+            size_t paletteRAM = numLEDs + ENTRIES * (depth + 1) * PALETTE_ENTRY_WORDS * sizeof(uint32_t);
+            printf("%6zu %6u %10.2f %10.2f %12.2f %10zu %10zu %8s %8s\n", numLEDs, depth, directNs, paletteNs,
+                   entryNs / 1000, colorRAM, paletteRAM, bench::check(same, "yes", "NO"), bench::check(stream, "yes", "NO"));
+        }
+    }
+    printf("Palette changes re-encode one entry and copy it to the LEDs showing it (1/16 of the strip here).\n");
+
+    // The static driver sizes the palette at compile time and leaves out the color buffer
+    LEDSim::reset();
+    LED_SPI_CH32 dynamicPalette(60, 3, LED_SPI_BUFFERED, ENTRIES);
+    LED_SPI_CH32_Static<60, 3, LED_Protocol, LED_SPI_BUFFERED, ENTRIES> staticPalette;
+    for (size_t i = 0; i < 60; i++)
+    {
+        dynamicPalette.setPaletteColor(i % ENTRIES, {(uint8_t)(i * 3), (uint8_t)(i * 5), (uint8_t)(i * 7)});
+        staticPalette.setPaletteColor(i % ENTRIES, {(uint8_t)(i * 3), (uint8_t)(i * 5), (uint8_t)(i * 7)});
+        dynamicPalette.setIndex(i, (i * 11) % ENTRIES);
+        staticPalette.setIndex(i, (i * 11) % ENTRIES);
+    }
+    dynamicPalette.show();
+    staticPalette.show();
+    bool match = !memcmp(dynamicPalette._DMABuffer, staticPalette._DMABuffer, dynamicPalette._DMABufferSize * 4);
+    printf("static 60 LEDs, dither 3, 16 entries: %zu bytes of .bss (direct color: %zu), %s\n",
+           LED_SPI_CH32_Static<60, 3, LED_Protocol, LED_SPI_BUFFERED, ENTRIES>::RAM_BYTES,
+           LED_SPI_CH32_Static<60, 3>::RAM_BYTES, bench::check(match));
+}
+
+static void benchDirty()
+{
+    bench::section("Dirty tracking: commit cost when k LEDs change per frame (us/frame, dither=3)");
+    printf("%6s %10s %10s %10s %10s\n", "LEDs", "k=1", "k=5", "k=10%", "k=all");
+
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        printf("%6zu", numLEDs);
+        for (size_t changed : {(size_t)1, (size_t)5, numLEDs / 10, numLEDs})
+        {
+            LEDSim::reset();
+            LED_SPI_CH32 leds(numLEDs, 3);
+            leds.show();
+            int frame = 0;
+            double ns = bench::nsPerItem(1, [&] {
+                frame++;
+                for (size_t i = 0; i < changed; i++)
+                    leds.setLED((i * 7 + frame) % numLEDs, frame & 0xFF, i & 0xFF, 100);
+                leds.show();
+            });
+            printf(" %10.2f", ns / 1000);
+        }
+        printf("\n");
+    }
+
+    bench::section("Trim to last lit LED: 300 LED strip with the first k LEDs in use");
+    printf("%6s %12s %10s\n", "lit", "wire us/frm", "frames/s");
+    for (size_t lit : {(size_t)21, (size_t)60, (size_t)150, (size_t)300})
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(300, 0);
+        leds.setTrimToLit(true);
+        leds.fill(0, lit, {255, 128, 0});
+        leds.show();
+        leds.start();
+        LEDSim::runInterrupts(4);
+        uint64_t ns = LEDSim::nanos;
+        LEDSim::runInterrupts(20);
+        ns = LEDSim::nanos - ns;
+        printf("%6zu %12.1f %10.1f\n", lit, ns / 10 / 1000.0, 10 * 1e9 / ns);
+        leds.stop();
+    }
+}
+
+static void benchFrame()
+{
+    bench::section("Plasma frame: render + encode (us/frame)");
+    printf("%6s", "LEDs");
+    for (uint8_t depth : DITHER_DEPTHS)
+        printf("  dither=%u", depth);
+    printf("  ns/LED(d=3)\n");
+
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        printf("%6zu", numLEDs);
+        double lastNs = 0;
+        for (uint8_t depth : DITHER_DEPTHS)
+        {
+            LEDSim::reset();
+            LED_SPI_CH32 leds(numLEDs, depth);
+            // Owned and cached, as src/main.cpp draws it
+            static PlasmaEffect<> plasma;
+            int t = 0;
+            lastNs = bench::nsPerItem(1, [&] { plasma.draw(leds, numLEDs, t++); });
+            printf("  %8.2f", lastNs / 1000);
+        }
+        printf("  %11.2f\n", lastNs / numLEDs);
+    }
+}
+
+/// The plasma as it was written before Effect.cpp: every term evaluated per LED.
+static void drawPlasmaDirect(LED_SPI_CH32 &leds, size_t numLEDs, int t)
+{
+    const Q8 R = numLEDs;
+    const Q8 phaseR = Q8::fromRaw(t * 15 / 256);
+    const Q8 phaseG = Q8::fromRaw(t * 16 / 256 + FP_2PI / 3);
+    const Q8 phaseB = Q8::fromRaw(t * 17 / 256 - FP_2PI / 3);
+    const Q8 offset = 120 / 256.0;
+
+    for (size_t i = 0; i < numLEDs; i++)
+    {
+        const Q8 x = i;
+        const Q8 radiusR = sqrtFP(R * R - 2 * (x * (R * sinFP(phaseR))) + x * x);
+        const Q8 radiusG = sqrtFP(R * R - 2 * (x * (R * sinFP(phaseG))) + x * x);
+        const Q8 radiusB = sqrtFP(R * R - 2 * (x * (R * sinFP(phaseB))) + x * x);
+
+        leds.setLED(i,
+        sinFP(Q8::fromRaw(7 * t) + radiusR * 54 / 256) + offset,
+        sinFP(Q8::fromRaw(3 * t) + radiusG * 116 / 256) + offset,
+        sinFP(Q8::fromRaw(2 * t) + radiusB * 73 / 256) + offset);
+    }
+}
+
+static void benchEffect()
+{
+    bench::section("Plasma effect: hoisted, incremental and cached terms vs per LED evaluation (render only)");
+    printf("%6s %12s %12s %8s %14s %14s %6s\n", "LEDs", "direct us", "effect us", "speedup", "direct miss us",
+           "effect miss us", "same");
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 direct(numLEDs), effect(numLEDs), uncached(numLEDs);
+
+        // Same colors for every LED, frame by frame across several cache refreshes of every
+        // channel, then at random frames. drawPlasma() has no cache and must agree as well
+        static PlasmaEffect<> plasma;
+        bool same = true;
+        for (int t = 0; t < 600 && same; t++)
+        {
+            drawPlasmaDirect(direct, numLEDs, t);
+            plasma.draw(effect, numLEDs, t);
+            drawPlasma(uncached, numLEDs, t);
+            same = !memcmp(direct._LEDColors, effect._LEDColors, direct._LEDColorsSize * sizeof(uint32_t)) &&
+                   !memcmp(direct._LEDColors, uncached._LEDColors, direct._LEDColorsSize * sizeof(uint32_t));
+        }
+        for (int i = 0; i < 200 && same; i++)
+        {
+            int t = nextRandom() % 100000;
+            drawPlasmaDirect(direct, numLEDs, t);
+            plasma.draw(effect, numLEDs, t);
+            same = !memcmp(direct._LEDColors, effect._LEDColors, direct._LEDColorsSize * sizeof(uint32_t));
+        }
+
+        // Consecutive frames as the firmware draws them, and the worst case where every
+        // channel misses its cache (and every LED changes, which costs setLED() more)
+        int t = 0;
+        double directNs = bench::nsPerItem(1, [&] { drawPlasmaDirect(direct, numLEDs, t++); });
+        double effectNs = bench::nsPerItem(1, [&] { plasma.draw(effect, numLEDs, t++); });
+        double directMissNs = bench::nsPerItem(1, [&] { drawPlasmaDirect(direct, numLEDs, t += 256); });
+        double effectMissNs = bench::nsPerItem(1, [&] { plasma.draw(effect, numLEDs, t += 256); });
+        printf("%6zu %12.2f %12.2f %7.2fx %14.2f %14.2f %6s\n", numLEDs, directNs / 1000, effectNs / 1000,
+               directNs / effectNs, directMissNs / 1000, effectMissNs / 1000, bench::check(same));
+    }
+}
+
+/// HSV to RGB in float, h in turns: the reference for hsvToRGB() and the old way to feed setLEDf().
+static void hsvFloat(float h, float s, float v, float rgb[3])
+{
+    float sixths = (h - floorf(h)) * 6;
+    int sector = (int)sixths;
+    float f = sixths - sector;
+    float p = v * (1 - s), q = v * (1 - s * f), t = v * (1 - s * (1 - f));
+    const float table[6][3] = {{v, t, p}, {q, v, p}, {p, v, t}, {p, q, v}, {t, p, v}, {v, p, q}};
+    memcpy(rgb, table[sector % 6], sizeof(table[0]));
+}
+
+/// setLEDf() as it was: clamp and multiply in float.
+static void setLEDfFloat(LED_SPI_CH32 &leds, size_t index, float r, float g, float b)
+{
+    r = CLAMP(r, 0.0, 1.0);
+    g = CLAMP(g, 0.0, 1.0);
+    b = CLAMP(b, 0.0, 1.0);
+    leds.setLED(index, r * 255, g * 255, b * 255);
+}
+
+static void benchHSV()
+{
+    bench::section("HSV: fixed point hsvToRGB() and setLEDf() vs float");
+
+    // Every hue, a grid of saturations and values, against the float conversion rounded
+    int maxError = 0;
+    uint64_t totalError = 0, samples = 0;
+    for (int h = 0; h < 1024; h++)
+        for (int s = 0; s < 256; s += 5)
+            for (int v = 0; v < 256; v += 5)
+            {
+                RGB fixed = hsvToRGB({(uint16_t)h, (uint8_t)s, (uint8_t)v});
+                float reference[3];
+                hsvFloat(h / 1024.0f, s / 255.0f, v, reference);
+                const uint8_t got[3] = {fixed.r, fixed.g, fixed.b};
+                for (int c = 0; c < 3; c++)
+                {
+                    int error = abs(got[c] - (int)lrintf(reference[c]));
+                    maxError = std::max(maxError, error);
+                    totalError += error;
+                    samples++;
+                }
+            }
+    printf("hsvToRGB vs float: max error %d, mean %.3f levels over %llu channels %s\n", maxError,
+           (double)totalError / samples, (unsigned long long)samples, bench::check(maxError <= 2));
+
+    // Hue rotation: identity at 0 and a full turn, red to green and blue at thirds, greys kept
+    bool rotationOk = true;
+    for (int i = 0; i < 1000; i++)
+    {
+        RGB c = {(uint8_t)nextRandom(), (uint8_t)nextRandom(), (uint8_t)nextRandom()};
+        RGB same = HueRotation(0).apply(c), turned = HueRotation(FP_FIXED_VAL * 4).apply(c);
+        RGB grey = HueRotation(nextRandom() % 1024).apply({c.r, c.r, c.r});
+        rotationOk &= !memcmp(&same, &c, 3) && !memcmp(&turned, &c, 3);
+        rotationOk &= grey.r == c.r && grey.g == c.r && grey.b == c.r;
+    }
+    RGB green = HueRotation(1024 / 3).apply({255, 0, 0});
+    RGB blue = HueRotation(2 * 1024 / 3 + 1).apply({255, 0, 0});
+    rotationOk &= green.r <= 1 && green.g >= 254 && green.b <= 1 && blue.r <= 1 && blue.g <= 1 && blue.b >= 254;
+    printf("HueRotation: identity, thirds and greys %s (red + 1/3 turn = %d,%d,%d)\n", bench::check(rotationOk),
+           green.r, green.g, green.b);
+
+    // setLEDf(): the integer conversion against the float clamp and multiply, over every
+    // channel level, its neighbours, and random values in and out of range
+    size_t numLEDs = 300;
+    LEDSim::reset();
+    LED_SPI_CH32 fixedLEDs(numLEDs), floatLEDs(numLEDs);
+    size_t mismatches = 0, tried = 0;
+    auto compare = [&](float x) {
+        fixedLEDs.setLEDf(0, x, x, x);
+        setLEDfFloat(floatLEDs, 0, x, x, x);
+        mismatches += memcmp(fixedLEDs._LEDColors, floatLEDs._LEDColors, LED_CHANNELS * sizeof(uint32_t)) != 0;
+        tried++;
+    };
+    for (int level = 0; level <= 256; level++)
+    {
+        float x = level / 255.0f;
+        compare(x);
+        compare(nextafterf(x, 0));
+        compare(nextafterf(x, 2));
+    }
+    for (int i = 0; i < 100000; i++)
+        compare((int32_t)(nextRandom() % 2000000) / 1e6f - 0.5f);
+    compare(1e-40f);
+    compare(-0.0f);
+    compare(INFINITY);
+    compare(-INFINITY);
+    printf("setLEDf integer vs float: %zu of %zu values differ %s\n", mismatches, tried, bench::check(!mismatches));
+
+    // A rainbow drawn from float HSV through setLEDf(), and from HSV through setPixels()
+    std::vector<HSV> rainbow(numLEDs);
+    std::vector<RGB> rgb(numLEDs);
+    int t = 0;
+    double floatNs = bench::nsPerItem(numLEDs, [&] {
+        for (size_t i = 0; i < numLEDs; i++)
+        {
+            float c[3];
+            hsvFloat((i * 4 + t) / 1024.0f, 1.0f, 0.75f, c);
+            setLEDfFloat(floatLEDs, i, c[0], c[1], c[2]);
+        }
+        t++;
+    });
+    double setLEDfNs = bench::nsPerItem(numLEDs, [&] {
+        for (size_t i = 0; i < numLEDs; i++)
+        {
+            float c[3];
+            hsvFloat((i * 4 + t) / 1024.0f, 1.0f, 0.75f, c);
+            fixedLEDs.setLEDf(i, c[0], c[1], c[2]);
+        }
+        t++;
+    });
+    double batchNs = bench::nsPerItem(numLEDs, [&] {
+        for (size_t i = 0; i < numLEDs; i++)
+            rainbow[i] = {(uint16_t)(i * 4 + t), 255, 191};
+        fixedLEDs.setPixels(rainbow.data(), numLEDs);
+        t++;
+    });
+    double convertNs = bench::nsPerItem(numLEDs, [&] {
+        for (size_t i = 0; i < numLEDs; i++)
+            rgb[i] = hsvToRGB({(uint16_t)(i * 4 + t), 255, 191});
+        bench::sink = rgb[t % numLEDs].r;
+        t++;
+    });
+    HueRotation rotation(37);
+    double rotateNs = bench::nsPerItem(numLEDs, [&] {
+        rotation.apply(rgb.data(), numLEDs);
+        bench::sink = rgb[0].r;
+    });
+    printf("%-44s %8.2f ns/LED\n", "float HSV + float setLEDf (before)", floatNs);
+    printf("%-44s %8.2f ns/LED\n", "float HSV + integer setLEDf", setLEDfNs);
+    printf("%-44s %8.2f ns/LED (%.2fx)\n", "HSV array + setPixels(HSV)", batchNs, floatNs / batchNs);
+    printf("%-44s %8.2f ns/LED\n", "hsvToRGB only", convertNs);
+    printf("%-44s %8.2f ns/LED\n", "HueRotation::apply, in place", rotateNs);
+}
+
+/// One channel of one blend, the way loop() would write it by hand.
+static int blendChannel(LED_BlendMode mode, int d, int s, int alpha)
+{
+    switch (mode)
+    {
+    case LED_BLEND_ADD:
+        return std::min(255, d + (s * alpha >> 8));
+    case LED_BLEND_MULTIPLY:
+        s = (d * s + 255) >> 8;
+        break;
+    case LED_BLEND_MAX:
+        s = std::max(d, s);
+        break;
+    default:
+        break;
+    }
+    return (d * (256 - alpha) + s * alpha) >> 8;
+}
+
+/// Blend layers per channel and setLED() the result: the reference for LED_SPI_Compositor.
+template <size_t Layers>
+static void blendByHand(LED_SPI_CH32 &leds, size_t numLEDs, const uint32_t *const layers[Layers],
+                        const LED_BlendMode modes[Layers], const uint8_t opacity[Layers])
+{
+    for (size_t i = 0; i < numLEDs; i++)
+    {
+        int rgb[3] = {0, 0, 0};
+        for (size_t layer = 0; layer < Layers; layer++)
+        {
+            uint32_t pixel = layers[layer][i];
+            int alpha = pixel >> 24, layerAlpha = opacity[layer] + (opacity[layer] >> 7);
+            alpha = ((alpha + (alpha >> 7)) * layerAlpha) >> 8;
+            for (int c = 0; c < 3; c++)
+                rgb[c] = blendChannel(modes[layer], rgb[c], (pixel >> (16 - 8 * c)) & 0xFF, alpha);
+        }
+        leds.setLED(i, rgb[0], rgb[1], rgb[2]);
+    }
+}
+
+static void benchLayers()
+{
+    bench::section("Layers: SWAR compositor vs blending per channel by hand");
+    const size_t numLEDs = 300;
+    LEDSim::reset();
+    LED_SPI_CH32 composed(numLEDs), byHand(numLEDs);
+    static LED_SPI_Compositor<3, numLEDs> layers(composed, numLEDs);
+    const uint32_t *const pixels[3] = {layers.pixels(0), layers.pixels(1), layers.pixels(2)};
+    auto same = [&] { return !memcmp(composed._LEDColors, byHand._LEDColors, composed._LEDColorsSize * sizeof(uint32_t)); };
+
+    // Random pixels, modes and opacities, then random partial updates of random layers so
+    // the dirty ranges and the cached lower layers are exercised
+    LED_BlendMode modes[3];
+    uint8_t opacity[3];
+    bool ok = true;
+    for (int round = 0; round < 50 && ok; round++)
+    {
+        for (uint8_t layer = 0; layer < 3; layer++)
+        {
+            modes[layer] = (LED_BlendMode)(nextRandom() % 4);
+            opacity[layer] = nextRandom() % 4 ? nextRandom() : nextRandom() % 2 * 255;
+            layers.setBlendMode(layer, modes[layer]);
+            layers.setOpacity(layer, opacity[layer]);
+            for (size_t i = 0; i < numLEDs; i++)
+                layers.setPixel(layer, i, nextRandom() % 3 ? nextRandom() : nextRandom() % 2 * 0xFF000000u);
+        }
+        layers.compose();
+        blendByHand<3>(byHand, numLEDs, pixels, modes, opacity);
+        ok = same();
+        for (int frame = 0; frame < 20 && ok; frame++)
+        {
+            uint8_t layer = nextRandom() % 3;
+            size_t start = nextRandom() % numLEDs, count = nextRandom() % 40;
+            for (size_t i = start; i < start + count; i++)
+                layers.setPixel(layer, i, nextRandom());
+            layers.compose();
+            blendByHand<3>(byHand, numLEDs, pixels, modes, opacity);
+            ok = same();
+        }
+    }
+    printf("compositor vs per channel blend, all modes and opacities: %s\n", bench::check(ok));
+
+    // A moving gradient, sparkles added on top and a status LED range at half coverage
+    const LED_BlendMode sceneModes[3] = {LED_BLEND_NORMAL, LED_BLEND_ADD, LED_BLEND_NORMAL};
+    const uint8_t sceneOpacity[3] = {255, 255, 255};
+    for (uint8_t layer = 0; layer < 3; layer++)
+    {
+        layers.setBlendMode(layer, sceneModes[layer]);
+        layers.setOpacity(layer, 255);
+        layers.fill(layer, 0, numLEDs, 0);
+    }
+    layers.fill(2, 0, 8, 0x80FF2000);
+    int t = 0;
+    auto background = [&] {
+        uint32_t *out = layers.pixels(0);
+        for (size_t i = 0; i < numLEDs; i++)
+            out[i] = 0xFF000000u | (uint8_t)(i + t) << 16 | (uint8_t)(2 * i - t) << 8 | 0x40;
+        layers.markDirty(0, 0, numLEDs);
+    };
+    auto sparkles = [&] {
+        for (int i = 0; i < 30; i++)
+            layers.setPixel(1, nextRandom() % numLEDs, nextRandom() % 2 ? 0xFFC0C0C0u : 0);
+    };
+
+    double handNs = bench::nsPerItem(numLEDs, [&] {
+        background();
+        sparkles();
+        blendByHand<3>(byHand, numLEDs, pixels, sceneModes, sceneOpacity);
+        t++;
+    });
+    double allNs = bench::nsPerItem(numLEDs, [&] {
+        background();
+        sparkles();
+        layers.compose();
+        t++;
+    });
+    double sparkleNs = bench::nsPerItem(numLEDs, [&] {
+        sparkles();
+        layers.compose();
+    });
+    blendByHand<3>(byHand, numLEDs, pixels, sceneModes, sceneOpacity);
+    ok = same();
+    double idleNs = bench::nsPerItem(numLEDs, [&] { layers.compose(); });
+    printf("%-48s %8.2f ns/LED\n", "by hand, per channel, setLED()", handNs);
+    printf("%-48s %8.2f ns/LED (%.2fx)\n", "compositor, background moving", allNs, handNs / allNs);
+    printf("%-48s %8.2f ns/LED (%.2fx)\n", "compositor, only sparkles moving", sparkleNs, handNs / sparkleNs);
+    printf("%-48s %8.2f ns/LED\n", "compositor, nothing changed", idleNs);
+    printf("scene matches the per channel blend: %s\n", bench::check(ok));
+}
+
+/// Value noise the float way, the same lattice and smoothstep: what the fixed point replaces.
+static float valueNoiseFloat(float x, float y)
+{
+    float fx = floorf(x), fy = floorf(y);
+    int i = (int)fx, j = (int)fy;
+    float u = x - fx, v = y - fy;
+    u = u * u * (3 - 2 * u);
+    v = v * v * (3 - 2 * v);
+    auto lattice = [](int i, int j) { return noiseLattice(noiseHash(i, j)) / 256.0f; };
+    float bottom = lattice(i, j) + (lattice(i + 1, j) - lattice(i, j)) * u;
+    float top = lattice(i, j + 1) + (lattice(i + 1, j + 1) - lattice(i, j + 1)) * u;
+    return bottom + (top - bottom) * v;
+}
+
+/// Range and largest step between samples 1/256 cell apart, of noise along x at each y and along y at each x.
+struct NoiseRange
+{
+    int low = INT32_MAX, high = INT32_MIN, step = 0;
+
+    void add(int value, int previous)
+    {
+        low = std::min(low, value);
+        high = std::max(high, value);
+        step = std::max(step, abs(value - previous));
+    }
+};
+
+template <class Noise>
+static NoiseRange noiseRange2D(uint8_t octaves)
+{
+    // Whole rows and columns across 24 cells, at offsets that hit the cell edges and the
+    // wrap of the 256 cell lattice
+    const size_t N = 24 * FP_FIXED_VAL;
+    static Fixed8 line[N];
+    NoiseRange range;
+    for (Fixed8 across = -40 * FP_FIXED_VAL; across < 40 * FP_FIXED_VAL; across += 37)
+    {
+        Fixed8 start = 244 * FP_FIXED_VAL + across * 3;
+        fractalNoise<Noise>(line, N, start, 1, across, octaves);
+        for (size_t i = 0; i < N; i++)
+            range.add(line[i], line[i ? i - 1 : 0]);
+        // Along y: a column is a 1 wide matrix
+        fractalNoiseMatrix<Noise>(line, 1, N, false, across, start, 1, octaves);
+        for (size_t i = 0; i < N; i++)
+            range.add(line[i], line[i ? i - 1 : 0]);
+    }
+    return range;
+}
+
+template <class Noise>
+static void noiseRow(const char *name, uint8_t octaves, int maxStep)
+{
+    NoiseRange range = noiseRange2D<Noise>(octaves);
+    bool ok = range.low >= -FP_FIXED_VAL && range.high <= FP_FIXED_VAL && range.step <= maxStep;
+
+    const size_t numLEDs = 300;
+    static Fixed8 out[numLEDs];
+    Fixed8 y = 0;
+    double ns = bench::nsPerItem(numLEDs, [&] {
+        fractalNoise<Noise>(out, numLEDs, 0, FP_FIXED_VAL / 8, y += 5, octaves);
+        bench::sink = out[numLEDs - 1];
+    });
+    printf("%-10s %7u %6d %6d %9d %10.2f %11.1f %6s\n", name, octaves, range.low, range.high, range.step, ns,
+           ns * LEDSim::HCLK / 1e9, bench::check(ok));
+}
+
+static void benchNoise()
+{
+    bench::section("Noise: fixed point value and simplex noise, range, continuity and cost");
+
+    // 1D noise over a wide span, negative coordinates and the lattice wrap included
+    NoiseRange value1D, simplex1D;
+    for (Fixed8 x = -300 * FP_FIXED_VAL; x < 300 * FP_FIXED_VAL; x++)
+    {
+        value1D.add(valueNoise(x), valueNoise(x - 1));
+        simplex1D.add(simplexNoise(x), simplexNoise(x - 1));
+    }
+    for (auto [name, range] : {std::pair<const char *, NoiseRange>{"value 1D", value1D}, {"simplex 1D", simplex1D}})
+        printf("%-10s range %4d..%-4d largest step %d %s\n", name, range.low, range.high, range.step,
+               bench::check(range.low >= -FP_FIXED_VAL && range.high <= FP_FIXED_VAL && range.step <= 8));
+
+    // Steps are per 1/256 cell. Octave k moves 2^k times as fast at half the weight of k - 1,
+    // so each octave adds about half the single octave step, plus one for the rounding
+    printf("%-10s %7s %6s %6s %9s %10s %11s %6s\n", "noise", "octaves", "min", "max", "max step", "ns/LED",
+           "sim cyc/LED", "");
+    for (uint8_t octaves : {1, 2, 3, 4})
+        noiseRow<ValueNoise>("value", octaves, 3 * octaves + 2);
+    for (uint8_t octaves : {1, 2, 3, 4})
+        noiseRow<SimplexNoise>("simplex", octaves, 5 * octaves + 4);
+
+    // Float value noise, on the host FPU; the CH32X035 has none and calls soft-float instead
+    const size_t numLEDs = 300;
+    static float floatOut[numLEDs];
+    float y = 0;
+    double floatNs = bench::nsPerItem(numLEDs, [&] {
+        y += 0.02f;
+        for (size_t i = 0; i < numLEDs; i++)
+            floatOut[i] = valueNoiseFloat(i / 8.0f, y);
+        bench::sink = floatOut[numLEDs - 1];
+    });
+    printf("%-10s %7u %6s %6s %9s %10.2f %11.1f\n", "float", 1, "", "", "", floatNs, floatNs * LEDSim::HCLK / 1e9);
+
+    // A 16x16 serpentine matrix
+    static Fixed8 matrix[256];
+    Fixed8 t = 0;
+    double matrixNs = bench::nsPerItem(256, [&] {
+        fractalNoiseMatrix<SimplexNoise>(matrix, 16, 16, true, t += 3, 0, FP_FIXED_VAL / 6, 3);
+        bench::sink = matrix[255];
+    });
+    bool serpentine = true;
+    fractalNoiseMatrix<SimplexNoise>(matrix, 16, 16, true, 0, 0, FP_FIXED_VAL / 6, 3);
+    static Fixed8 row[16];
+    fractalNoise<SimplexNoise>(row, 16, 0, FP_FIXED_VAL / 6, FP_FIXED_VAL / 6, 3);
+    for (int column = 0; column < 16; column++)
+        serpentine &= matrix[16 + 15 - column] == row[column];
+    printf("16x16 serpentine matrix, simplex, 3 octaves: %.2f ns/LED, %.1f sim cycles/LED, LED order %s\n", matrixNs,
+           matrixNs * LEDSim::HCLK / 1e9, bench::check(serpentine));
+    printf("(sim cycles count host time in HCLK ticks, as LED_SPI_CYCLES() does on the host)\n");
+}
+
+/**
+ * @brief Turn SPI bytes back into the color bytes they encode, in wire order.
+ *
+ * @return false if any BITS_PER_SIGNAL group is neither SIGNAL_LOW nor SIGNAL_HIGH, or for
+ * clocked LEDs, if an LED does not start with a header byte.
+ */
+static bool decodeSymbols(const uint8_t *spi, size_t colorBytes, std::vector<uint8_t> &out)
+{
+    out.clear();
+#if LED_SPI_CLOCKED
+    for (size_t i = 0; i < colorBytes; i += LED_CHANNELS, spi += LED_BYTES_PER_LED)
+    {
+        if ((spi[0] & LED_APA102::HEADER) != LED_APA102::HEADER)
+            return false;
+        out.insert(out.end(), spi + LED_APA102::HEADER_BYTES, spi + LED_BYTES_PER_LED);
+    }
+    return true;
+#endif
+    size_t bit = 0;
+    for (size_t i = 0; i < colorBytes; i++)
+    {
+        uint8_t value = 0;
+        for (int b = 0; b < 8; b++)
+        {
+            uint32_t symbol = 0;
+            for (int s = 0; s < BITS_PER_SIGNAL; s++, bit++)
+                symbol = symbol << 1 | ((spi[bit / 8] >> (7 - bit % 8)) & 1);
+            if (symbol != SIGNAL_LOW && symbol != SIGNAL_HIGH)
+                return false;
+            value = value << 1 | (symbol == SIGNAL_HIGH);
+        }
+        out.push_back(value);
+    }
+    return true;
+}
+
+static void benchSimulator()
+{
+    bench::section("DMA/SPI simulation (ISR state machine)");
+    printf("%6s %6s %10s %10s %12s %10s %8s %8s\n", "LEDs", "dither", "bytes/frm", "IRQs/frm", "wire us/frm", "frames/s", "match", "decodes");
+
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        for (uint8_t depth : DITHER_DEPTHS)
+        {
+            LEDSim::reset();
+            LED_SPI_CH32 leds(numLEDs, depth);
+            drawPlasma(leds, numLEDs, 42);
+            leds.show();
+            leds.start();
+
+            // Let the state machine settle into its colour/reset rhythm, then measure one
+            // full dither cycle: (2^buffers - 1) colour frames, each followed by the reset gap
+            LEDSim::runInterrupts(2);
+            size_t frames = (1u << leds._numDitherBuffers) - 1;
+            uint64_t bytes = LEDSim::bytesSent, irqs = LEDSim::interrupts, ns = LEDSim::nanos;
+            LEDSim::wire.clear();
+            LEDSim::capture = true;
+            LEDSim::runInterrupts(2 * frames);
+            LEDSim::capture = false;
+            bytes = LEDSim::bytesSent - bytes;
+            irqs = LEDSim::interrupts - irqs;
+            ns = LEDSim::nanos - ns;
+
+            // Every colour burst on the wire must be one of the pre-rendered dither buffers
+            bool match = true;
+            size_t offset = 0;
+            for (size_t frame = 0; frame < frames && match; frame++)
+            {
+                offset += WAIT_BYTES;
+                bool found = false;
+                for (size_t buffer = 0; buffer < leds._numDitherBuffers && !found; buffer++)
+                    found = offset + leds._DMABufferSize <= LEDSim::wire.size() &&
+                            !memcmp(&LEDSim::wire[offset], leds._DMABuffer + buffer * leds._DMABufferSize, leds._DMABufferSize);
+                match = found;
+                offset += leds._DMABufferSize;
+            }
+
+            // The symbols of the first burst must decode to the quantized colors, plus at
+            // most one dither step
+            std::vector<uint8_t> decoded;
+            bool decodes = decodeSymbols(&LEDSim::wire[WAIT_BYTES], leds._LEDColorsSize, decoded);
+            for (size_t i = 0; i < decoded.size() && decodes; i++)
+            {
+                uint32_t color = leds._LEDColors[i];
+                int step = decoded[i] - (int)(color >> 16);
+                decodes = step == 0 || (step == 1 && (color & 0xFFFF));
+            }
+
+            printf("%6zu %6u %10llu %10.2f %12.1f %10.1f %8s %8s\n", numLEDs, depth,
+                   (unsigned long long)(bytes / frames), (double)irqs / frames, ns / 1000.0 / frames,
+                   1e9 * frames / ns, bench::check(match, "yes", "NO"), bench::check(decodes, "yes", "NO"));
+            leds.stop();
+        }
+    }
+}
+
+/// One row of the capacity plan: the timing model next to a simulated driver of the same configuration.
+template <size_t N, uint8_t D, LED_SPI_Mode M>
+static void planRow(const char *mode)
+{
+    typedef LED_SPI_Timing<N, D, M> Timing;
+
+    LEDSim::reset();
+    LED_SPI_CH32 leds(N, D, M);
+    drawPlasma(leds, N, 42);
+    leds.show();
+    leds.start();
+    leds.waitForFrame();
+    leds.waitForFrame();
+    uint64_t ns = LEDSim::nanos;
+    const int FRAMES = 2 * Timing::DITHER_FRAMES;
+    for (int frame = 0; frame < FRAMES; frame++)
+        leds.waitForFrame();
+    double simNs = (double)(LEDSim::nanos - ns) / FRAMES;
+    leds.stop();
+
+    // The simulation has no interrupt overhead, so it has to match the pure wire time. It
+    // counts whole ns per byte, so it may be up to 1 ns per byte short
+    bool match = simNs <= Timing::WIRE_NS + 1 && simNs >= Timing::WIRE_NS - Timing::WIRE_BYTES - 1;
+    printf("%-9s %5zu %3u %9.1f %9.1f %8.1f %8.1f %8zu %8zu %8.0f %5s %6s\n", mode, N, D, Timing::WIRE_NS / 1000,
+           simNs / 1000, Timing::FRAME_HZ, Timing::DITHER_HZ, Timing::DMA_BYTES, Timing::RAM_BYTES,
+           Timing::ENCODE_BUDGET_CYCLES, Timing::meets(100) ? "yes" : "no", bench::check(match));
+}
+
+template <size_t N, uint8_t D>
+static void planRows()
+{
+    planRow<N, D, LED_SPI_BUFFERED>("buffered");
+    planRow<N, D, LED_SPI_CIRCULAR>("circular");
+    planRow<N, D, LED_SPI_STREAMING>("streaming");
+}
+
+/// Pulse timings of the symbols at an SPI prescaler, from the model alone.
+template <uint32_t Prescaler>
+static void pulsesAt()
+{
+    typedef LED_SPI_Timing<60, 0, LED_SPI_BUFFERED, 0, LED_SPI_CYCLES_HZ / Prescaler> Timing;
+    printf("%9u %7.1f %7.0f %7.0f %7.0f %7.0f %7.1f %9s\n", (unsigned)Prescaler, LED_SPI_CYCLES_HZ / Prescaler / 1e6,
+           Timing::T0H_NS, Timing::T0L_NS, Timing::T1H_NS, Timing::T1L_NS, Timing::WIRE_GAP_NS / 1000,
+           Timing::PULSES_OK && Timing::RESET_OK ? "in spec" : "no");
+}
+
+static void benchTiming()
+{
+    bench::section("Timing model and capacity plan (LEDTiming.h) against the simulation");
+    printf("buffered mode adds %d us of interrupt overhead per frame to the wire time\n", LED_SPI_BUFFERED_OVERHEAD_US);
+    printf("%-9s %5s %3s %9s %9s %8s %8s %8s %8s %8s %5s %6s\n", "mode", "LEDs", "D", "wire us", "sim us", "fps",
+           "cycle Hz", "DMA B", "RAM B", "enc cyc", "100Hz", "match");
+    planRows<60, 0>();
+    planRows<60, 3>();
+    planRows<150, 0>();
+    planRows<150, 3>();
+    planRows<300, 0>();
+    planRows<300, 3>();
+
+#if LED_SPI_CLOCKED
+    printf("pulse timings    not used by clocked LEDs\n");
+#else
+    // The symbols at other prescalers: what the same encoding would put on the wire
+    printf("%9s %7s %7s %7s %7s %7s %7s %9s\n", "prescaler", "MHz", "T0H ns", "T0L ns", "T1H ns", "T1L ns", "zeros us",
+           "datasheet");
+    pulsesAt<4>();
+    pulsesAt<8>();
+    pulsesAt<16>();
+    pulsesAt<32>();
+
+    // Decode an encoded frame back into pulses: every bit has to be one of the two modelled
+    // symbols, and their widths are checked against the datasheet
+    typedef LED_SPI_Timing<60> Timing;
+    const size_t N = 60;
+    LEDSim::reset();
+    LED_SPI_CH32 leds(N);
+    for (size_t i = 0; i < N; i++)
+        leds.setLED(i, nextRandom() & 0xFF, nextRandom() & 0xFF, nextRandom() & 0xFF, nextRandom() & 0xFF);
+    leds.show();
+
+    size_t pulses = 0, zeros = 0, ones = 0;
+    uint32_t high = 0, low = 0;
+    bool symbols = true;
+    auto pulse = [&] {
+        pulses++;
+        if (high == LED_SymbolHighBits(SIGNAL_LOW) && low == BITS_PER_SIGNAL - high)
+            zeros++;
+        else if (high == LED_SymbolHighBits(SIGNAL_HIGH) && low == BITS_PER_SIGNAL - high)
+            ones++;
+        else
+            symbols = false;
+        high = low = 0;
+    };
+    for (size_t i = 0; i < leds._DMABufferSize * 8; i++)
+    {
+        bool bit = (leds._DMABuffer[i / 8] >> (7 - i % 8)) & 1;
+        if (bit && low)
+            pulse();
+        (bit ? high : low)++;
+    }
+    pulse();
+    symbols &= pulses == N * LED_CHANNELS * 8;
+
+    const LED_PulseSpec &spec = LED_PROTOCOL_PULSES;
+    printf("decoded pulses   %zu zeros, %zu ones, %s\n", zeros, ones, bench::check(symbols));
+    printf("T0H %4.0f ns  (%u..%u)   T1H %4.0f ns  (%u..%u)   T0L %4.0f ns  (%u..%u)   T1L %4.0f ns  (%u..%u)   %s\n",
+           Timing::T0H_NS, spec.t0hMin, spec.t0hMax, Timing::T1H_NS, spec.t1hMin, spec.t1hMax, Timing::T0L_NS,
+           spec.t0lMin, spec.lowMax, Timing::T1L_NS, spec.t1lMin, spec.lowMax,
+           Timing::PULSES_OK ? "in spec" : "out of spec");
+#endif
+}
+
+/**
+ * @brief Split a captured wire dump into colour bursts separated by runs of reset zeros.
+ *
+ * Clocked LEDs send zero color bytes as they are, so there a burst is the run of LEDs that
+ * start with a header byte.
+ */
+static std::vector<std::pair<size_t, size_t>> colourBursts(const std::vector<uint8_t> &wire)
+{
+    std::vector<std::pair<size_t, size_t>> bursts;
+    size_t i = 0;
+    while (i < wire.size())
+    {
+        while (i < wire.size() && wire[i] == 0)
+            i++;
+        if (i == wire.size())
+            break; // Ends in zeros
+        size_t start = i;
+#if LED_SPI_CLOCKED
+        while (i + LED_BYTES_PER_LED <= wire.size() && (wire[i] & LED_APA102::HEADER) == LED_APA102::HEADER)
+            i += LED_BYTES_PER_LED;
+        if (i == start)
+            i++; // Partial LED at the start of the capture
+#else
+        while (i < wire.size() && wire[i] != 0)
+            i++;
+#endif
+        if (i > start)
+            bursts.push_back({start, i - start});
+    }
+    return bursts;
+}
+
+static void benchTearing()
+{
+    bench::section("Tearing: render at full speed while the DMA streams");
+    printf("%9s %6s %8s %8s %8s %6s\n", "mode", "LEDs", "frames", "bursts", "torn", "whole");
+
+    for (LED_SPI_Mode mode : {LED_SPI_BUFFERED, LED_SPI_CIRCULAR})
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(numLEDs, 0, mode);
+        leds.show();
+        leds.start();
+        LEDSim::capture = true;
+
+        // Every frame paints all LEDs the same colour, so a burst mixing two colours is torn.
+        // Drawing one LED costs two LEDs of wire time, so the DMA overtakes the renderer
+        // and any sharing of buffers shows up.
+        const int FRAMES = 64;
+        for (int frame = 1; frame <= FRAMES; frame++)
+        {
+            while (leds.commitPending())
+                LEDSim::run(16);
+            for (size_t i = 0; i < numLEDs; i++)
+            {
+                leds.setLED(i, frame * 4, 0, 255 - frame * 4);
+                LEDSim::run(2 * LED_BYTES_PER_LED);
+            }
+            leds.show();
+        }
+        LEDSim::runInterrupts(4);
+        LEDSim::capture = false;
+
+        size_t torn = 0;
+        const size_t LED_BYTES = LED_BYTES_PER_LED;
+
+        auto bursts = colourBursts(LEDSim::wire);
+        // The first and last bursts may be cut by the capture window
+        for (size_t b = 1; b + 1 < bursts.size(); b++)
+        {
+            const uint8_t *burst = &LEDSim::wire[bursts[b].first];
+            bool whole = bursts[b].second == numLEDs * LED_BYTES;
+            for (size_t led = 1; led < numLEDs && whole; led++)
+                whole = !memcmp(burst, burst + led * LED_BYTES, LED_BYTES);
+            torn += !whole;
+        }
+        printf("%9s %6zu %8d %8zu %8zu %6s\n", mode == LED_SPI_CIRCULAR ? "circular" : "buffered", numLEDs, FRAMES,
+               bursts.size(), torn, bench::check(torn == 0));
+        leds.stop();
+    }
+}
+
+static void benchStreaming()
+{
+    bench::section("Streaming ring (HT/TC just-in-time encode)");
+    printf("%6s %6s %9s %9s %10s %10s %8s %8s\n", "LEDs", "dither", "ring B", "buffer B", "IRQs/frm", "frames/s", "min gap", "decodes");
+
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        for (uint8_t depth : DITHER_DEPTHS)
+        {
+            LEDSim::reset();
+            LED_SPI_CH32 leds(numLEDs, depth, LED_SPI_STREAMING);
+            drawPlasma(leds, numLEDs, 42);
+            leds.start();
+
+            const size_t FRAME_BYTES = numLEDs * LED_BYTES_PER_LED;
+            LEDSim::run(4 * FRAME_BYTES);
+            uint64_t irqs = LEDSim::interrupts, ns = LEDSim::nanos;
+            LEDSim::capture = true;
+            LEDSim::run(16 * FRAME_BYTES);
+            LEDSim::capture = false;
+            irqs = LEDSim::interrupts - irqs;
+            ns = LEDSim::nanos - ns;
+
+            // Whole bursts only: the capture window cuts the first and last ones
+            auto bursts = colourBursts(LEDSim::wire);
+            size_t frames = 0, minGap = SIZE_MAX;
+            bool decodes = true;
+            std::vector<uint8_t> decoded;
+            for (size_t b = 1; b + 1 < bursts.size(); b++)
+            {
+                frames++;
+                minGap = std::min(minGap, bursts[b + 1].first - (bursts[b].first + bursts[b].second));
+                decodes &= bursts[b].second == FRAME_BYTES &&
+                           decodeSymbols(&LEDSim::wire[bursts[b].first], leds._LEDColorsSize, decoded);
+                for (size_t i = 0; i < decoded.size() && decodes; i++)
+                {
+                    int step = decoded[i] - (int)(leds._LEDColors[i] >> 16);
+                    decodes = step == 0 || (step == 1 && (leds._LEDColors[i] & 0xFFFF));
+                }
+            }
+            decodes &= minGap >= STREAM_RESET_BYTES;
+            double seconds = ns * 1e-9;
+            double framesPerSecond = (bursts.size() - 1) / seconds;
+
+            printf("%6zu %6u %9d %9zu %10.2f %10.1f %8zu %8s\n", numLEDs, depth, (int)(2 * STREAM_HALF_BYTES),
+                   2 * FRAME_BYTES * (depth + 1), irqs / seconds / framesPerSecond, framesPerSecond, minGap,
+                   bench::check(frames && decodes, "yes", "NO"));
+            leds.stop();
+        }
+    }
+
+    // An interrupt held off past both halves is counted, and only refills the half the DMA
+    // is not reading
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(60, 0, LED_SPI_STREAMING);
+        drawPlasma(leds, 60, 42);
+        leds.start();
+        LEDSim::run(STREAM_HALF_BYTES / 2);
+        bool onTime = leds.streamUnderruns() == 0;
+        LEDSim::irqEnabled = false;
+        LEDSim::run(2 * STREAM_HALF_BYTES); // Past HT and TC, back in the first half
+        LEDSim::irqEnabled = true;
+        std::vector<uint8_t> live(leds._streamBuffer, leds._streamBuffer + STREAM_HALF_BYTES);
+        std::vector<uint8_t> idle(leds._streamBuffer + STREAM_HALF_BYTES, leds._streamBuffer + 2 * STREAM_HALF_BYTES);
+        DMA1_Channel3_IRQHandler();
+        bool kept = !memcmp(live.data(), leds._streamBuffer, STREAM_HALF_BYTES);
+        bool refilled = memcmp(idle.data(), leds._streamBuffer + STREAM_HALF_BYTES, STREAM_HALF_BYTES) != 0;
+        printf("late interrupt   %u underrun, live half %s, other half %s, %s\n", (unsigned)leds.streamUnderruns(),
+               kept ? "kept" : "overwritten", refilled ? "refilled" : "stale",
+               bench::check(onTime && leds.streamUnderruns() == 1 && kept && refilled));
+        leds.stop();
+    }
+
+    // The ISR must encode a half before the DMA has drained the other one. Host timing only:
+    // the headroom says how much slower the target may be, it is not a cycle count of it
+    bench::section("Streaming ISR budget (host only): encode one half vs SPI drain time");
+    LEDSim::reset();
+    LED_SPI_CH32 leds(300, 3, LED_SPI_STREAMING);
+    drawPlasma(leds, 300, 42);
+    leds.show();
+    double encodeNs = bench::nsPerItem(1, [&] {
+        if (leds._streamLED >= leds._numLEDs)
+            leds._streamLED = 0;
+        leds.fillStreamHalf(leds._streamBuffer);
+    });
+    LEDSim::spi1.CTLR1.value = (LEDSim::spi1.CTLR1.value & ~SPI_CTLR1_BR) | SPI_PRESCALER;
+    double drainNs = (double)STREAM_HALF_BYTES * LEDSim::byteNanos();
+    printf("chunk            %d LEDs (%d bytes per half)\n", STREAM_CHUNK_LEDS, (int)STREAM_HALF_BYTES);
+    printf("SPI drain        %.0f ns per half = %.0f cycles at 48 MHz\n", drainNs, drainNs * LEDSim::HCLK / 1e9);
+    printf("host encode      %.0f ns per half\n", encodeNs);
+    printf("headroom         %.0fx: the target may be that many times slower than this host\n", drainNs / encodeNs);
+}
+
+/// Position of the green byte within an LED on the wire.
+static size_t greenSlot()
+{
+    size_t slot = 0;
+    while (LED_Protocol::channel(slot) != LED_G)
+        slot++;
+    return slot;
+}
+
+/**
+ * @brief Record the output level of one channel over consecutive frames.
+ *
+ * Runs a single LED streaming driver in the simulator and decodes the green byte of
+ * every frame that goes out on the wire.
+ */
+static std::vector<uint8_t> ditherSequence(uint8_t depth, LED_SPI_Dither ditherMode, uint8_t value, size_t frames)
+{
+    LEDSim::reset();
+    LED_SPI_CH32 leds(1, depth, LED_SPI_STREAMING);
+    leds.setDitherMode(ditherMode);
+    leds.setLED(0, 0, value, 0);
+    leds.start();
+    LEDSim::capture = true;
+
+    std::vector<uint8_t> levels, decoded;
+    while (levels.size() < frames)
+    {
+        LEDSim::wire.clear();
+        LEDSim::run(2 * STREAM_HALF_BYTES);
+        for (auto &burst : colourBursts(LEDSim::wire))
+            if (burst.second == LED_BYTES_PER_LED && decodeSymbols(&LEDSim::wire[burst.first], LED_CHANNELS, decoded))
+                levels.push_back(decoded[greenSlot()]);
+    }
+    levels.resize(frames);
+    leds.stop();
+    return levels;
+}
+
+static void benchDither()
+{
+    bench::section("Temporal dithering: average intensity error and visible flicker, all 256 inputs");
+    printf("Flicker is the largest DFT amplitude (in output steps) below %d Hz at the frame rate of\n", 60);
+    printf("a 300 LED strip (104 fps) and a 60 LED strip (518 fps).\n");
+    printf("%-22s %7s %9s %9s %12s %12s %9s\n", "scheme", "levels", "mean err", "max err", "flicker@104", "flicker@518", "DMA RAM");
+
+    struct Scheme
+    {
+        const char *name;
+        uint8_t depth;
+        LED_SPI_Dither ditherMode;
+    };
+    const Scheme SCHEMES[] = {
+        {"binary, depth 3", 3, LED_SPI_DITHER_BINARY},
+        {"sigma-delta, depth 3", 3, LED_SPI_DITHER_SIGMA_DELTA},
+        {"sigma-delta, depth 7", 7, LED_SPI_DITHER_SIGMA_DELTA},
+    };
+    const size_t FRAMES = 1024;
+    const double FRAME_RATES[] = {104, 518};
+    static double cosTable[FRAMES], sinTable[FRAMES];
+    for (size_t n = 0; n < FRAMES; n++)
+    {
+        cosTable[n] = cos(2 * M_PI * n / FRAMES);
+        sinTable[n] = sin(2 * M_PI * n / FRAMES);
+    }
+
+    for (const Scheme &scheme : SCHEMES)
+    {
+        double meanError = 0, maxError = 0, flicker[2] = {0, 0};
+        for (int value = 0; value < 256; value++)
+        {
+            std::vector<uint8_t> levels = ditherSequence(scheme.depth, scheme.ditherMode, value, FRAMES);
+
+            double mean = 0;
+            for (uint8_t level : levels)
+                mean += level;
+            mean /= FRAMES;
+            // Against the level the color lookup asks for, so only the dithering is measured
+            double error = fabs(mean - LED_SPI_COLOR_TABLE.levels[1][value] * MAX_BRIGHTNESS / 65535.0);
+            meanError += error / 256;
+            maxError = std::max(maxError, error);
+
+            for (int rate = 0; rate < 2; rate++)
+            {
+                for (size_t k = 1; k < FRAMES / 2 && k * FRAME_RATES[rate] / FRAMES < 60; k++)
+                {
+                    double re = 0, im = 0;
+                    for (size_t n = 0; n < FRAMES; n++)
+                    {
+                        re += (levels[n] - mean) * cosTable[k * n % FRAMES];
+                        im -= (levels[n] - mean) * sinTable[k * n % FRAMES];
+                    }
+                    flicker[rate] = std::max(flicker[rate], 2 * sqrt(re * re + im * im) / FRAMES);
+                }
+            }
+        }
+
+        size_t levelsPerStep = scheme.ditherMode == LED_SPI_DITHER_BINARY ? (1u << (scheme.depth + 1)) - 1 : 1u << (scheme.depth + 1);
+        size_t bufferRAM = scheme.ditherMode == LED_SPI_DITHER_BINARY ? 2 * 300 * LED_BYTES_PER_LED * (scheme.depth + 1) : 2 * STREAM_HALF_BYTES + 300 * LED_CHANNELS;
+        printf("%-22s %7zu %9.4f %9.4f %12.3f %12.3f %9zu\n", scheme.name, levelsPerStep, meanError, maxError,
+               flicker[0], flicker[1], bufferRAM);
+    }
+    printf("DMA RAM is for 300 LEDs: double buffered frames for binary, ring + accumulators for sigma-delta.\n");
+
+    // Switched while the stream runs: the interrupts from then on carry the accumulators
+    LEDSim::reset();
+    LED_SPI_CH32 leds(60, 3, LED_SPI_STREAMING);
+    leds.start();
+    LEDSim::run(3 * STREAM_HALF_BYTES / 2);
+    leds.setDitherMode(LED_SPI_DITHER_SIGMA_DELTA);
+    for (size_t i = 0; i < 60; i++)
+        leds.setLED(i, 0, 37, 0);
+    uint32_t frames = leds.frameCount();
+    LEDSim::run(8 * 60 * LED_BYTES_PER_LED);
+    bool carried = false;
+    for (size_t i = 0; leds._ditherError && i < leds._LEDColorsSize; i++)
+        carried |= leds._ditherError[i] != 0;
+    printf("switch running   %u frames after sigma-delta was set, accumulators %s, %s\n",
+           (unsigned)(leds.frameCount() - frames), carried ? "in use" : "idle",
+           bench::check(carried && leds.frameCount() - frames >= 4));
+    leds.stop();
+}
+
+static void benchProtocol()
+{
+#if LED_SPI_PROTOCOL == LED_PROTOCOL_APA102
+    const char *name = "APA102/SK9822";
+#elif LED_SPI_PROTOCOL == LED_PROTOCOL_SK6812_RGBW
+    const char *name = "SK6812 RGBW";
+#elif LED_SPI_PROTOCOL == LED_PROTOCOL_WS2811
+    const char *name = "WS2811";
+#else
+    const char *name = "WS2812";
+#endif
+    bench::section("LED protocol (LED_SPI_PROTOCOL): wire cost and channel order");
+    printf("protocol         %s, %d channels, %s\n", name, (int)LED_CHANNELS, LED_SPI_CLOCKED ? "clocked" : "one wire");
+    printf("SPI clock        %.1f MHz, %d bytes per LED, %d byte reset gap\n", SPI_CLOCK / 1e6, (int)LED_BYTES_PER_LED,
+           (int)WAIT_BYTES);
+    printf("%6s %10s %12s %10s\n", "LEDs", "bytes/frm", "wire us/frm", "frames/s");
+    for (size_t numLEDs : LED_COUNTS)
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(numLEDs);
+        drawPlasma(leds, numLEDs, 42);
+        leds.show();
+        leds.start();
+        LEDSim::runInterrupts(2);
+        uint64_t bytes = LEDSim::bytesSent, ns = LEDSim::nanos;
+        LEDSim::runInterrupts(2 * 8);
+        bytes = LEDSim::bytesSent - bytes;
+        ns = LEDSim::nanos - ns;
+        printf("%6zu %10llu %12.1f %10.1f\n", numLEDs, (unsigned long long)(bytes / 8), ns / 1000.0 / 8, 8e9 / ns);
+        leds.stop();
+    }
+
+    // Every slot on the wire must carry the input channel the protocol puts there
+    const size_t N = 60;
+    LEDSim::reset();
+    LED_SPI_CH32 leds(N);
+    std::vector<int> input(N * 4);
+    for (size_t i = 0; i < N; i++)
+    {
+        for (int c = 0; c < 4; c++)
+            input[i * 4 + c] = nextRandom() & 0xFF;
+        leds.setLED(i, input[i * 4], input[i * 4 + 1], input[i * 4 + 2], input[i * 4 + 3]);
+    }
+    leds.setGlobalBrightness(7);
+    leds.show();
+    leds.start();
+    LEDSim::runInterrupts(2);
+    LEDSim::wire.clear();
+    LEDSim::capture = true;
+    LEDSim::runInterrupts(2);
+    LEDSim::capture = false;
+    leds.stop();
+
+    std::vector<uint8_t> decoded;
+    auto bursts = colourBursts(LEDSim::wire);
+    bool order = !bursts.empty() && bursts[0].second == N * LED_BYTES_PER_LED &&
+                 decodeSymbols(&LEDSim::wire[bursts[0].first], N * LED_CHANNELS, decoded);
+    for (size_t i = 0; i < N && order; i++)
+        for (size_t slot = 0; slot < LED_CHANNELS; slot++)
+        {
+            // First dither buffer: the integer part plus the lowest fraction bit
+            LED_Channel channel = LED_Protocol::channel(slot);
+            uint32_t level = LED_SPI_CH32::quantize(leds._colorLUT[channel], input[i * 4 + channel]);
+            order &= decoded[i * LED_CHANNELS + slot] == (level >> 16) + (level & 1);
+        }
+    printf("channel order    %s\n", bench::check(order));
+#if LED_SPI_CLOCKED
+    bool headers = order;
+    for (size_t i = 0; i < N && headers; i++)
+        headers = LEDSim::wire[bursts[0].first + i * LED_BYTES_PER_LED] == (LED_APA102::HEADER | 7);
+    printf("global level 7   %s\n", bench::check(headers));
+#endif
+}
+
+#if !LED_SPI_CLOCKED
+/**
+ * @brief Turn the slices of one output, from port value start on, back into color bytes,
+ * like decodeSymbols() does for SPI bytes.
+ *
+ * @return false if any PARALLEL_SLICES_PER_BIT group is neither symbol.
+ */
+static bool decodeSlices(const std::vector<uint16_t> &port, size_t start, int output, size_t colorBytes, std::vector<uint8_t> &out)
+{
+    out.clear();
+    for (size_t i = 0; i < colorBytes; i++)
+    {
+        uint8_t value = 0;
+        for (int b = 0; b < 8; b++)
+        {
+            uint32_t symbol = 0;
+            for (int s = 0; s < PARALLEL_SLICES_PER_BIT; s++)
+                symbol = symbol << 1 | ((port[start++] >> output) & 1);
+            if (symbol != PARALLEL_SIGNAL_LOW && symbol != PARALLEL_SIGNAL_HIGH)
+                return false;
+            value = value << 1 | (symbol == PARALLEL_SIGNAL_HIGH);
+        }
+        out.push_back(value);
+    }
+    return true;
+}
+
+/// Run both simulated DMA engines together until the timer one has sent `slices` port values.
+static void runParallel(uint64_t slices)
+{
+    uint64_t target = LEDSim::timerTransfers + slices;
+    while (LEDSim::timerTransfers < target && LEDSim::step())
+        ;
+}
+#endif
+
+static void benchParallel()
+{
+    bench::section("Parallel outputs: transposed GPIO DMA vs one SPI strip");
+#if LED_SPI_CLOCKED
+    printf("not available for clocked LEDs\n");
+#else
+    // The kernel against the bit by bit definition
+    const size_t N = 4096;
+    static uint8_t matrices[N][8];
+    for (auto &rows : matrices)
+        for (auto &row : rows)
+            row = nextRandom();
+    bool transposes = true;
+    for (auto &rows : matrices)
+    {
+        uint8_t planes[8];
+        LED_Parallel_CH32::transpose8(rows, planes);
+        for (int b = 0; b < 8; b++)
+            for (int k = 0; k < 8; k++)
+                transposes &= ((planes[b] >> k) & 1) == ((rows[k] >> (7 - b)) & 1);
+    }
+    double kernelNs = bench::nsPerItem(N, [&] {
+        uint32_t sum = 0;
+        uint8_t planes[8];
+        for (auto &rows : matrices)
+        {
+            LED_Parallel_CH32::transpose8(rows, planes);
+            sum += planes[0] + planes[7];
+        }
+        bench::sink = sum;
+    });
+    double naiveNs = bench::nsPerItem(N, [&] {
+        uint32_t sum = 0;
+        uint8_t planes[8];
+        for (auto &rows : matrices)
+        {
+            for (int b = 0; b < 8; b++)
+            {
+                planes[b] = 0;
+                for (int k = 0; k < 8; k++)
+                    planes[b] |= ((rows[k] >> (7 - b)) & 1) << k;
+            }
+            sum += planes[0] + planes[7];
+        }
+        bench::sink = sum;
+    });
+    printf("transpose8       %.2f ns (bit loop %.2f ns), %s\n", kernelNs, naiveNs, bench::check(transposes));
+
+    // Every output must carry the bits LED_SPI_CH32 sends for its segment, then stay low
+    const size_t LEDS = 300;
+    printf("symbols          %d slices of %.0f ns, T0H %.0f T1H %.0f T0L %.0f T1L %.0f ns\n", PARALLEL_SLICES_PER_BIT,
+           LED_ParallelPulses::SLICE_NS, LED_ParallelPulses::T0H_NS, LED_ParallelPulses::T1H_NS, LED_ParallelPulses::T0L_NS,
+           LED_ParallelPulses::T1L_NS);
+    printf("%8s %8s %10s %12s %10s %10s %8s\n", "outputs", "segment", "RAM bytes", "wire us/frm", "frames/s", "show us", "match");
+    for (uint8_t outputs : {1, 2, 3, 4, 8})
+    {
+        LEDSim::reset();
+        LED_Parallel_CH32 parallel(LEDS, outputs);
+        std::vector<uint8_t> colors(LEDS * 3);
+        for (size_t i = 0; i < LEDS; i++)
+        {
+            for (int c = 0; c < 3; c++)
+                colors[i * 3 + c] = nextRandom();
+            parallel.setLED(i, colors[i * 3], colors[i * 3 + 1], colors[i * 3 + 2]);
+        }
+        double showNs = bench::nsPerItem(1, [&] { parallel.show(); });
+        parallel.start();
+        LEDSim::capture = true;
+        runParallel(2 * (PARALLEL_RESET_SLICES + parallel._frameBytes));
+        LEDSim::capture = false;
+
+        const std::vector<uint16_t> &port = LEDSim::gpioWire;
+        size_t segment = parallel.segmentLength(), frameSlices = parallel._frameBytes;
+        bool match = port.size() == 2 * (PARALLEL_RESET_SLICES + frameSlices);
+        for (size_t i = 0; i < PARALLEL_RESET_SLICES && match; i++)
+            match = port[i] == 0 && port[PARALLEL_RESET_SLICES + frameSlices + i] == 0;
+        for (size_t i = 0; i < port.size() && match; i++)
+            match = port[i] >> outputs == 0;
+        for (int output = 0; output < outputs && match; output++)
+        {
+            size_t first = output * segment, count = first < LEDS ? std::min(segment, LEDS - first) : 0;
+            std::vector<uint8_t> bits, expected;
+            if (count)
+            {
+                LED_SPI_CH32 single(count);
+                for (size_t i = 0; i < count; i++)
+                    single.setLED(i, colors[(first + i) * 3], colors[(first + i) * 3 + 1], colors[(first + i) * 3 + 2]);
+                single.show();
+                match = decodeSymbols(single._DMABuffer, count * LED_CHANNELS, expected) &&
+                        decodeSlices(port, PARALLEL_RESET_SLICES, output, count * LED_CHANNELS, bits) && bits == expected;
+            }
+            for (size_t i = count * PARALLEL_SLICES_PER_LED; i < frameSlices && match; i++)
+                match = !((port[PARALLEL_RESET_SLICES + i] >> output) & 1);
+        }
+
+        uint64_t ns = LEDSim::timerNanos / 2;
+        size_t RAM = 2 * ((parallel._frameBytes + 3) & ~(size_t)3) + LEDS * LED_CHANNELS + sizeof(LED_Parallel_CH32);
+        printf("%8u %8zu %10zu %12.1f %10.1f %10.2f %8s\n", outputs, segment, RAM, ns / 1000.0, 1e9 / ns,
+               showNs / 1000, bench::check(match, "yes", "NO"));
+        parallel.stop();
+    }
+
+    // The static driver builds the same frames in its own buffers, and its RAM is what the
+    // table counts. 300 LEDs on 1 or 2 outputs do not fit in SRAM and would not compile
+    {
+        typedef LED_Parallel_CH32_Static<LEDS, 8> Static;
+        LEDSim::reset();
+        std::vector<uint8_t> frame;
+        {
+            Static fixed;
+            for (size_t i = 0; i < LEDS; i++)
+                fixed.setLED(i, i, 2 * i, 3 * i);
+            fixed.show();
+            frame.assign(fixed._frontBuffer, fixed._frontBuffer + fixed._frameBytes);
+        }
+        LED_Parallel_CH32 dynamic(LEDS, 8);
+        for (size_t i = 0; i < LEDS; i++)
+            dynamic.setLED(i, i, 2 * i, 3 * i);
+        dynamic.show();
+        size_t RAM = 2 * ((dynamic._frameBytes + 3) & ~(size_t)3) + LEDS * LED_CHANNELS + sizeof(LED_Parallel_CH32);
+        bool same = frame.size() == dynamic._frameBytes && !memcmp(frame.data(), dynamic._frontBuffer, frame.size()) &&
+                    Static::RAM_BYTES == RAM && sizeof(Static) <= CH32X035_SRAM_BYTES;
+        printf("static           %zu LEDs on 8 outputs in %zu bytes, 2 outputs need %zu, %s\n", LEDS, Static::RAM_BYTES,
+               LED_Parallel_Layout<LEDS, 2>::RAM_BYTES, bench::check(same));
+    }
+
+    // Both DMA engines at once: a 60 LED SPI strip next to 300 LEDs on 8 outputs, which
+    // must leave the SPI1 pins alone
+    LEDSim::reset();
+    LED_SPI_CH32 spi(60);
+    LED_Parallel_CH32 parallel(LEDS, 8);
+    uint32_t portA = LEDSim::gpioA.CFGLR, portB = LEDSim::gpioB.CFGLR;
+    bool pins = portA == 0 && portB == 0x33333333 && parallel.numOutputs() == 8 &&
+                LED_Parallel_CH32::maxOutputs(GPIOA) == LED_PARALLEL_SPI1_FIRST_PIN;
+    printf("pins             PB0..PB%u outputs, GPIOA untouched, at most %u on GPIOA, %s\n", parallel.numOutputs() - 1,
+           LED_Parallel_CH32::maxOutputs(GPIOA), bench::check(pins));
+    for (size_t i = 0; i < LEDS; i++)
+    {
+        spi.setLED(i, i, 2 * i, 3 * i);
+        parallel.setLED(i, 3 * i, 2 * i, i);
+    }
+    spi.show();
+    parallel.show();
+    LEDSim::gpioB.OUTDR = 1u << 12; // Another output of the port, set before the start
+    spi.start();
+    parallel.start();
+    LEDSim::capture = true;
+    runParallel(20 * (PARALLEL_RESET_SLICES + parallel._frameBytes));
+    LEDSim::capture = false;
+    printf("port takeover    PB12 %s after the first write, as documented, %s\n",
+           LEDSim::gpioB.OUTDR & (1u << 12) ? "high" : "low", bench::check(!(LEDSim::gpioB.OUTDR & (1u << 12))));
+
+    // Every SPI burst is the SPI frame, every port frame the transposed one
+    size_t spiFrames = 0, portFrames = 0;
+    bool concurrent = true;
+    for (auto &burst : colourBursts(LEDSim::wire))
+        if (burst.second == spi._DMABufferSize)
+            spiFrames++, concurrent &= !memcmp(&LEDSim::wire[burst.first], spi._DMABuffer, burst.second);
+    const size_t PERIOD = PARALLEL_RESET_SLICES + parallel._frameBytes;
+    for (size_t start = PARALLEL_RESET_SLICES; start + parallel._frameBytes <= LEDSim::gpioWire.size(); start += PERIOD, portFrames++)
+        for (size_t i = 0; i < parallel._frameBytes && concurrent; i++)
+            concurrent = LEDSim::gpioWire[start + i] == parallel._frontBuffer[i];
+    printf("concurrent       SPI %zu frames + GPIO %zu frames in %.1f ms, %s\n", spiFrames, portFrames,
+           LEDSim::timerNanos / 1e6, bench::check(concurrent && spiFrames > 10 && portFrames == 20));
+    spi.stop();
+    parallel.stop();
+#endif
+}
+
+/**
+ * @brief Draw the same frames on a heap and a static driver of N LEDs, time show() on both.
+ */
+template <size_t N>
+static void compareStatic()
+{
+    LEDSim::reset();
+    LED_SPI_CH32 dynamicLEDs(N, 3);
+    LED_SPI_CH32_Static<N, 3> staticLEDs;
+    staticLEDs.clear();
+
+    int frame = 0;
+    auto draw = [&](LED_SPI_CH32 &leds) {
+        for (size_t i = 0; i < N; i++)
+            leds.setLED(i, (i * 3 + frame) & 0xFF, (i * 5) & 0xFF, frame & 0xFF);
+    };
+    double dynamicNs = bench::nsPerItem(1, [&] {
+        frame++;
+        draw(dynamicLEDs);
+        dynamicLEDs.show();
+    });
+    double staticNs = bench::nsPerItem(1, [&] {
+        frame++;
+        draw(staticLEDs);
+        staticLEDs.show();
+    });
+
+    draw(dynamicLEDs);
+    draw(staticLEDs);
+    dynamicLEDs.show();
+    staticLEDs.show();
+    bool match = !memcmp(dynamicLEDs._DMABuffer, staticLEDs._DMABuffer, N * LED_BYTES_PER_LED * 4);
+    printf("%6zu %12.2f %12.2f %10zu %6s\n", N, dynamicNs / 1000, staticNs / 1000,
+           LED_SPI_CH32_Static<N, 3>::RAM_BYTES, bench::check(match));
+}
+
+static void benchStatic()
+{
+    // 88 LEDs at dither=3 is about the most 8 bit symbols fit in the 20 kB of SRAM next to the
+    // color lookup, 66 for RGBW
+    bench::section("Static vs heap driver: setLED all + show (us/frame, dither=3)");
+    printf("%6s %12s %12s %10s %6s\n", "LEDs", "heap", "static", "RAM bytes", "match");
+    compareStatic<21>();
+    compareStatic<60>();
+    compareStatic<88 * 3 / LED_CHANNELS>();
+
+    // Two drivers of the same configuration each have their own buffers
+    LEDSim::reset();
+    LED_SPI_CH32_Static<21, 3> first, second;
+    first.setLED(0, 255, 0, 0);
+    second.setLED(0, 0, 0, 255);
+    first.show();
+    second.show();
+    bool separate = first._DMABuffer != second._DMABuffer &&
+                    memcmp(first._DMABuffer, second._DMABuffer, LED_BYTES_PER_LED) &&
+                    memcmp(first._LEDColors, second._LEDColors, LED_CHANNELS * sizeof(uint32_t));
+    printf("instances        2 of the same configuration, %zu bytes each, %s\n", sizeof(first),
+           bench::check(separate, "separate", "SHARED: FAIL"));
+}
+
+/// Frame n of the stream test: every LED a different color, so a misplaced pixel shows.
+static std::vector<uint8_t> streamColors(size_t numLEDs, uint32_t n)
+{
+    std::vector<uint8_t> rgb(numLEDs * 3);
+    for (size_t i = 0; i < rgb.size(); i++)
+        rgb[i] = (uint8_t)(i * 7 + n * 13);
+    return rgb;
+}
+
+enum StreamFraming
+{
+    STREAM_ADALIGHT,
+    STREAM_ADALIGHT_CRC,
+    STREAM_TPM2,
+};
+
+/// What a PC sender puts on the wire for one frame.
+static std::vector<uint8_t> streamFrame(StreamFraming framing, const std::vector<uint8_t> &rgb)
+{
+    std::vector<uint8_t> frame;
+    if (framing == STREAM_TPM2)
+    {
+        frame = {TPM2_START, TPM2_DATA, (uint8_t)(rgb.size() >> 8), (uint8_t)rgb.size()};
+        frame.insert(frame.end(), rgb.begin(), rgb.end());
+        frame.push_back(TPM2_END);
+        return frame;
+    }
+    uint8_t high = (rgb.size() / 3 - 1) >> 8, low = rgb.size() / 3 - 1;
+    frame = {'A', 'd', (uint8_t)(framing == STREAM_ADALIGHT_CRC ? 'c' : 'a'), high, low,
+             (uint8_t)(high ^ low ^ ADALIGHT_CHECK_XOR)};
+    frame.insert(frame.end(), rgb.begin(), rgb.end());
+    if (framing == STREAM_ADALIGHT_CRC)
+    {
+        uint16_t crc = LED_SPI_StreamReceiver::crc16(0xFFFF, rgb.data(), rgb.size());
+        frame.push_back(crc >> 8);
+        frame.push_back(crc);
+    }
+    return frame;
+}
+
+/// Device side of src/main.cpp with STREAM_ENABLE: one CDC packet at a time into the receiver.
+static void pumpUSB(LED_SPI_StreamReceiver &receiver)
+{
+    uint8_t chunk[64];
+    size_t length;
+    do
+    {
+        length = 0;
+        while (length < sizeof(chunk) && wch::usbcdc::USBSerial.available())
+            chunk[length++] = wch::usbcdc::USBSerial.read();
+        receiver.receive(chunk, length);
+    } while (length);
+}
+
+static void benchUSBStream()
+{
+    bench::section("USB frame streaming: decode into the driver, pty sender");
+    const size_t N = 300;
+    const StreamFraming framings[] = {STREAM_ADALIGHT, STREAM_ADALIGHT_CRC, STREAM_TPM2};
+    const char *names[] = {"Adalight", "Adalight+CRC", "TPM2"};
+
+    // Decode cost from memory, against copying the payload into a frame buffer (without
+    // parsing or checking it) and then calling setPixels()
+    printf("%-14s %12s %12s %6s\n", "framing", "decode us", "copy us", "match");
+    std::vector<uint8_t> rgb = streamColors(N, 1);
+    for (int f = 0; f < 3; f++)
+    {
+        std::vector<uint8_t> frame = streamFrame(framings[f], rgb);
+        LEDSim::reset();
+        LED_SPI_CH32 leds(N), reference(N);
+        LED_SPI_StreamReceiver receiver(leds);
+        double decodeNs = bench::nsPerItem(1, [&] {
+            for (size_t at = 0; at < frame.size(); at += 64)
+                receiver.receive(&frame[at], std::min<size_t>(64, frame.size() - at));
+        });
+        static uint8_t frameBuffer[N * 3];
+        size_t header = framings[f] == STREAM_TPM2 ? 4 : 6;
+        double copyNs = bench::nsPerItem(1, [&] {
+            for (size_t at = 0; at < sizeof(frameBuffer); at += 64)
+                memcpy(frameBuffer + at, &frame[header + at], std::min<size_t>(64, sizeof(frameBuffer) - at));
+            reference.setPixels((const RGB *)frameBuffer, N);
+            reference.show();
+        });
+        reference.setPixels((const RGB *)rgb.data(), N);
+        bool match = receiver.dropped() == 0 && !memcmp(leds._LEDColors, reference._LEDColors, N * LED_CHANNELS * 4);
+        printf("%-14s %12.2f %12.2f %6s\n", names[f], decodeNs / 1000, copyNs / 1000, bench::check(match));
+    }
+    printf("RAM            receiver %zu bytes, frame buffer %zu bytes\n", sizeof(LED_SPI_StreamReceiver), N * 3);
+
+    // A byte that breaks a magic may start the next one: every frame behind noise is found
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(N);
+        LED_SPI_StreamReceiver receiver(leds);
+        std::vector<uint8_t> frame = streamFrame(STREAM_ADALIGHT, streamColors(N, 4));
+        // The last is a header whose check byte is the 'A' of the frame
+        const std::string noise[] = {"A", "AdA", "Ad!", std::string("Ada\0\0", 5)};
+        for (const std::string &prefix : noise)
+        {
+            receiver.receive((const uint8_t *)prefix.data(), prefix.size());
+            receiver.receive(frame.data(), frame.size());
+        }
+        printf("resync         %u of %zu frames found behind \"A\", \"AdA\", \"Ad!\", a cut header, %s\n",
+               (unsigned)receiver.frames(), std::size(noise), bench::check(receiver.frames() == std::size(noise)));
+    }
+
+    // Buffered mode: a frame failing its CRC leaves the encoded frame as it was
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(N);
+        LED_SPI_StreamReceiver receiver(leds);
+        std::vector<uint8_t> good = streamFrame(STREAM_ADALIGHT_CRC, streamColors(N, 2));
+        std::vector<uint8_t> bad = streamFrame(STREAM_ADALIGHT_CRC, streamColors(N, 3));
+        bad[bad.size() - 1] ^= 1;
+        receiver.receive(good.data(), good.size());
+        std::vector<uint8_t> shown(leds._DMABuffer, leds._DMABuffer + leds._DMABufferSize);
+        receiver.receive(bad.data(), bad.size());
+        bool kept = receiver.dropped() == 1 && !memcmp(shown.data(), leds._DMABuffer, shown.size());
+        printf("bad CRC        frames %u, dropped %u, shown frame %s, %s\n", (unsigned)receiver.frames(),
+               (unsigned)receiver.dropped(), kept ? "kept" : "changed", bench::check(kept && receiver.frames() == 1));
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    int device = -1;
+    if (master >= 0 && !grantpt(master) && !unlockpt(master))
+        device = open(ptsname(master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (device < 0)
+    {
+        printf("no pty available, skipping the streaming test\n");
+        if (master >= 0)
+            close(master);
+        return;
+    }
+    termios raw;
+    tcgetattr(device, &raw);
+    cfmakeraw(&raw);
+    tcsetattr(device, TCSANOW, &raw);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    wch::usbcdc::USBSerial.input = device;
+
+    // The PC writes as fast as the pty takes it while the device pumps in the same loop.
+    // Latency runs from the first byte of a frame leaving the sender to its show() returning.
+    // One frame of the CRC and TPM2 streams is corrupted and must be dropped, not shown.
+    // Host fps is what the pty and parser sustain; show() waits for the simulated wire, which
+    // costs no host time, so the strip itself is refreshed at the wire fps.
+    const uint32_t FRAMES = 400, CORRUPT = 100;
+    printf("%-14s %10s %10s %10s %10s %8s %6s\n", "framing", "host fps", "lat us", "max us", "wire fps", "dropped",
+           "final");
+    for (int f = 0; f < 3; f++)
+    {
+        std::vector<uint8_t> stream;
+        std::vector<size_t> starts;
+        for (uint32_t n = 0; n < FRAMES; n++)
+        {
+            std::vector<uint8_t> frame = streamFrame(framings[f], streamColors(N, n));
+            if (n == CORRUPT && framings[f] != STREAM_ADALIGHT)
+                frame[framings[f] == STREAM_TPM2 ? frame.size() - 1 : 6 + n] ^= 0x40;
+            starts.push_back(stream.size());
+            stream.insert(stream.end(), frame.begin(), frame.end());
+        }
+        uint32_t expectDropped = framings[f] == STREAM_ADALIGHT ? 0 : 1;
+
+        LEDSim::reset();
+        LED_SPI_CH32 leds(N);
+        LED_SPI_StreamReceiver receiver(leds);
+        leds.start();
+
+        std::vector<uint64_t> sentAt(FRAMES);
+        size_t sent = 0, nextStart = 0;
+        uint32_t seen = 0;
+        double latency = 0, worst = 0;
+        uint64_t simStart = LEDSim::nanos, frameStart = leds.frameCount();
+        uint64_t start = bench::nowNs(), idle = 0;
+        while (seen < FRAMES && idle < 1000000)
+        {
+            if (sent < stream.size())
+            {
+                ssize_t n = write(master, &stream[sent], std::min<size_t>(4096, stream.size() - sent));
+                uint64_t now = bench::nowNs();
+                for (; n > 0 && nextStart < FRAMES && starts[nextStart] < sent + n; nextStart++)
+                    sentAt[nextStart] = now;
+                sent += n > 0 ? n : 0;
+            }
+            pumpUSB(receiver);
+            uint64_t now = bench::nowNs();
+            uint32_t done = receiver.frames() + receiver.dropped();
+            idle = done == seen ? idle + 1 : 0;
+            for (; seen < done; seen++)
+            {
+                double us = (now - sentAt[seen]) / 1000.0;
+                latency += us;
+                worst = std::max(worst, us);
+            }
+        }
+        double hostFps = seen * 1e9 / (bench::nowNs() - start);
+        double wireFps = (leds.frameCount() - frameStart) * 1e9 / (LEDSim::nanos - simStart);
+        leds.stop();
+
+        // Constructed only now: a second driver takes over the DMA interrupt
+        LED_SPI_CH32 reference(N);
+        reference.setPixels((const RGB *)streamColors(N, FRAMES - 1).data(), N);
+        bool final = seen == FRAMES && receiver.dropped() == expectDropped &&
+                     !memcmp(leds._LEDColors, reference._LEDColors, N * LED_CHANNELS * 4);
+        printf("%-14s %10.0f %10.1f %10.1f %10.1f %8u %6s\n", names[f], hostFps, latency / seen, worst, wireFps,
+               (unsigned)receiver.dropped(), bench::check(final));
+    }
+
+    wch::usbcdc::USBSerial.input = -1;
+    while (wch::usbcdc::USBSerial.available())
+        wch::usbcdc::USBSerial.read();
+    close(device);
+    close(master);
+}
+
+static void benchCircular()
+{
+    bench::section("Circular refresh: ISR work per frame, buffered vs circular DMA");
+    printf("%9s %6s %6s %10s %10s %12s %10s %8s %8s\n", "mode", "LEDs", "dither", "IRQs/frm", "ns/IRQ", "ISR ns/frm",
+           "frames/s", "min gap", "match");
+
+    for (LED_SPI_Mode mode : {LED_SPI_BUFFERED, LED_SPI_CIRCULAR})
+    for (size_t numLEDs : LED_COUNTS)
+    for (uint8_t depth : {(uint8_t)0, (uint8_t)3})
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(numLEDs, depth, mode);
+        drawPlasma(leds, numLEDs, 42);
+        leds.show();
+        leds.start();
+
+        // Settle, then capture a few dither cycles
+        const size_t FRAME_BYTES = leds._DMABufferSize + CIRCULAR_GAP_BYTES;
+        LEDSim::run(2 * FRAME_BYTES);
+        uint64_t irqs = LEDSim::interrupts, ns = LEDSim::nanos;
+        LEDSim::wire.clear();
+        LEDSim::capture = true;
+        LEDSim::run(21 * FRAME_BYTES);
+        LEDSim::capture = false;
+        irqs = LEDSim::interrupts - irqs;
+        ns = LEDSim::nanos - ns;
+
+        // Every whole burst must be one of the dither frames, separated by a reset gap
+        auto bursts = colourBursts(LEDSim::wire);
+        bool match = bursts.size() > 2;
+        size_t minGap = SIZE_MAX;
+        for (size_t b = 1; b + 1 < bursts.size() && match; b++)
+        {
+            minGap = std::min(minGap, bursts[b].first - (bursts[b - 1].first + bursts[b - 1].second));
+            bool found = false;
+            for (size_t level = 0; level < leds._numDitherBuffers && !found; level++)
+                found = bursts[b].second == leds._DMABufferSize &&
+                        !memcmp(&LEDSim::wire[bursts[b].first], leds._DMABuffer + level * leds._frameStride, leds._DMABufferSize);
+            match = found;
+        }
+        double frames = bursts.size() > 1 ? bursts.size() - 1 : 1;
+
+        // Time the handler on its own, as the hardware would enter it on transfer complete
+        double isrNs = bench::nsPerItem(1000, [&] {
+            for (int i = 0; i < 1000; i++)
+            {
+                LEDSim::dma1.INTFR.value |= DMA1_IT_TC3 | DMA1_IT_GL3;
+                DMA1_Channel3_IRQHandler();
+            }
+        });
+
+        printf("%9s %6zu %6u %10.2f %10.1f %12.1f %10.1f %8zu %8s\n", mode == LED_SPI_CIRCULAR ? "circular" : "buffered",
+               numLEDs, depth, irqs / frames, isrNs, isrNs * irqs / frames, 1e9 * frames / ns, minGap,
+               bench::check(match, "yes", "NO"));
+        leds.stop();
+    }
+}
+
+static void countFrame(void *context) { ++*(uint32_t *)context; }
+
+static void benchVsync()
+{
+    bench::section("Frame sync: solid frames rendered on waitForFrame() vs a free-running loop (60 LEDs)");
+    printf("%9s %10s %8s %8s %10s %10s %14s\n", "mode", "loop", "renders", "frames", "callbacks", "shown", "latency us");
+
+    const size_t LEDS = 60;
+    for (LED_SPI_Mode mode : {LED_SPI_BUFFERED, LED_SPI_CIRCULAR})
+    for (bool synced : {false, true})
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(LEDS, 0, mode);
+        uint32_t callbacks = 0;
+        leds.setFrameCallback(countFrame, &callbacks);
+        leds.show();
+        leds.start();
+        LEDSim::capture = true;
+        LEDSim::runInterrupts(4);
+
+        // Each render lights a different single LED, so the wire shows which render went out when
+        const int RENDERS = 40;
+        std::vector<size_t> shows;
+        uint32_t frames = leds.frameCount(), calls = callbacks;
+        for (int render = 0; render < RENDERS; render++)
+        {
+            if (synced)
+                leds.waitForFrame();
+            else
+                LEDSim::run(LEDS * LED_BYTES_PER_LED * 37 / 10); // Unrelated period of ~3.7 frames
+            leds.clear();
+            leds.setLED(render, 255, 255, 255);
+            leds.show();
+            shows.push_back(LEDSim::wire.size());
+        }
+        leds.waitForFrame();
+        leds.waitForFrame();
+        frames = leds.frameCount() - frames;
+        calls = callbacks - calls;
+        LEDSim::capture = false;
+
+        // Latency from show() to the first byte of the first burst carrying its frame
+        auto bursts = colourBursts(LEDSim::wire);
+        size_t shown = 0;
+        double latency = 0;
+        for (int render = 0; render < RENDERS; render++)
+        {
+            for (auto &burst : bursts)
+            {
+                std::vector<uint8_t> decoded;
+                if (burst.first < shows[render] || burst.second != LEDS * LED_BYTES_PER_LED)
+                    continue;
+                decodeSymbols(&LEDSim::wire[burst.first], LEDS * LED_CHANNELS, decoded);
+                size_t lit = std::find_if(decoded.begin(), decoded.end(), [](uint8_t v) { return v; }) - decoded.begin();
+                if (lit / LED_CHANNELS == (size_t)render)
+                {
+                    shown++;
+                    latency += (burst.first - shows[render]) * LEDSim::byteNanos() / 1000.0;
+                    break;
+                }
+            }
+        }
+        printf("%9s %10s %8d %8u %10u %10zu %14.1f\n", mode == LED_SPI_CIRCULAR ? "circular" : "buffered",
+               synced ? "vsync" : "free", RENDERS, frames, calls, shown, shown ? latency / shown : 0.0);
+        leds.stop();
+    }
+
+    // start() only queues the reset in front of the first frame: the first frame event
+    // comes once that frame is on the wire
+    for (LED_SPI_Mode mode : {LED_SPI_BUFFERED, LED_SPI_CIRCULAR, LED_SPI_STREAMING})
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(LEDS, 0, mode);
+        uint32_t callbacks = 0;
+        leds.setFrameCallback(countFrame, &callbacks);
+        leds.setLED(0, 255, 255, 255);
+        leds.show();
+        LEDSim::capture = true;
+        leds.start();
+        bool quiet = !leds.frameCount() && !callbacks;
+        leds.waitForFrame();
+        LEDSim::capture = false;
+        auto bursts = colourBursts(LEDSim::wire);
+        bool first = quiet && leds.frameCount() == 1 && callbacks == 1 && bursts.size() == 1 &&
+                     bursts[0].second <= LEDS * LED_BYTES_PER_LED;
+        printf("%9s first frame event after %zu color bytes, %s\n",
+               mode == LED_SPI_CIRCULAR ? "circular" : mode == LED_SPI_STREAMING ? "streaming" : "buffered",
+               bursts.empty() ? 0 : bursts[0].second, bench::check(first));
+        leds.stop();
+    }
+
+    // The scheduler paces renders on the wall clock; the simulated strip runs much faster
+    bench::section("Frame scheduler: 200 fps target for 0.2 s, render cost 1 ms vs 7 ms");
+    printf("%10s %8s %8s\n", "render ms", "renders", "dropped");
+    for (uint32_t renderUs : {1000u, 7000u})
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(LEDS, 0);
+        leds.start();
+        LED_SPI_FrameScheduler scheduler(leds, 200);
+        int renders = 0;
+        uint32_t start = micros();
+        while (micros() - start < 200000)
+        {
+            scheduler.wait();
+            uint32_t renderStart = micros();
+            while (micros() - renderStart < renderUs) {}
+            leds.show();
+            renders++;
+        }
+        printf("%10.1f %8d %8u\n", renderUs / 1000.0, renders, scheduler.dropped());
+        leds.stop();
+    }
+}
+
+static void benchStats()
+{
+    bench::section("Hot path statistics (LED_SPI_STATS)");
+#ifndef LED_SPI_STATS
+    printf("compiled out: sizeof(LED_SPI_CH32) = %zu, build with -D LED_SPI_STATS (pio run -e native_stats)\n",
+           sizeof(LED_SPI_CH32));
+#else
+    printf("sizeof(LED_SPI_CH32) = %zu, ticks at %u Hz\n", sizeof(LED_SPI_CH32), LED_SPI_CYCLES_HZ);
+    printf("ISR latency on the host is the simulator's own cost per transfer, not interrupt latency\n");
+    printf("%9s %6s %8s %8s %9s %9s %9s %9s %9s %8s %8s\n", "mode", "dither", "ns/set", "enc LEDs", "enc us",
+           "ISR ns", "lat us", "lat max", "frames/s", "overwr", "dump");
+
+    const size_t LEDS = 60;
+    for (LED_SPI_Mode mode : {LED_SPI_BUFFERED, LED_SPI_CIRCULAR, LED_SPI_STREAMING})
+    for (uint8_t depth : {(uint8_t)0, (uint8_t)3})
+    {
+        LEDSim::reset();
+        LED_SPI_CH32 leds(LEDS, depth, mode);
+        leds.setFrameCallback(nullptr);
+        leds.start();
+        for (int frame = 0; frame < 30; frame++)
+        {
+            leds.waitForFrame();
+            drawPlasma(leds, LEDS, frame);
+            leds.show();
+            // Streaming has no commit to wait for, so draw a second frame over the first
+            if (mode == LED_SPI_STREAMING && frame % 3 == 0)
+                leds.show();
+        }
+        leds.waitForFrame();
+        LED_SPI_Stats render = leds.stats();
+
+        // On the host, time spent drawing is not simulated on the wire, so the interrupt
+        // timing is taken over frames with nothing else running
+        leds.resetStats();
+        for (int frame = 0; frame < 10; frame++)
+            leds.waitForFrame();
+
+        // The binary dump must carry the same counters, framed and checksummed
+        std::string dump;
+        wch::usbcdc::USBSerial.capture = &dump;
+        leds.dumpStats();
+        wch::usbcdc::USBSerial.capture = nullptr;
+        const size_t PAYLOAD = LED_SPI_STATS_DUMP_WORDS * sizeof(uint32_t);
+        uint8_t check = 0;
+        for (char c : dump)
+            check ^= (uint8_t)c;
+        bool dumpOK = dump.size() == PAYLOAD + 4 && (uint8_t)dump[0] == DUMP_SYNC && dump[1] == 'S' &&
+                      (uint8_t)dump[2] == PAYLOAD && check == 0 && !memcmp(&dump[3], &leds.stats(), PAYLOAD);
+
+        const LED_SPI_Stats &stats = leds.stats();
+        double nsPerTick = 1e9 / LED_SPI_CYCLES_HZ;
+        printf("%9s %6u %8.1f %8u %9.2f %9.1f %9.2f %9.2f %9.1f %8u %8s\n",
+               mode == LED_SPI_STREAMING ? "streaming" : mode == LED_SPI_CIRCULAR ? "circular" : "buffered", depth,
+               render.setLEDCalls ? render.setLEDCycles * nsPerTick / render.setLEDCalls : 0.0, render.encodedLEDs,
+               render.encodeCycles * nsPerTick / 1000, stats.isrCycles * nsPerTick, stats.isrLatency * nsPerTick / 1000,
+               stats.isrLatencyMax * nsPerTick / 1000, stats.frameCycles ? LED_SPI_CYCLES_HZ / (double)stats.frameCycles : 0.0,
+               render.framesOverwritten, bench::check(dumpOK, "ok", "BAD"));
+        leds.stop();
+    }
+#endif
+}
+
+static void benchFlash()
+{
+    bench::section("Flash animations: 48 frames of 150 LEDs played from pre-encoded symbols");
+    const size_t LEDS = 150, FRAMES = 48;
+    typedef LED_SPI_Timing<LEDS> Timing;
+
+    // A comet crossing the strip, which changes little from frame to frame, then noise
+    std::vector<RGB> rgb(LEDS * FRAMES, RGB{0, 0, 0});
+    for (size_t frame = 0; frame < FRAMES; frame++)
+    {
+        RGB *pixels = &rgb[frame * LEDS];
+        if (frame < 40)
+            for (size_t tail = 0; tail < 12; tail++)
+                pixels[(frame * 3 + LEDS - tail) % LEDS] = hsvToRGB(HSV{(uint16_t)(frame * 24), 255, (uint8_t)(255 - tail * 20)});
+        else
+            for (size_t i = 0; i < LEDS; i++)
+                pixels[i] = {(uint8_t)nextRandom(), (uint8_t)nextRandom(), (uint8_t)nextRandom()};
+    }
+    std::vector<std::vector<uint8_t>> symbols = LED_EncodeSymbols(rgb.data(), LEDS, FRAMES);
+    const size_t FRAME_BYTES = symbols[0].size();
+
+    // What the same frames cost drawn at run time
+    LED_SPI_CH32 encoder(LEDS);
+    size_t drawn = 0;
+    double drawNs = bench::nsPerItem(1, [&] {
+        encoder.setPixels(&rgb[drawn * LEDS], LEDS);
+        encoder.show();
+        drawn = (drawn + 1) % FRAMES;
+    });
+
+    printf("Frame time %.0f us; the driver's own buffers take %zu bytes of RAM (LED_SPI_Layout).\n", Timing::FRAME_NS / 1000,
+           LED_SPI_Layout<LEDS>::RAM_BYTES);
+    printf("CPU is host ns per frame over the frames played, against %.0f ns for setPixels() + show().\n", drawNs);
+    printf("%10s %5s %5s %5s %9s %9s %10s %9s %7s\n", "storage", "raw", "rle", "delta", "flash", "play RAM", "CPU ns",
+           "CPU load", "wire");
+
+    struct Storage
+    {
+        const char *name;
+        size_t budget;
+        bool compressAll;
+    };
+    const Storage STORAGES[] = {
+        {"raw", SIZE_MAX, false},
+        {"half", FRAMES * FRAME_BYTES / 2, false},
+        {"compress", SIZE_MAX, true},
+    };
+    for (const Storage &storage : STORAGES)
+    {
+        std::vector<LED_EncodedFrame> encoded = LED_ChooseFrameEncodings(symbols, storage.budget, storage.compressAll);
+        std::vector<LED_FlashFrame> table;
+        size_t counts[3] = {0, 0, 0};
+        for (const LED_EncodedFrame &frame : encoded)
+        {
+            table.push_back({frame.data.data(), (uint32_t)frame.data.size(), frame.encoding});
+            counts[frame.encoding]++;
+        }
+        const LED_FlashAnimation animation = {(uint16_t)LEDS, (uint16_t)table.size(), (uint32_t)FRAME_BYTES, table.data()};
+
+        // Decoding is the only work per frame: raw frames are a pointer handed to the DMA
+        std::vector<uint8_t> out(FRAME_BYTES);
+        double decodeNs = bench::nsPerItem(FRAMES, [&] {
+            for (size_t i = 0; i < FRAMES; i++)
+                if (encoded[i].encoding != LED_FRAME_RAW)
+                    LED_DecodeRLE(out.data(), FRAME_BYTES, encoded[i].data.data(),
+                                  encoded[i].encoding == LED_FRAME_DELTA ? symbols[i - 1].data() : nullptr);
+            bench::sink = out[0];
+        });
+
+        // Two loops on the simulated strip: every frame must reach the wire in order, raw
+        // frames with the DMA reading the stored bytes in place
+        LEDSim::reset();
+        LED_SPI_CH32 leds(LEDS);
+        leds.show();
+        leds.start();
+        LED_FlashPlayer player(leds, animation);
+        bool ok = player.valid();
+        LEDSim::capture = true;
+        for (size_t played = 0; ok && played < 2 * FRAMES; played++)
+        {
+            const LED_FlashFrame &frame = table[player.nextFrame()];
+            player.showNextFrame();
+            leds.waitForCommit();
+            if (frame.encoding == LED_FRAME_RAW)
+                ok &= leds._DMASettingsSendColorData.DMA_MemoryBaseAddr == (uintptr_t)frame.data;
+            leds.waitForFrame();
+        }
+        LEDSim::capture = false;
+        auto at = LEDSim::wire.begin();
+        for (size_t played = 0; ok && played < 2 * FRAMES; played++)
+        {
+            const std::vector<uint8_t> &expected = symbols[played % FRAMES];
+            at = std::search(at, LEDSim::wire.end(), expected.begin(), expected.end());
+            ok &= at != LEDSim::wire.end();
+            at += ok ? expected.size() : 0;
+        }
+        // show() goes back to the colors set on the driver
+        leds.setLED(0, 255, 255, 255);
+        leds.show();
+        leds.waitForCommit();
+        ok &= !leds._frontEncoded;
+        leds.stop();
+
+        printf("%10s %5zu %5zu %5zu %9zu %9zu %10.0f %8.2f%% %7s\n", storage.name, counts[LED_FRAME_RAW],
+               counts[LED_FRAME_RLE], counts[LED_FRAME_DELTA], LED_FlashBytes(encoded), player.ramBytes(), decodeNs,
+               100 * decodeNs / Timing::FRAME_NS, bench::check(ok));
+    }
+    printf("Raw frames cost no RAM and no CPU; compressed ones decode into two frame buffers.\n");
+    printf("Host timings are noisy and the target has no cache: compare the ratios, not the ns.\n");
+}
+
+struct Section
+{
+    const char *name;
+    void (*run)();
+    bool optIn = false; // Only run when named on the command line
+};
+
+static const Section SECTIONS[] = {
+    {"fixed", benchFixedPoint},
+    {"sin", benchSin},
+    {"sqrt", benchRoots},
+    {"encode", benchEncode},
+    {"bulk", benchBulkEncode},
+    {"color", benchColor},
+    {"palette", benchPalette},
+    {"dirty", benchDirty},
+    {"frame", benchFrame},
+    {"effect", benchEffect},
+    {"hsv", benchHSV},
+    {"layers", benchLayers},
+    {"noise", benchNoise},
+    {"sim", benchSimulator},
+    {"timing", benchTiming},
+    {"tearing", benchTearing},
+    {"stream", benchStreaming},
+    {"dither", benchDither},
+    {"protocol", benchProtocol},
+    {"parallel", benchParallel},
+    {"usb", benchUSBStream},
+    {"static", benchStatic},
+    {"circular", benchCircular},
+    {"vsync", benchVsync},
+    {"stats", benchStats},
+    {"flash", benchFlash},
+    {"sqrtfull", benchRootsExhaustive, true},
+};
+
+int main(int argc, char **argv)
+{
+    for (const Section &section : SECTIONS)
+    {
+        bool selected = argc < 2 && !section.optIn;
+        for (int i = 1; i < argc; i++)
+            selected |= !strcmp(argv[i], section.name);
+        if (selected)
+            section.run();
+    }
+    if (bench::failures)
+        printf("\n%d checks FAILED\n", bench::failures);
+    return bench::failures != 0;
+}
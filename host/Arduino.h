@@ -0,0 +1,43 @@
+#pragma once
+
+// Minimal Arduino core for building the LED driver on a Linux host ([env:native]).
+// Peripheral registers come from the simulator in ch32x035_sim.h.
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "ch32x035_sim.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+class String
+{
+public:
+    String(const char *s = "") : _s(s) {}
+    String(const std::string &s) : _s(s) {}
+    const char *c_str() const { return _s.c_str(); }
+    size_t length() const { return _s.size(); }
+    String operator+(const String &other) const { return String(_s + other._s); }
+
+private:
+    std::string _s;
+};
+
+inline uint32_t micros()
+{
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint32_t millis() { return micros() / 1000; }
@@ -0,0 +1,94 @@
+#pragma once
+
+// Host stand-in for jobitjoseph/CH32X035_USBSerial. Output goes to stdout, input comes
+// from a file descriptor (a pty in the bench) standing in for the PC end of the link.
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "Arduino.h"
+
+namespace wch
+{
+    namespace usbcdc
+    {
+        class USBSerialClass
+        {
+        public:
+            void begin(uint32_t) {}
+            void end() {}
+            bool waitForPC(uint32_t) { return true; }
+
+            /// When set, output is appended here instead of going to stdout (used to check binary dumps).
+            std::string *capture = nullptr;
+
+            /// Bytes the PC sends arrive on this descriptor, best opened non-blocking. -1 for none.
+            int input = -1;
+
+            /// Bytes ready to read. Refills a 64 byte buffer like the CDC OUT endpoint when it is empty.
+            int available()
+            {
+                if (_rxPos == _rxLength && input >= 0)
+                {
+                    ssize_t n = ::read(input, _rx, sizeof(_rx));
+                    _rxLength = n > 0 ? n : 0;
+                    _rxPos = 0;
+                }
+                return _rxLength - _rxPos;
+            }
+
+            int read() { return available() ? _rx[_rxPos++] : -1; }
+
+            size_t write(uint8_t c) { return write(&c, 1); }
+            size_t write(const uint8_t *buffer, size_t size)
+            {
+                if (capture)
+                    return capture->append((const char *)buffer, size), size;
+                return fwrite(buffer, 1, size, stdout);
+            }
+
+            size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+            size_t print(const char *s) { return print(String(s)); }
+            size_t print(char c) { return write((uint8_t)c); }
+            size_t print(unsigned long n, int base = DEC) { return print(format(n, base)); }
+            size_t print(long n, int base = DEC)
+            {
+                if (n < 0 && base == DEC)
+                    return print('-') + print((unsigned long)-n, base);
+                return print((unsigned long)n, base);
+            }
+            size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+            size_t print(int n, int base = DEC) { return print((long)n, base); }
+
+            template <typename T>
+            size_t println(T value) { return print(value) + println(); }
+            template <typename T>
+            size_t println(T value, int base) { return print(value, base) + println(); }
+            size_t println() { return print('\n'); }
+
+        private:
+            uint8_t _rx[64];
+            size_t _rxPos = 0;
+            size_t _rxLength = 0;
+
+            static String format(unsigned long n, int base)
+            {
+                if (base < 2)
+                    base = 10;
+                char buffer[8 * sizeof(long) + 1];
+                char *p = &buffer[sizeof(buffer) - 1];
+                *p = '\0';
+                do
+                {
+                    int digit = n % base;
+                    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+                    n /= base;
+                } while (n);
+                return String(p);
+            }
+        };
+
+        inline USBSerialClass USBSerial;
+    }
+}
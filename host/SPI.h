@@ -0,0 +1,38 @@
+#pragma once
+
+// Host stand-in for the openwch SPI library. beginTransaction() programs SPI1 in the
+// simulator so the driver's own register tweaks apply on top, as on target.
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_TRANSMITONLY 1
+
+class SPISettings
+{
+public:
+    SPISettings(uint32_t clock = 4000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0, uint8_t transmitOnly = 0)
+        : clock(clock), bitOrder(bitOrder), dataMode(dataMode), transmitOnly(transmitOnly) {}
+
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+    uint8_t transmitOnly;
+};
+
+class SPIClass
+{
+public:
+    void begin() {}
+    void beginTransaction(SPISettings settings)
+    {
+        // Pick the smallest prescaler that does not exceed the requested clock
+        uint16_t br = 0;
+        while (br < 7 && (LEDSim::HCLK >> (br + 1)) > settings.clock)
+            br++;
+        SPI1->CTLR1 = (uint16_t)((SPI1->CTLR1 & ~SPI_CTLR1_BR) | (br << 3) | SPI_CTLR1_SPE);
+    }
+    void endTransaction() {}
+};
+
+inline SPIClass SPI;
@@ -0,0 +1,572 @@
+#pragma once
+
+// Host-side stand-in for the CH32X035 DMA1/SPI1 registers used by LED_SPI_CH32.
+//
+// Only the parts of the peripheral library the driver touches are modelled. Register
+// writes go through SimRegister so the simulator can react to channel enables the same
+// way the hardware latches MADDR/CNTR. Bytes move only when LEDSim::run() is called:
+// each byte is pulled from memory into SPI1->DATAR, appended to LEDSim::wire and
+// accounted for on the simulated clock. Transfer complete/half transfer flags raise
+// DMA1_Channel3_IRQHandler synchronously, just like the NVIC would on target.
+//
+// LED_Parallel_CH32 gets a second, independent engine: TIM2 update events pace DMA1
+// channel 2 writes to the output register of a GPIO port. LEDSim::runTimer() moves those,
+// appending each port value to LEDSim::gpioWire on its own clock, and raises
+// DMA1_Channel2_IRQHandler.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define ENABLE 1
+#define DISABLE 0
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef uint8_t FunctionalState;
+
+/// Register cell that notifies the simulator on every write.
+template <typename T>
+struct SimRegister
+{
+    T value = 0;
+    void (*onWrite)(void *context, T oldValue, T newValue) = nullptr;
+    void *context = nullptr;
+
+    operator T() const { return value; }
+    SimRegister &operator=(T v)
+    {
+        T old = value;
+        value = v;
+        if (onWrite)
+            onWrite(context, old, v);
+        return *this;
+    }
+    SimRegister &operator|=(T v) { return *this = value | v; }
+    SimRegister &operator&=(T v) { return *this = value & v; }
+};
+
+typedef struct
+{
+    SimRegister<uint32_t> CFGR;
+    SimRegister<uint32_t> CNTR;
+    SimRegister<uintptr_t> PADDR; // 32-bit on target; pointer sized so host addresses fit
+    SimRegister<uintptr_t> MADDR;
+} DMA_Channel_TypeDef;
+
+typedef struct
+{
+    SimRegister<uint32_t> INTFR;
+    SimRegister<uint32_t> INTFCR; // Write-1-to-clear; the simulator applies it to INTFR
+} DMA_TypeDef;
+
+typedef struct
+{
+    SimRegister<uint16_t> CTLR1;
+    SimRegister<uint16_t> CTLR2;
+    SimRegister<uint16_t> STATR;
+    SimRegister<uint16_t> DATAR;
+} SPI_TypeDef;
+
+typedef struct
+{
+    SimRegister<uint32_t> CFGLR;
+    SimRegister<uint32_t> CFGHR;
+    SimRegister<uint32_t> INDR;
+    SimRegister<uint32_t> OUTDR;
+    SimRegister<uint32_t> BSHR;
+    SimRegister<uint32_t> BCR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+    SimRegister<uint16_t> CTLR1;
+    SimRegister<uint16_t> DMAINTENR;
+    SimRegister<uint16_t> PSC;
+    SimRegister<uint16_t> ATRLR;
+} TIM_TypeDef;
+
+typedef struct
+{
+    uint16_t GPIO_Pin;
+    uint32_t GPIO_Speed;
+    uint32_t GPIO_Mode;
+} GPIO_InitTypeDef;
+
+typedef struct
+{
+    uint16_t TIM_Prescaler;
+    uint16_t TIM_CounterMode;
+    uint16_t TIM_Period;
+    uint16_t TIM_ClockDivision;
+    uint8_t TIM_RepetitionCounter;
+} TIM_TimeBaseInitTypeDef;
+
+typedef struct
+{
+    uintptr_t DMA_PeripheralBaseAddr;
+    uintptr_t DMA_MemoryBaseAddr;
+    uint32_t DMA_DIR;
+    uint32_t DMA_BufferSize;
+    uint32_t DMA_PeripheralInc;
+    uint32_t DMA_MemoryInc;
+    uint32_t DMA_PeripheralDataSize;
+    uint32_t DMA_MemoryDataSize;
+    uint32_t DMA_Mode;
+    uint32_t DMA_Priority;
+    uint32_t DMA_M2M;
+} DMA_InitTypeDef;
+
+// DMA channel configuration register bits (same values as ch32x035.h / ch32x035_dma.h)
+#define DMA_CFGR1_EN ((uint16_t)0x0001)
+#define DMA_CFGR1_TCIE ((uint16_t)0x0002)
+#define DMA_CFGR1_HTIE ((uint16_t)0x0004)
+#define DMA_CFGR1_TEIE ((uint16_t)0x0008)
+#define DMA_CFGR1_DIR ((uint16_t)0x0010)
+#define DMA_CFGR1_CIRC ((uint16_t)0x0020)
+#define DMA_CFGR1_PINC ((uint16_t)0x0040)
+#define DMA_CFGR1_MINC ((uint16_t)0x0080)
+
+#define DMA_DIR_PeripheralDST ((uint32_t)0x00000010)
+#define DMA_DIR_PeripheralSRC ((uint32_t)0x00000000)
+#define DMA_PeripheralInc_Enable ((uint32_t)0x00000040)
+#define DMA_PeripheralInc_Disable ((uint32_t)0x00000000)
+#define DMA_MemoryInc_Enable ((uint32_t)0x00000080)
+#define DMA_MemoryInc_Disable ((uint32_t)0x00000000)
+#define DMA_PeripheralDataSize_Byte ((uint32_t)0x00000000)
+#define DMA_PeripheralDataSize_HalfWord ((uint32_t)0x00000100)
+#define DMA_MemoryDataSize_Byte ((uint32_t)0x00000000)
+#define DMA_Mode_Circular ((uint32_t)0x00000020)
+#define DMA_Mode_Normal ((uint32_t)0x00000000)
+#define DMA_Priority_VeryHigh ((uint32_t)0x00003000)
+#define DMA_Priority_High ((uint32_t)0x00002000)
+#define DMA_M2M_Enable ((uint32_t)0x00004000)
+#define DMA_M2M_Disable ((uint32_t)0x00000000)
+
+#define DMA_IT_TC ((uint32_t)0x00000002)
+#define DMA_IT_HT ((uint32_t)0x00000004)
+#define DMA_IT_TE ((uint32_t)0x00000008)
+
+#define DMA1_IT_GL2 ((uint32_t)0x00000010)
+#define DMA1_IT_TC2 ((uint32_t)0x00000020)
+#define DMA1_IT_HT2 ((uint32_t)0x00000040)
+#define DMA1_FLAG_TC2 DMA1_IT_TC2
+
+#define DMA1_IT_GL3 ((uint32_t)0x00000100)
+#define DMA1_IT_TC3 ((uint32_t)0x00000200)
+#define DMA1_IT_HT3 ((uint32_t)0x00000400)
+#define DMA1_IT_TE3 ((uint32_t)0x00000800)
+#define DMA1_FLAG_GL3 DMA1_IT_GL3
+#define DMA1_FLAG_TC3 DMA1_IT_TC3
+#define DMA1_FLAG_HT3 DMA1_IT_HT3
+
+#define SPI_CTLR1_BR ((uint16_t)0x0038)
+#define SPI_CTLR1_SPE ((uint16_t)0x0040)
+#define SPI_CTLR2_TXDMAEN ((uint8_t)0x02)
+
+#define SPI_BaudRatePrescaler_2 ((uint16_t)0x0000)
+#define SPI_BaudRatePrescaler_4 ((uint16_t)0x0008)
+#define SPI_BaudRatePrescaler_8 ((uint16_t)0x0010)
+#define SPI_BaudRatePrescaler_16 ((uint16_t)0x0018)
+#define SPI_BaudRatePrescaler_32 ((uint16_t)0x0020)
+#define SPI_BaudRatePrescaler_64 ((uint16_t)0x0028)
+
+#define RCC_AHBPeriph_DMA1 ((uint32_t)0x00000001)
+#define RCC_APB1Periph_TIM2 ((uint32_t)0x00000001)
+#define RCC_APB2Periph_GPIOA ((uint32_t)0x00000004)
+#define RCC_APB2Periph_GPIOB ((uint32_t)0x00000008)
+
+#define GPIO_Speed_50MHz 3
+#define GPIO_Mode_Out_PP 0x10
+
+#define TIM_CEN ((uint16_t)0x0001)
+#define TIM_UDE ((uint16_t)0x0100)
+#define TIM_DMA_Update ((uint16_t)0x0100)
+#define TIM_CounterMode_Up ((uint16_t)0x0000)
+#define TIM_CKD_DIV1 ((uint16_t)0x0000)
+
+typedef enum
+{
+    DMA1_Channel1_IRQn = 27,
+    DMA1_Channel2_IRQn = 28,
+    DMA1_Channel3_IRQn = 29,
+} IRQn_Type;
+
+extern "C" void DMA1_Channel2_IRQHandler(void);
+extern "C" void DMA1_Channel3_IRQHandler(void);
+
+namespace LEDSim
+{
+    constexpr uint32_t HCLK = 48000000; ///< System clock the SPI prescaler divides
+
+    inline DMA_TypeDef dma1;
+    inline DMA_Channel_TypeDef dma1Channel3;
+    inline SPI_TypeDef spi1;
+    inline bool irqEnabled = false;
+
+    /// Everything clocked out of SPI1 so far (only while capture is set).
+    inline std::vector<uint8_t> wire;
+    inline bool capture = false;
+
+    inline uint64_t bytesSent = 0;   ///< Total bytes shifted out of SPI1
+    inline uint64_t nanos = 0;       ///< Simulated wire time
+    inline uint64_t interrupts = 0;  ///< Number of DMA1_Channel3_IRQHandler invocations
+
+    // Internal transfer state latched when the channel is enabled
+    inline bool active = false;
+    inline uintptr_t cursor = 0;
+    inline uint32_t reload = 0;
+
+    inline DMA_Channel_TypeDef dma1Channel2;
+    inline TIM_TypeDef tim2;
+    inline GPIO_TypeDef gpioA;
+    inline GPIO_TypeDef gpioB;
+    inline bool timerIrqEnabled = false;
+
+    /// Every value written to a port by the timer DMA (only while capture is set).
+    inline std::vector<uint16_t> gpioWire;
+
+    inline uint64_t timerTransfers = 0;  ///< Total timer paced DMA writes to the port
+    inline uint64_t timerNanos = 0;      ///< Simulated time of the timer engine
+    inline uint64_t timerInterrupts = 0; ///< Number of DMA1_Channel2_IRQHandler invocations
+
+    inline bool timerActive = false;
+    inline uintptr_t timerCursor = 0;
+    inline uint32_t timerReload = 0;
+
+    /// HCLK cycles elapsed: simulated wire time plus host CPU time, for LED_SPI_CYCLES().
+    inline uint32_t cycles()
+    {
+        uint64_t hostNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch()).count();
+        return (uint32_t)((nanos + hostNanos) * (HCLK / 1000000) / 1000);
+    }
+
+    /// Nanoseconds one SPI byte occupies on the wire at the configured prescaler.
+    inline uint32_t byteNanos()
+    {
+        uint32_t prescaler = 2u << ((spi1.CTLR1 & SPI_CTLR1_BR) >> 3);
+        return (uint32_t)(8ull * prescaler * 1000000000ull / HCLK);
+    }
+
+    inline void onChannelConfig(void *, uint32_t oldValue, uint32_t newValue)
+    {
+        // Like the hardware, the transfer parameters are latched on the rising edge of EN
+        if (!(oldValue & DMA_CFGR1_EN) && (newValue & DMA_CFGR1_EN))
+        {
+            active = true;
+            cursor = dma1Channel3.MADDR;
+            reload = dma1Channel3.CNTR;
+        }
+        else if (!(newValue & DMA_CFGR1_EN))
+        {
+            active = false;
+        }
+    }
+
+    inline void onTimerChannelConfig(void *, uint32_t oldValue, uint32_t newValue)
+    {
+        if (!(oldValue & DMA_CFGR1_EN) && (newValue & DMA_CFGR1_EN))
+        {
+            timerActive = true;
+            timerCursor = dma1Channel2.MADDR;
+            timerReload = dma1Channel2.CNTR;
+        }
+        else if (!(newValue & DMA_CFGR1_EN))
+        {
+            timerActive = false;
+        }
+    }
+
+    /// Nanoseconds between two TIM2 update events.
+    inline uint32_t timerPeriodNanos()
+    {
+        return (uint32_t)((uint64_t)(tim2.PSC + 1) * (tim2.ATRLR + 1) * 1000000000ull / HCLK);
+    }
+
+    inline void onFlagClear(void *, uint32_t, uint32_t value)
+    {
+        // Clearing the global flag of a channel clears all of its flags
+        for (int ch = 0; ch < 8; ch++)
+            if (value & (1u << (ch * 4)))
+                value |= 0xFu << (ch * 4);
+        dma1.INTFR.value &= ~value;
+    }
+
+    /// Put the peripherals back into their reset state. Call before constructing a driver.
+    inline void reset()
+    {
+        dma1 = DMA_TypeDef();
+        dma1Channel3 = DMA_Channel_TypeDef();
+        spi1 = SPI_TypeDef();
+        dma1.INTFCR.onWrite = onFlagClear;
+        dma1Channel3.CFGR.onWrite = onChannelConfig;
+        irqEnabled = false;
+        wire.clear();
+        bytesSent = nanos = interrupts = 0;
+        active = false;
+        cursor = 0;
+        reload = 0;
+
+        dma1Channel2 = DMA_Channel_TypeDef();
+        tim2 = TIM_TypeDef();
+        gpioA = GPIO_TypeDef();
+        gpioB = GPIO_TypeDef();
+        dma1Channel2.CFGR.onWrite = onTimerChannelConfig;
+        timerIrqEnabled = false;
+        gpioWire.clear();
+        timerTransfers = timerNanos = timerInterrupts = 0;
+        timerActive = false;
+        timerCursor = 0;
+        timerReload = 0;
+    }
+
+    inline void raise(uint32_t flags, uint32_t enableBit)
+    {
+        dma1.INTFR.value |= flags | DMA1_IT_GL3;
+        if (irqEnabled && (dma1Channel3.CFGR & enableBit))
+        {
+            interrupts++;
+            DMA1_Channel3_IRQHandler();
+        }
+    }
+
+    /**
+     * @brief Clock up to maxBytes out of SPI1, servicing DMA interrupts as they occur.
+     *
+     * @return Number of bytes actually transferred. Stops early when the channel goes idle.
+     */
+    inline size_t run(size_t maxBytes)
+    {
+        size_t sent = 0;
+        while (sent < maxBytes)
+        {
+            bool spiReady = (spi1.CTLR1 & SPI_CTLR1_SPE) && (spi1.CTLR2 & SPI_CTLR2_TXDMAEN);
+            if (!active || !spiReady || dma1Channel3.CNTR == 0)
+                break;
+
+            uint8_t byte = *(const uint8_t *)cursor;
+            if (dma1Channel3.CFGR & DMA_CFGR1_MINC)
+                cursor++;
+            spi1.DATAR.value = byte;
+            if (capture)
+                wire.push_back(byte);
+            bytesSent++;
+            nanos += byteNanos();
+            sent++;
+
+            uint32_t remaining = dma1Channel3.CNTR.value - 1;
+            dma1Channel3.CNTR.value = remaining;
+
+            if (remaining == reload / 2 && remaining != 0)
+                raise(DMA1_IT_HT3, DMA_CFGR1_HTIE);
+
+            if (remaining == 0)
+            {
+                if (dma1Channel3.CFGR & DMA_CFGR1_CIRC)
+                {
+                    dma1Channel3.CNTR.value = reload;
+                    cursor = dma1Channel3.MADDR;
+                }
+                raise(DMA1_IT_TC3, DMA_CFGR1_TCIE);
+            }
+        }
+        return sent;
+    }
+
+    /**
+     * @brief Let TIM2 trigger up to maxTransfers DMA writes to the port register at PADDR.
+     *
+     * Each update event moves one byte, widened to the 16-bit port like the DMA does with
+     * a byte source and a half-word destination.
+     *
+     * @return Number of writes performed. Stops early when the channel goes idle.
+     */
+    inline size_t runTimer(size_t maxTransfers)
+    {
+        size_t sent = 0;
+        while (sent < maxTransfers)
+        {
+            bool timerReady = (tim2.CTLR1 & TIM_CEN) && (tim2.DMAINTENR & TIM_UDE);
+            if (!timerActive || !timerReady || dma1Channel2.CNTR == 0)
+                break;
+
+            uint16_t value = *(const uint8_t *)timerCursor;
+            if (dma1Channel2.CFGR & DMA_CFGR1_MINC)
+                timerCursor++;
+            ((SimRegister<uint32_t> *)dma1Channel2.PADDR.value)->value = value;
+            if (capture)
+                gpioWire.push_back(value);
+            timerTransfers++;
+            timerNanos += timerPeriodNanos();
+            sent++;
+
+            uint32_t remaining = dma1Channel2.CNTR.value - 1;
+            dma1Channel2.CNTR.value = remaining;
+            if (remaining == 0)
+            {
+                if (dma1Channel2.CFGR & DMA_CFGR1_CIRC)
+                {
+                    dma1Channel2.CNTR.value = timerReload;
+                    timerCursor = dma1Channel2.MADDR;
+                }
+                dma1.INTFR.value |= DMA1_IT_TC2 | DMA1_IT_GL2;
+                if (timerIrqEnabled && (dma1Channel2.CFGR & DMA_CFGR1_TCIE))
+                {
+                    timerInterrupts++;
+                    DMA1_Channel2_IRQHandler();
+                }
+            }
+        }
+        return sent;
+    }
+
+    /**
+     * @brief Advance whichever of the SPI and timer engines is behind by one transfer.
+     *
+     * Keeps the two simulated clocks in step so both outputs make progress together, as
+     * they would on target. @return false when neither engine has anything to send.
+     */
+    inline bool step()
+    {
+        bool spiReady = active && (spi1.CTLR1 & SPI_CTLR1_SPE) && (spi1.CTLR2 & SPI_CTLR2_TXDMAEN) && dma1Channel3.CNTR;
+        bool timerReady = timerActive && (tim2.CTLR1 & TIM_CEN) && (tim2.DMAINTENR & TIM_UDE) && dma1Channel2.CNTR;
+        if (spiReady && (!timerReady || nanos <= timerNanos))
+            return run(1);
+        if (timerReady)
+            return runTimer(1);
+        return false;
+    }
+
+    /// Run until the channel has raised at least `count` more interrupts (or goes idle).
+    inline void runInterrupts(uint64_t count, size_t maxBytes = 1 << 24)
+    {
+        uint64_t target = interrupts + count;
+        while (interrupts < target && maxBytes)
+        {
+            size_t sent = run(1);
+            if (!sent)
+                break;
+            maxBytes--;
+        }
+    }
+}
+
+#define DMA1 (&LEDSim::dma1)
+#define DMA1_Channel3 (&LEDSim::dma1Channel3)
+#define SPI1 (&LEDSim::spi1)
+#define DMA1_Channel2 (&LEDSim::dma1Channel2)
+#define TIM2 (&LEDSim::tim2)
+#define GPIOA (&LEDSim::gpioA)
+#define GPIOB (&LEDSim::gpioB)
+
+inline void DMA_Init(DMA_Channel_TypeDef *channel, DMA_InitTypeDef *init)
+{
+    uint32_t tmpreg = channel->CFGR;
+    tmpreg &= 0xFFFF800F;
+    tmpreg |= init->DMA_DIR | init->DMA_Mode | init->DMA_PeripheralInc | init->DMA_MemoryInc |
+              init->DMA_PeripheralDataSize | init->DMA_MemoryDataSize | init->DMA_Priority | init->DMA_M2M;
+    channel->CFGR = tmpreg;
+    channel->CNTR = init->DMA_BufferSize;
+    channel->PADDR = init->DMA_PeripheralBaseAddr;
+    channel->MADDR = init->DMA_MemoryBaseAddr;
+}
+
+inline void DMA_Cmd(DMA_Channel_TypeDef *channel, FunctionalState state)
+{
+    if (state != DISABLE)
+        channel->CFGR |= DMA_CFGR1_EN;
+    else
+        channel->CFGR &= (uint16_t)~DMA_CFGR1_EN;
+}
+
+inline void DMA_ITConfig(DMA_Channel_TypeDef *channel, uint32_t it, FunctionalState state)
+{
+    if (state != DISABLE)
+        channel->CFGR |= it;
+    else
+        channel->CFGR &= ~it;
+}
+
+inline void DMA_ClearFlag(uint32_t flag) { DMA1->INTFCR = flag; }
+
+inline FlagStatus DMA_GetFlagStatus(uint32_t flag) { return (DMA1->INTFR & flag) ? SET : RESET; }
+
+inline void SPI_Cmd(SPI_TypeDef *spi, FunctionalState state)
+{
+    if (state != DISABLE)
+        spi->CTLR1 |= SPI_CTLR1_SPE;
+    else
+        spi->CTLR1 &= (uint16_t)~SPI_CTLR1_SPE;
+}
+
+inline void RCC_AHBPeriphClockCmd(uint32_t, FunctionalState) {}
+inline void RCC_APB1PeriphClockCmd(uint32_t, FunctionalState) {}
+inline void RCC_APB2PeriphClockCmd(uint32_t, FunctionalState) {}
+
+// Only the mode fields are kept, so the bench can see which pins became outputs. The
+// port value is all the simulated transfers look at
+inline void GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init)
+{
+    uint32_t mode = (init->GPIO_Mode & 0x0F) | (init->GPIO_Mode & 0x10 ? init->GPIO_Speed : 0);
+    for (int pin = 0; pin < 16; pin++)
+    {
+        if (!(init->GPIO_Pin & (1u << pin)))
+            continue;
+        SimRegister<uint32_t> &config = pin < 8 ? port->CFGLR : port->CFGHR;
+        int shift = (pin & 7) * 4;
+        config = (config & ~(0xFu << shift)) | (mode << shift);
+    }
+}
+
+inline void TIM_TimeBaseInit(TIM_TypeDef *timer, TIM_TimeBaseInitTypeDef *init)
+{
+    timer->PSC = init->TIM_Prescaler;
+    timer->ATRLR = init->TIM_Period;
+}
+
+inline void TIM_DMACmd(TIM_TypeDef *timer, uint16_t source, FunctionalState state)
+{
+    if (state != DISABLE)
+        timer->DMAINTENR |= source;
+    else
+        timer->DMAINTENR &= (uint16_t)~source;
+}
+
+inline void TIM_Cmd(TIM_TypeDef *timer, FunctionalState state)
+{
+    if (state != DISABLE)
+        timer->CTLR1 |= TIM_CEN;
+    else
+        timer->CTLR1 &= (uint16_t)~TIM_CEN;
+}
+
+inline void NVIC_EnableIRQ(IRQn_Type irq)
+{
+    if (irq == DMA1_Channel3_IRQn)
+        LEDSim::irqEnabled = true;
+    if (irq == DMA1_Channel2_IRQn)
+        LEDSim::timerIrqEnabled = true;
+}
+
+inline void NVIC_DisableIRQ(IRQn_Type irq)
+{
+    if (irq == DMA1_Channel3_IRQn)
+        LEDSim::irqEnabled = false;
+    if (irq == DMA1_Channel2_IRQn)
+        LEDSim::timerIrqEnabled = false;
+}
+
+inline void __NOP() {}
+
+// Interrupts are delivered synchronously by LEDSim::run(), so masking them has nothing to do
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+
+/// Sleep until the next interrupt: keep the simulated DMAs running until one raises one.
+inline void __WFI()
+{
+    uint64_t interrupts = LEDSim::interrupts + LEDSim::timerInterrupts;
+    for (size_t i = 0; i < (1 << 24) && LEDSim::interrupts + LEDSim::timerInterrupts == interrupts; i++)
+        if (!LEDSim::step())
+            break;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "FixedPoint.cpp"
+
+/// 8-bit per channel color used by the bulk encoding functions.
+struct RGB {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+/**
+ * @brief Compact HSV color for content arrays, see hsvToRGB().
+ *
+ * h is an AngleHz and wraps: 4 * FP_FIXED_VAL is a full turn, red at 0, green at a third
+ * and blue at two thirds. s and v are 0..255.
+ */
+struct HSV {
+    uint16_t h;
+    uint8_t s;
+    uint8_t v;
+};
+
+/**
+ * @brief HSV to RGB with shifts and multiplies only.
+ *
+ * The hue is split into sixths of a turn by a multiply by 6: the sector lands in the bits
+ * above the 10 bits of a turn, the position within it in those 10 bits. In each sector
+ * one channel is v, one is v (1 - s) and the third moves linearly between the two.
+ *
+ * @param h Hue in AngleHz, any value.
+ * @param s Saturation, 0 (grey) to FP_FIXED_VAL (pure hue).
+ * @param v Value on the 0..255 scale of LED_SPI_CH32::setLED(), which no channel exceeds.
+ */
+inline RGB hsvToRGB(AngleHz h, Fixed8 s, Fixed8 v)
+{
+    const uint32_t TURN_BITS = FP_FIXED_BITS + 2;
+    uint32_t sixths = (uint32_t)(h & ((1 << TURN_BITS) - 1)) * 6;
+    uint32_t sector = sixths >> TURN_BITS;
+    int32_t fraction = sixths & ((1 << TURN_BITS) - 1);
+
+    // s v in Q8, times the 10 bit fraction: 18 bits to shift out
+    int32_t sv = s * v;
+    int32_t top = v;
+    int32_t bottom = v - ((sv + (1 << (FP_FIXED_BITS - 1))) >> FP_FIXED_BITS);
+    int32_t ramp = (sv * fraction + (1 << (FP_FIXED_BITS + TURN_BITS - 1))) >> (FP_FIXED_BITS + TURN_BITS);
+    int32_t rising = bottom + ramp;
+    int32_t falling = top - ramp;
+
+    switch (sector)
+    {
+    case 0:
+        return {(uint8_t)top, (uint8_t)rising, (uint8_t)bottom};
+    case 1:
+        return {(uint8_t)falling, (uint8_t)top, (uint8_t)bottom};
+    case 2:
+        return {(uint8_t)bottom, (uint8_t)top, (uint8_t)rising};
+    case 3:
+        return {(uint8_t)bottom, (uint8_t)falling, (uint8_t)top};
+    case 4:
+        return {(uint8_t)rising, (uint8_t)bottom, (uint8_t)top};
+    default:
+        return {(uint8_t)top, (uint8_t)bottom, (uint8_t)falling};
+    }
+}
+
+/**
+ * @brief hsvToRGB() of a compact HSV. s = 255 is fully saturated.
+ */
+inline RGB hsvToRGB(HSV color)
+{
+    return hsvToRGB(color.h, color.s + (color.s >> 7), color.v);
+}
+
+/**
+ * @brief Rotation of RGB colors about the grey axis: shifts the hue of colors already in RGB.
+ *
+ * The rotation matrix about (1, 1, 1) is circulant, so three coefficients describe it.
+ * They are worked out once per angle with sinFP() and cosFP(); apply() is then three
+ * multiplies per channel. Greys stay grey and a third of a turn takes red to green exactly.
+ */
+struct HueRotation
+{
+    int32_t a, b, c; ///< Row of the matrix for red, in Q8: r' = a r + b g + c b.
+
+    explicit HueRotation(AngleHz angle)
+    {
+        const int32_t ONE_THIRD = 85;         // 1/3 in Q8, rounded
+        const int32_t ONE_OVER_SQRT3 = 148;   // 1/sqrt(3) in Q8, rounded
+        const int32_t HALF = 1 << (FP_FIXED_BITS - 1);
+        int32_t cosine = cosFP(angle), sine = sinFP(angle);
+        int32_t third = ((FP_FIXED_VAL - cosine) * ONE_THIRD + HALF) >> FP_FIXED_BITS;
+        int32_t skew = (sine * ONE_OVER_SQRT3 + HALF) >> FP_FIXED_BITS;
+        // The row sums to exactly one so greys come out unchanged despite the rounding
+        b = third - skew;
+        c = third + skew;
+        a = FP_FIXED_VAL - b - c;
+    }
+
+    RGB apply(RGB color) const
+    {
+        return {channel(color.r, color.g, color.b), channel(color.g, color.b, color.r), channel(color.b, color.r, color.g)};
+    }
+
+    /// Rotate count colors in place.
+    void apply(RGB *colors, size_t count) const
+    {
+        for (size_t i = 0; i < count; i++)
+            colors[i] = apply(colors[i]);
+    }
+
+private:
+    uint8_t channel(int32_t self, int32_t next, int32_t previous) const
+    {
+        int32_t value = (a * self + b * next + c * previous + (1 << (FP_FIXED_BITS - 1))) >> FP_FIXED_BITS;
+        return value < 0 ? 0 : value > 255 ? 255 : value;
+    }
+};
+
+/**
+ * @brief floor(x * scale) for x in [0, 1], read from the bits of the float.
+ *
+ * Integer operations only, so the FPU-less core does not call into soft-float. Values
+ * below 0 give 0; 1, larger values, infinity and NaN give scale.
+ */
+inline int32_t scaleUnitFloat(float x, int32_t scale)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    if ((int32_t)bits <= 0)
+        return 0;
+
+    // x = mantissa * 2^(exponent - 150), with the implicit bit only for normal numbers
+    int32_t exponent = bits >> 23;
+    if (exponent >= 127)
+        return scale;
+    uint64_t mantissa = (bits & 0x7FFFFF) | (exponent ? 0x800000 : 0);
+    int32_t shift = 150 - (exponent ? exponent : 1);
+    return shift >= 64 ? 0 : (int32_t)((mantissa * scale) >> shift);
+}
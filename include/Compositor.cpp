@@ -0,0 +1,286 @@
+#pragma once
+
+#include "LEDSPI.h"
+
+// Blend kernels work on two 8-bit channels per 32-bit word, in lanes 0x00AA00BB: the byte
+// above each channel absorbs products, carries and borrows without touching the other lane.
+// A pixel 0xAARRGGBB splits into the words R,B and 0,G.
+#define LED_BLEND_LANES 0x00FF00FFu
+#define LED_BLEND_CARRIES 0x01000100u
+
+/// How a layer combines with the layers below it. All modes are scaled by the layer alpha.
+enum LED_BlendMode : uint8_t {
+    LED_BLEND_NORMAL,   ///< Cover what is below.
+    LED_BLEND_ADD,      ///< Add to what is below, saturating at 255.
+    LED_BLEND_MULTIPLY, ///< Multiply what is below, 255 being 1.
+    LED_BLEND_MAX,      ///< Keep the brighter of the layer and what is below, per channel.
+};
+
+/// d + (s - d) a for two lanes, a in 0..256.
+inline uint32_t LED_BlendLerp(uint32_t d, uint32_t s, uint32_t a)
+{
+    return ((d * (256 - a) + s * a) >> 8) & LED_BLEND_LANES;
+}
+
+/// d + s a for two lanes, a in 0..256, saturating: a lane that carries into bit 8 is set to 255.
+inline uint32_t LED_BlendAdd(uint32_t d, uint32_t s, uint32_t a)
+{
+    uint32_t sum = d + ((s * a >> 8) & LED_BLEND_LANES);
+    uint32_t carries = sum & LED_BLEND_CARRIES;
+    return (sum | (carries - (carries >> 8))) & LED_BLEND_LANES;
+}
+
+/// d s / 255 for two lanes. The lanes are multiplied one at a time: there is no lane-wise multiply.
+inline uint32_t LED_BlendMultiply(uint32_t d, uint32_t s)
+{
+    uint32_t products = (d & 0xFF) * (s & 0xFF) | ((d >> 16) * (s >> 16)) << 16;
+    return ((products + LED_BLEND_LANES) >> 8) & LED_BLEND_LANES;
+}
+
+/// max(d, s) for two lanes: bit 8 of 256 + s - d is set where s >= d.
+inline uint32_t LED_BlendMax(uint32_t d, uint32_t s)
+{
+    uint32_t mask = ((((s | LED_BLEND_CARRIES) - d) >> 8) & 0x00010001u) * 0xFF;
+    return (s & mask) | (d & ~mask);
+}
+
+/**
+ * @brief Stack of Layers full strip layers blended into one driver.
+ *
+ * Layer 0 is at the bottom and blends over black. Pixels are 0xAARRGGBB, the alpha byte
+ * being that pixel's coverage, times the layer's opacity. Layers start out transparent.
+ *
+ * Every layer tracks the range of LEDs written since the last compose(). compose() only
+ * blends that range, chunk by chunk straight into setPixels(), so the strip is never
+ * buffered whole a second time. It also keeps the blend of the layers below the lowest
+ * layer that changed: while only the top layers change (sparkles over a still background),
+ * the layers under them are not blended again.
+ *
+ * The color path of the driver is RGB, so RGBW LEDs get a white channel of 0.
+ *
+ * @tparam Layers Number of layers.
+ * @tparam MaxLEDs LEDs each layer holds: Layers + 1 words of RAM per LED.
+ */
+template <uint8_t Layers, size_t MaxLEDs>
+class LED_SPI_Compositor
+{
+public:
+    /**
+     * @fn LED_SPI_Compositor(LED_SPI_CH32 &leds, size_t numLEDs)
+     * @param leds Driver the layers are composed into.
+     * @param numLEDs LEDs to compose, clipped to MaxLEDs.
+     */
+    LED_SPI_Compositor(LED_SPI_CH32 &leds, size_t numLEDs) : _leds(leds), _numLEDs(numLEDs < MaxLEDs ? numLEDs : MaxLEDs)
+    {
+        for (uint8_t layer = 0; layer < Layers; layer++)
+        {
+            _opacity[layer] = 255;
+            markDirty(layer, 0, _numLEDs);
+        }
+    }
+
+    /**
+     * @fn void setPixel(uint8_t layer, size_t index, uint32_t argb)
+     * @brief Set one pixel of a layer, 0xAARRGGBB.
+     */
+    void setPixel(uint8_t layer, size_t index, uint32_t argb)
+    {
+        if (layer >= Layers || index >= _numLEDs)
+            return;
+        _pixels[layer][index] = argb;
+        markDirty(layer, index, 1);
+    }
+
+    /**
+     * @fn void setPixel(uint8_t layer, size_t index, RGB color, uint8_t alpha)
+     * @brief Set one pixel of a layer from an RGB color and its coverage.
+     */
+    void setPixel(uint8_t layer, size_t index, RGB color, uint8_t alpha = 255)
+    {
+        setPixel(layer, index, (uint32_t)alpha << 24 | color.r << 16 | color.g << 8 | color.b);
+    }
+
+    /**
+     * @fn void fill(uint8_t layer, size_t start, size_t count, uint32_t argb)
+     * @brief Set a run of pixels of a layer to one 0xAARRGGBB value. fill(layer, 0, n, 0) clears it.
+     */
+    void fill(uint8_t layer, size_t start, size_t count, uint32_t argb)
+    {
+        if (layer >= Layers || start >= _numLEDs)
+            return;
+        if (count > _numLEDs - start)
+            count = _numLEDs - start;
+        for (size_t i = start; i < start + count; i++)
+            _pixels[layer][i] = argb;
+        markDirty(layer, start, count);
+    }
+
+    /**
+     * @fn uint32_t *pixels(uint8_t layer)
+     * @brief Pixels of a layer for drawing in bulk. Report what was written with markDirty().
+     */
+    uint32_t *pixels(uint8_t layer) { return _pixels[layer]; }
+
+    /**
+     * @fn void markDirty(uint8_t layer, size_t start, size_t count)
+     * @brief Have the next compose() blend LEDs start to start + count - 1 of a layer again.
+     */
+    void markDirty(uint8_t layer, size_t start, size_t count)
+    {
+        if (layer >= Layers || !count)
+            return;
+        if (start < _dirtyStart[layer])
+            _dirtyStart[layer] = start;
+        if (start + count > _dirtyEnd[layer])
+            _dirtyEnd[layer] = start + count;
+    }
+
+    /**
+     * @fn void setOpacity(uint8_t layer, uint8_t opacity)
+     * @brief Scale the alpha of every pixel of a layer, 255 being unchanged and 0 hiding the layer.
+     */
+    void setOpacity(uint8_t layer, uint8_t opacity)
+    {
+        if (layer >= Layers || opacity == _opacity[layer])
+            return;
+        _opacity[layer] = opacity;
+        markDirty(layer, 0, _numLEDs);
+    }
+
+    /**
+     * @fn void setBlendMode(uint8_t layer, LED_BlendMode mode)
+     * @brief Set how a layer combines with the layers below it. Layers start as LED_BLEND_NORMAL.
+     */
+    void setBlendMode(uint8_t layer, LED_BlendMode mode)
+    {
+        if (layer >= Layers || mode == _mode[layer])
+            return;
+        _mode[layer] = mode;
+        markDirty(layer, 0, _numLEDs);
+    }
+
+    /**
+     * @fn size_t compose()
+     * @brief Blend the LEDs that changed since the last call into the driver. Does not call show().
+     *
+     * @return Number of LEDs blended and handed to the driver, 0 if no layer changed.
+     */
+    size_t compose()
+    {
+        uint8_t lowest = 0;
+        while (lowest < Layers && _dirtyStart[lowest] >= _dirtyEnd[lowest])
+            lowest++;
+        if (lowest == Layers)
+            return 0;
+
+        // The LEDs to send are the ones any layer changed. The cached blend of the layers
+        // below the lowest changed one is still right if it covers exactly those layers.
+        size_t start = _numLEDs, end = 0;
+        for (uint8_t layer = lowest; layer < Layers; layer++)
+        {
+            start = _dirtyStart[layer] < start ? _dirtyStart[layer] : start;
+            end = _dirtyEnd[layer] > end ? _dirtyEnd[layer] : end;
+            _dirtyStart[layer] = SIZE_MAX;
+            _dirtyEnd[layer] = 0;
+        }
+        if (_baseLayers != lowest)
+        {
+            for (size_t i = 0; i < _numLEDs; i++)
+                _base[i] = 0;
+            blendLayers(_base, 0, _numLEDs, 0, lowest);
+            _baseLayers = lowest;
+        }
+
+        uint32_t chunk[CHUNK_LEDS];
+        RGB colors[CHUNK_LEDS];
+        for (size_t first = start; first < end; first += CHUNK_LEDS)
+        {
+            size_t count = end - first < CHUNK_LEDS ? end - first : CHUNK_LEDS;
+            for (size_t i = 0; i < count; i++)
+                chunk[i] = _base[first + i];
+            blendLayers(chunk, first, count, lowest, Layers);
+            for (size_t i = 0; i < count; i++)
+                colors[i] = {(uint8_t)(chunk[i] >> 16), (uint8_t)(chunk[i] >> 8), (uint8_t)chunk[i]};
+            _leds.setPixels(colors, count, first);
+        }
+        return end - start;
+    }
+
+private:
+    static constexpr size_t CHUNK_LEDS = 32;
+
+    /// Blend layers first to last - 1 over out, which holds LEDs start to start + count - 1 as 0x00RRGGBB.
+    void blendLayers(uint32_t *out, size_t start, size_t count, uint8_t first, uint8_t last)
+    {
+        for (uint8_t layer = first; layer < last; layer++)
+        {
+            if (!_opacity[layer])
+                continue;
+            const uint32_t *in = _pixels[layer] + start;
+            switch (_mode[layer])
+            {
+            case LED_BLEND_NORMAL:
+                blendRun<LED_BLEND_NORMAL>(out, in, count, _opacity[layer]);
+                break;
+            case LED_BLEND_ADD:
+                blendRun<LED_BLEND_ADD>(out, in, count, _opacity[layer]);
+                break;
+            case LED_BLEND_MULTIPLY:
+                blendRun<LED_BLEND_MULTIPLY>(out, in, count, _opacity[layer]);
+                break;
+            case LED_BLEND_MAX:
+                blendRun<LED_BLEND_MAX>(out, in, count, _opacity[layer]);
+                break;
+            }
+        }
+    }
+
+    template <LED_BlendMode Mode>
+    static void blendRun(uint32_t *out, const uint32_t *in, size_t count, uint8_t opacity)
+    {
+        // 0..255 to 0..256 so that 255 is exactly one
+        const uint32_t layerAlpha = opacity + (opacity >> 7);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t pixel = in[i];
+            uint32_t alpha = pixel >> 24;
+            alpha = ((alpha + (alpha >> 7)) * layerAlpha) >> 8;
+            if (!alpha)
+                continue;
+
+            uint32_t dRB = out[i] & LED_BLEND_LANES, dG = (out[i] >> 8) & 0xFF;
+            uint32_t sRB = pixel & LED_BLEND_LANES, sG = (pixel >> 8) & 0xFF;
+            if (Mode == LED_BLEND_ADD)
+            {
+                dRB = LED_BlendAdd(dRB, sRB, alpha);
+                dG = LED_BlendAdd(dG, sG, alpha);
+            }
+            else
+            {
+                if (Mode == LED_BLEND_MULTIPLY)
+                {
+                    sRB = LED_BlendMultiply(dRB, sRB);
+                    sG = LED_BlendMultiply(dG, sG);
+                }
+                else if (Mode == LED_BLEND_MAX)
+                {
+                    sRB = LED_BlendMax(dRB, sRB);
+                    sG = LED_BlendMax(dG, sG);
+                }
+                dRB = LED_BlendLerp(dRB, sRB, alpha);
+                dG = LED_BlendLerp(dG, sG, alpha);
+            }
+            out[i] = dRB | dG << 8;
+        }
+    }
+
+    LED_SPI_CH32 &_leds;
+    size_t _numLEDs;
+    uint32_t _pixels[Layers][MaxLEDs] = {};
+    uint32_t _base[MaxLEDs] = {};     ///< Layers 0 to _baseLayers - 1 blended over black.
+    uint8_t _baseLayers = 0;
+    uint8_t _opacity[Layers] = {};
+    LED_BlendMode _mode[Layers] = {};
+    size_t _dirtyStart[Layers] = {};
+    size_t _dirtyEnd[Layers] = {};
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include "LEDSPI.h"
+#include "FixedPoint.cpp"
+
+/*
+ * Effects are built from terms. A term is a struct with two functions:
+ *
+ *   void frame(const EffectFrame &f)   Work that is the same for every LED of the frame.
+ *   Q8 next()                          Value at the current LED, then step to the next one.
+ *
+ * next() is called once per LED in order, starting right after frame(), so per LED state
+ * advances by recurrences instead of being recomputed from the LED index. Terms hold the
+ * terms they are built from as members and every call is inlined: a composed effect is one
+ * loop over the strip with the per frame work hoisted out of it.
+ *
+ * A term whose values only depend on a per frame quantity that changes every few frames
+ * can also provide
+ *
+ *   int32_t key() const                That quantity, valid after frame().
+ *
+ * and be wrapped in EffectCached, which replays the values of the last frame with the same key.
+ */
+
+/// What a term can depend on per frame.
+struct EffectFrame
+{
+    size_t numLEDs;
+    int t; ///< Frame counter, advanced by one every tick.
+};
+
+/**
+ * @brief Distance from each LED to a point orbiting the strip on a circle of radius numLEDs.
+ *
+ * LED x sits at (x, 0) and the point at (R sin(phase), R cos(phase)), so the squared
+ * distance is R^2 - 2 x R sin(phase) + x^2. Its first difference grows by exactly 2 per LED,
+ * so next() updates it with two additions and only the root is left per LED.
+ *
+ * @tparam Speed Phase advance per frame, in 1/256 AngleHz.
+ * @tparam Phase Phase at t = 0, in AngleHz.
+ */
+template <int Speed, int Phase = 0>
+struct EffectOrbitDistance
+{
+    void frame(const EffectFrame &f)
+    {
+        const Q8 R = f.numLEDs;
+        const Q8 sine = sinFP(Q8::fromRaw(f.t * Speed / 256 + Phase));
+        _square = R * R;
+        _step = Q8(1) - 2 * (R * sine);
+        _key = _step.raw();
+    }
+
+    /// The phase only moves every 256 / Speed frames, and the distances with it.
+    int32_t key() const { return _key; }
+
+    Q8 next()
+    {
+        Q8 distance = sqrtFP(_square);
+        // (x + 1)^2 - x^2 = 2x + 1: the step to the next LED grows by 2 each time
+        _square += _step;
+        _step += Q8(2);
+        return distance;
+    }
+
+    Q8 _square;
+    Q8 _step;
+    int32_t _key;
+};
+
+/**
+ * @brief Term that remembers the values of Term and replays them while Term::key() is unchanged.
+ *
+ * Turns a per LED term with a slowly moving input into a load per LED on most frames, at
+ * the cost of MaxLEDs values of RAM. Strips longer than MaxLEDs are computed every frame.
+ *
+ * @tparam Term Term with a key(), see the top of this file.
+ * @tparam MaxLEDs LEDs the cache holds.
+ */
+template <class Term, size_t MaxLEDs>
+struct EffectCached
+{
+    void frame(const EffectFrame &f)
+    {
+        _term.frame(f);
+        _replay = _valid && _term.key() == _key && f.numLEDs == _numLEDs;
+        _valid = f.numLEDs <= MaxLEDs;
+        _key = _term.key();
+        _numLEDs = f.numLEDs;
+        _index = 0;
+    }
+
+    Q8 next()
+    {
+        if (_replay)
+            return _values[_index++];
+        Q8 value = _term.next();
+        if (_valid)
+            _values[_index++] = value;
+        return value;
+    }
+
+    Term _term;
+    Q8 _values[MaxLEDs];
+    size_t _index = 0;
+    size_t _numLEDs = 0;
+    int32_t _key = 0;
+    bool _valid = false;
+    bool _replay = false;
+};
+
+/**
+ * @brief sin(Speed t + Scale / 256 * input), the input being another term.
+ *
+ * @tparam Input Term giving the per LED part of the angle.
+ * @tparam Speed Angle advance per frame, in AngleHz.
+ * @tparam Scale Input to angle factor, in 1/256.
+ */
+template <class Input, int Speed, int Scale>
+struct EffectSine
+{
+    void frame(const EffectFrame &f)
+    {
+        _input.frame(f);
+        _base = Q8::fromRaw(Speed * f.t);
+    }
+
+    Q8 next() { return sinFP(_base + _input.next() * Scale / 256); }
+
+    Input _input;
+    Q8 _base;
+};
+
+/**
+ * @brief Three terms as the red, green and blue channels, plus a constant offset.
+ *
+ * @tparam Offset Added to every channel, raw Q8 (the 0..255 channel scale of setLED()).
+ */
+template <class Red, class Green, class Blue, int Offset = 0>
+struct EffectRGB
+{
+    /**
+     * @fn void draw(LED_SPI_CH32& leds, size_t numLEDs, int t)
+     * @brief Render frame t into the first numLEDs LEDs of leds.
+     *
+     * Flattened so the terms and the fixed point functions they call end up in the one
+     * loop even when that exceeds the inliner's budget, as three sqrtFP() do.
+     */
+    __attribute__((flatten)) void draw(LED_SPI_CH32 &leds, size_t numLEDs, int t)
+    {
+        const EffectFrame f = {numLEDs, t};
+        _red.frame(f);
+        _green.frame(f);
+        _blue.frame(f);
+
+        const Q8 offset = Q8::fromRaw(Offset);
+        for (size_t i = 0; i < numLEDs; i++)
+            leds.setLED(i, _red.next() + offset, _green.next() + offset, _blue.next() + offset);
+    }
+
+    Red _red;
+    Green _green;
+    Blue _blue;
+};
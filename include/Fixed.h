@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+/**
+ * @brief Signed fixed point number with FracBits fractional bits stored in Storage.
+ *
+ * Header-only and constexpr throughout, so constants written as Fixed<8>(0.5) are
+ * converted at compile time. Multiplication widens to twice the storage size before
+ * shifting back, which is a single mul/mulh pair on RV32IMAC for 32-bit storage, and is
+ * exact (rounded toward negative infinity) as long as the result fits. The sat*()
+ * functions clamp to the representable range instead of wrapping.
+ *
+ * Arithmetic with a plain int scales the number (x * 3 is three times x); use fromRaw()
+ * and raw() to move between the stored integer and the value it represents.
+ *
+ * @tparam FracBits Number of fractional bits.
+ * @tparam Storage Signed integer type holding the value, int32_t or int16_t.
+ */
+template <int FracBits, typename Storage = int32_t>
+class Fixed
+{
+    static_assert(std::is_signed<Storage>::value, "Fixed needs a signed storage type");
+    static_assert(sizeof(Storage) <= 4, "Storage wider than 32 bits has no wider type to multiply in");
+    static_assert(FracBits > 0 && FracBits < (int)(8 * sizeof(Storage)), "FracBits must leave room for the sign");
+
+public:
+    /// Type products are formed in before shifting back to Storage.
+    typedef typename std::conditional<sizeof(Storage) == 4, int64_t, int32_t>::type Wide;
+
+    static constexpr int FRAC_BITS = FracBits;
+    static constexpr Storage ONE_RAW = (Storage)1 << FracBits;
+    static constexpr Storage FRACTION_MASK = ONE_RAW - 1;
+
+    constexpr Fixed() : _raw(0) {}
+
+    /// Whole number.
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    constexpr Fixed(T value) : _raw((Storage)(value * ONE_RAW)) {}
+
+    /// Rounds to the nearest representable value. Evaluated by the compiler for constants.
+    template <typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    constexpr Fixed(T value) : _raw((Storage)(value * ONE_RAW + (value < 0 ? -0.5 : 0.5))) {}
+
+    static constexpr Fixed fromRaw(Storage raw)
+    {
+        Fixed f;
+        f._raw = raw;
+        return f;
+    }
+
+    static constexpr Fixed max() { return fromRaw(std::numeric_limits<Storage>::max()); }
+    static constexpr Fixed min() { return fromRaw(std::numeric_limits<Storage>::min()); }
+
+    constexpr Storage raw() const { return _raw; }
+
+    /// Integer part, rounded toward negative infinity.
+    constexpr int toInt() const { return _raw >> FracBits; }
+
+    constexpr float toFloat() const { return (float)_raw / ONE_RAW; }
+
+    /// Same value in another format. Fractional bits are truncated when there are fewer.
+    template <int F, typename S>
+    constexpr Fixed<F, S> as() const
+    {
+        return Fixed<F, S>::fromRaw(F >= FracBits ? (S)((Wide)_raw << (F - FracBits)) : (S)(_raw >> (FracBits - F)));
+    }
+
+    constexpr Fixed operator-() const { return fromRaw(-_raw); }
+    constexpr Fixed operator+(Fixed b) const { return fromRaw(_raw + b._raw); }
+    constexpr Fixed operator-(Fixed b) const { return fromRaw(_raw - b._raw); }
+    constexpr Fixed operator*(Fixed b) const { return fromRaw((Storage)(((Wide)_raw * b._raw) >> FracBits)); }
+    constexpr Fixed operator/(Fixed b) const { return fromRaw((Storage)(((Wide)_raw << FracBits) / b._raw)); }
+
+    constexpr Fixed operator*(int b) const { return fromRaw(_raw * b); }
+    constexpr Fixed operator/(int b) const { return fromRaw(_raw / b); }
+    constexpr Fixed operator>>(int bits) const { return fromRaw(_raw >> bits); }
+    constexpr Fixed operator<<(int bits) const { return fromRaw(_raw << bits); }
+    friend constexpr Fixed operator*(int a, Fixed b) { return b * a; }
+
+    constexpr Fixed &operator+=(Fixed b) { return *this = *this + b; }
+    constexpr Fixed &operator-=(Fixed b) { return *this = *this - b; }
+    constexpr Fixed &operator*=(Fixed b) { return *this = *this * b; }
+    constexpr Fixed &operator*=(int b) { return *this = *this * b; }
+
+    constexpr bool operator==(Fixed b) const { return _raw == b._raw; }
+    constexpr bool operator!=(Fixed b) const { return _raw != b._raw; }
+    constexpr bool operator<(Fixed b) const { return _raw < b._raw; }
+    constexpr bool operator<=(Fixed b) const { return _raw <= b._raw; }
+    constexpr bool operator>(Fixed b) const { return _raw > b._raw; }
+    constexpr bool operator>=(Fixed b) const { return _raw >= b._raw; }
+
+    /// a + b, clamped to [min(), max()].
+    friend constexpr Fixed satAdd(Fixed a, Fixed b) { return clamp((Wide)a._raw + b._raw); }
+
+    /// a - b, clamped to [min(), max()].
+    friend constexpr Fixed satSub(Fixed a, Fixed b) { return clamp((Wide)a._raw - b._raw); }
+
+    /// a * b, clamped to [min(), max()].
+    friend constexpr Fixed satMul(Fixed a, Fixed b)
+    {
+        // The product of two Storage values always fits in Wide, only the shifted result may not
+        return clamp(((Wide)a._raw * b._raw) >> FracBits);
+    }
+
+private:
+    Storage _raw;
+
+    static constexpr Fixed clamp(Wide value)
+    {
+        return value > std::numeric_limits<Storage>::max()   ? max()
+               : value < std::numeric_limits<Storage>::min() ? min()
+                                                             : fromRaw((Storage)value);
+    }
+};
+
+/// The 8 fractional bit format used throughout the drawing code (same scale as Fixed8).
+typedef Fixed<8, int32_t> Q8;
+
+/// 16 fractional bits, for intermediate results that need more precision.
+typedef Fixed<16, int32_t> Q16;
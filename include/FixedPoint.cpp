@@ -1,8 +1,9 @@
 #pragma once
-#include "debug.cpp"
+#include <cstdlib>
+#include "Fixed.h"
 
 // Define signed fixed point type
-// 8 fixed fractional bits
+// 8 fixed fractional bits. Raw integer form of Q8 (see Fixed.h), kept for the functions below
 typedef int Fixed8;
 
 // Define angular unit
@@ -18,17 +19,17 @@ typedef int AngleHz;
 #define FP_2PI FP_PI * 2
 #define FP_PI_2 FP_PI / 2
 
-Fixed8 add(Fixed8 a, Fixed8 b)
+inline Fixed8 add(Fixed8 a, Fixed8 b)
 {
     return a + b;
 }
 
-Fixed8 sub(Fixed8 a, Fixed8 b)
+inline Fixed8 sub(Fixed8 a, Fixed8 b)
 {
     return a - b;
 }
 
-Fixed8 mult(Fixed8 a, Fixed8 b)
+inline Fixed8 mult(Fixed8 a, Fixed8 b)
 {
     int h1 = a >> FP_FIXED_BITS, h2 = b >> FP_FIXED_BITS;     // Integer portion of the number
     int l1 = a & FP_FRACTION_MASK, l2 = b & FP_FRACTION_MASK; // Fractional portion of the number
@@ -42,145 +43,244 @@ Fixed8 mult(Fixed8 a, Fixed8 b)
 
 constexpr Fixed8 computeSinLUT(AngleHz x)
 {
-    // Define polynomial coeffciients
-    const double a = 0.00809167377688, b = -0.166592452584;
-
     // Convert to radians
     double xRad = x * M_PI_2 / FP_FIXED_VAL;
 
-    // sinx = ax^5 + bx^3 + x
-    return xRad * (1.0 + xRad * xRad * (b + xRad * xRad * a)) * FP_FIXED_VAL;
+    // Taylor series to x^15, accurate to well under one step over the first quarter turn
+    double term = xRad, sum = xRad;
+    for (int n = 1; n <= 7; n++)
+    {
+        term *= -xRad * xRad / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+
+    // Rounded to the nearest step
+    return sum * FP_FIXED_VAL + 0.5;
 }
 
-#define LUT_BITS 4
-#define BIN_SIZE (1 << (FP_FIXED_BITS - LUT_BITS))
-constexpr Fixed8 sinLUT[(1 << LUT_BITS) + 1] = {
-    computeSinLUT(0 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(1 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(2 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(3 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(4 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(5 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(6 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(7 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(8 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(9 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(10 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(11 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(12 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(13 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(14 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(15 * FP_FIXED_VAL / BIN_SIZE),
-    computeSinLUT(16 * FP_FIXED_VAL / BIN_SIZE)};
-
-Fixed8 sinFP(AngleHz x)
-{
-    // Save the sign of the
-    int sign = x < 0 ? -1 : 1;
-    x = abs(x);
-
-    int xFrac = x & FP_FRACTION_MASK;
-    int xInt = x >> FP_FIXED_BITS;
-
-    // If x is in an odd quadrant (0-indexed), reverse the bits
-    if (xInt % 2 == 1)
-        xFrac = FP_FIXED_VAL - xFrac;
-
-// Look up the sin value
-#if LUT_BITS == 8
-    // LUT table has a value for each possible fraction
-    Fixed8 sinVal = sinLUT[xFrac];
-#else
-    // Perform linear interpolation between the LUT values
-    size_t a = xFrac / BIN_SIZE; // Find the nearest 16th value to look up in the table
-    size_t offset = xFrac & ((1 << LUT_BITS) - 1);
-
-    Fixed8 sinVal = (offset * sinLUT[a + 1] + (BIN_SIZE - offset) * sinLUT[a]) / BIN_SIZE;
+// Number of table entries per quarter turn is 2^SIN_LUT_BITS. 8 gives one entry per
+// possible angle and no interpolation (514 bytes of flash); fewer bits interpolate
+// linearly between entries.
+#ifndef SIN_LUT_BITS
+#define SIN_LUT_BITS 8
 #endif
 
-    // If it's in quadrant 2 or 3 (0-indexed), negate the return value
-    if (xInt % 4 >= 2)
-        sign *= -1;
+/**
+ * @brief First quarter of a sine wave sampled at 2^LutBits + 1 points, generated at compile time.
+ *
+ * One extra copy of the last entry lets the interpolation read entry a + 1 at 90°
+ * without a bounds check.
+ */
+template <int LutBits>
+struct SinTable
+{
+    static_assert(LutBits >= 1 && LutBits <= FP_FIXED_BITS, "LutBits must be 1..FP_FIXED_BITS");
+    int16_t values[(1 << LutBits) + 2];
+
+    constexpr SinTable() : values()
+    {
+        for (int i = 0; i <= (1 << LutBits); i++)
+            values[i] = computeSinLUT(i << (FP_FIXED_BITS - LutBits));
+        values[(1 << LutBits) + 1] = values[1 << LutBits];
+    }
+};
+
+template <int LutBits>
+constexpr SinTable<LutBits> sinLUT;
+
+/**
+ * @brief Sine of an angle in AngleHz (256 per quarter turn), using a 2^LutBits entry table.
+ *
+ * The quadrant is folded straight from the bits of x with masks instead of abs(),
+ * % and sign multiplications: bit 8 mirrors the angle within the quarter, bit 9
+ * negates the result. Negative angles and angles past one turn wrap naturally.
+ */
+template <int LutBits>
+inline Fixed8 sinFPLut(AngleHz x)
+{
+    const uint32_t SHIFT = FP_FIXED_BITS - LutBits;
+    uint32_t angle = x;
+    uint32_t mirror = -((angle >> FP_FIXED_BITS) & 1);   // All ones in quadrants 1 and 3
+    uint32_t negate = -((angle >> (FP_FIXED_BITS + 1)) & 1); // All ones in quadrants 2 and 3
+
+    // FP_FIXED_VAL - frac in mirrored quadrants: ~frac + FP_FIXED_VAL + 1
+    uint32_t index = ((angle & FP_FRACTION_MASK) ^ mirror) + (mirror & (FP_FIXED_VAL + 1));
+
+    int32_t value;
+    if (SHIFT == 0)
+    {
+        value = sinLUT<LutBits>.values[index];
+    }
+    else
+    {
+        uint32_t a = index >> SHIFT;
+        int32_t offset = index & ((1 << SHIFT) - 1);
+        int32_t low = sinLUT<LutBits>.values[a], high = sinLUT<LutBits>.values[a + 1];
+        value = low + (((high - low) * offset + (1 << SHIFT) / 2) >> SHIFT);
+    }
 
-    return sinVal * sign;
+    return (value ^ (int32_t)negate) - (int32_t)negate;
 }
 
-Fixed8 cosFP(AngleHz x)
+inline Fixed8 sinFP(AngleHz x)
 {
-    return sinFP(FP_PI_2 - x);
+    return sinFPLut<SIN_LUT_BITS>(x);
 }
 
-Fixed8 sqrtFP(Fixed8 x)
-{ 
-    if (x < 0)
-        x = -x; // Return the sqrt of the magnitude of the value
-
-    if (x == 0)
-        return 0;
-    
-    Fixed8 xn;
-    // Choose a good starting guess based on highest bit set
-           if (x & 0xFF000000) {
-        xn = x >> 12;
-    } else if (x & 0x00FF0000) {
-        xn = x >> 6;
-    } else if (x & 0x0000FF00) {
-        xn = x >> 2;
-    } else {
-        xn = x << 2;
-    }
+/**
+ * @brief sinFP() of n angles at once, for evaluating a whole strip in one loop.
+ */
+inline void sinFP_batch(const AngleHz *x, Fixed8 *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = sinFPLut<SIN_LUT_BITS>(x[i]);
+}
 
-    // If the input value is big enough it would overflow if we used the regular Newton's algorithm,
-    //  use a slightly altered version, less-accurate version to keep it within a 32-bit int
+inline Fixed8 cosFP(AngleHz x)
+{
+    return sinFP(FP_PI_2 - x);
+}
 
-    if (x & (INT32_MAX - (INT32_MAX >> 2))) 
-    {
-        // If the two highest bits are set, Newton's algorithm can overflow when adding to x
-        // Use the most conservative formula to prevent overflow
-        for (int i = 0; i < 6; i++)
-        {
-            // Newton's algorithm, taking into account the fixed point shift
-            //  6 iterations are always enough with a good starting guess
-                            //USBSerial.println(xn);
+/**
+ * @brief Seeds for 1/sqrt(m) with m in [1, 4), indexed by the top 5 bits of m in Q30.
+ *
+ * Each entry is 1 / sqrt() of its bin centre in Q30, good to about 5 bits. Only
+ * entries 8 to 31 are reachable.
+ */
+struct RsqrtSeedTable
+{
+    uint32_t values[32];
 
-            xn = (xn / FP_FIXED_VAL + x / xn) * (FP_FIXED_VAL / 2);
-        
-        }
-    } else if (x & (INT32_MAX - (INT32_MAX >> (FP_FIXED_BITS - 1))))
+    constexpr RsqrtSeedTable() : values()
     {
-        // If one of the bits in the top 7-bits is set, it can overflow when multiplying by FP_FIXED_VAL / 2
-        // Use a modified formula to prevent overflow, this one divides xn 
-        for (int i = 0; i < 6; i++)
+        for (int i = 8; i < 32; i++)
         {
-            // Newton's algorithm, taking into account the fixed point shift
-            //  6 iterations are always enough with a good starting guess
-
-
-            Fixed8 xn_2 = xn >> (FP_FIXED_BITS / 2);
-            xn = (xn_2 * xn_2 + x) / xn * (FP_FIXED_VAL / 2);
-        
+            // Newton's iteration for the root of the bin centre, carried out in doubles.
+            // 2 / (1 + m) is below 1 / sqrt(m) everywhere, so it converges from below
+            double m = (i + 0.5) / 8, y = 2 / (1 + m);
+            for (int n = 0; n < 8; n++)
+                y = y * (3 - m * y * y) / 2;
+            values[i] = y * (1u << 30);
         }
     }
-    else if (x & (INT32_MAX - (INT32_MAX >> (FP_FIXED_BITS)))) {
-        // Slightly less accurate than the main formula, but because we multiply by FP_FIXED_VAL / 2
-        // Instead of FP_FIXED_VAL, we get one extra bit before overflow
-        // Only use this if the 8-th highest bit is set
-         for (int i = 0; i < 5; i++)
-        {
-            // Newton's algorithm, taking into account the fixed point shift
-            // 6 iterations are always enough with a good starting guess
-            xn = (xn + 1) / 2 + x * (FP_FIXED_VAL / 2) / xn;
-        }
-    } else
+};
+
+constexpr RsqrtSeedTable rsqrtSeeds;
+
+/**
+ * @brief 1 / sqrt(m / 2^30) in Q30 for m / 2^30 in [1, 4), i.e. the top bit of m at 30 or 31.
+ *
+ * The seed comes from the top 5 bits of m and three Newton steps y = y (3 - m y^2) / 2
+ * refine it to the precision of Q30. Multiplies only, and always the same number of them.
+ */
+inline uint32_t rsqrtQ30(uint32_t m)
+{
+    uint32_t y = rsqrtSeeds.values[m >> 27];
+    for (int i = 0; i < 3; i++)
     {
-        // Fastest and most accurate Newton's method formula, use this when there is no chance of overflow
-        for (int i = 0; i < 5; i++)
-        {
-            // Newton's algorithm, taking into account the fixed point shift
-            // 6 iterations are always enough with a good starting guess
-            xn = (xn + x * FP_FIXED_VAL / xn + 1) / 2;
-        }
+        uint32_t y2 = ((uint64_t)y * y) >> 30;        // y^2
+        uint32_t my2 = ((uint64_t)m * y2) >> 30;      // m y^2
+        y = ((uint64_t)y * ((3u << 30) - my2)) >> 31; // y (3 - m y^2) / 2
     }
+    return y;
+}
+
+/**
+ * @brief 1 / sqrt(x), for normalizing distances without a divide.
+ *
+ * x is normalized with CLZ to m * 4^-k with m in [1, 4) and rsqrtQ30() does the rest.
+ * Returns INT32_MAX for x <= 0.
+ */
+inline Fixed8 rsqrtFP(Fixed8 x)
+{
+    if (x <= 0)
+        return INT32_MAX;
+
+    // Shift by an even amount so m = x << shift has its top bit at 30 or 31
+    uint32_t shift = __builtin_clz((uint32_t)x) & ~1;
+    uint32_t y = rsqrtQ30((uint32_t)x << shift);
 
-    return xn;
+    // 1 / sqrt(x / 2^8) = 2^4 / sqrt(x) = 2^4 * 2^(shift / 2 - 15) * y, and the result has 8
+    // fractional bits: 2^(shift / 2 - 3) * y, i.e. y in Q30 shifted right by 33 - shift / 2
+    uint32_t down = 33 - shift / 2;
+    return (Fixed8)(((uint64_t)y + (1ull << (down - 1))) >> down);
 }
+
+/**
+ * @brief Square root of the magnitude of x.
+ *
+ * sqrt(x) = x / sqrt(x), with 1 / sqrt(x) from rsqrtQ30(). The estimate is taken in
+ * sixteenths of a step and rounded with a 1/16 bias downwards, so it is never above the
+ * true root and at most half a step below it: one compare against the square rounds it to
+ * the nearest Fixed8. Constant time: no loop depends on x and nothing divides, unlike the
+ * Newton iteration it replaced, which divided on every step.
+ */
+inline Fixed8 sqrtFP(Fixed8 x)
+{
+    uint32_t magnitude = x < 0 ? -(uint32_t)x : x;
+    uint32_t shift = __builtin_clz(magnitude | 1) & ~1; // | 1: clz(0) is undefined, sqrt(0) comes out 0
+    uint32_t m = magnitude << shift;
+    uint32_t y = rsqrtQ30(m);
+
+    // sqrt(x / 2^8) * 2^8 = sqrt(x * 2^8) = sqrt(m / 2^30) * 2^(19 - shift / 2), and
+    // sqrt(m / 2^30) = m * y / 2^60, here in sixteenths
+    uint32_t sixteenths = ((uint64_t)m * y) >> (37 + shift / 2);
+    uint32_t root = (sixteenths + 7) >> 4;
+
+    // Round to nearest: (root + 1/2)^2 <= target exactly when root^2 + root < target
+    uint64_t target = (uint64_t)magnitude << FP_FIXED_BITS;
+    root += (uint64_t)root * root + root < target;
+    return root;
+}
+
+/**
+ * @brief Square root of a 64-bit value, rounded to the nearest integer.
+ *
+ * The sqrtFP() kernel on the top 32 bits: an even CLZ shift makes them a Q30 m in [1, 4),
+ * m / sqrt(m) gives the root of the shifted value, and the bits below m are taken back in
+ * with one Newton step on the exact remainder, which needs 1 / (2 root) and so y again.
+ * That leaves the root within one step of the nearest, and a compare each way settles it.
+ * The same multiplies for every value, no divides and no loops.
+ */
+inline uint32_t sqrtRounded64(uint64_t value)
+{
+    uint32_t shift = __builtin_clzll(value | 1) & ~1;
+    uint64_t normal = value << shift;
+    uint32_t m = normal >> 32;
+    uint32_t y = rsqrtQ30(m);
+
+    // sqrt(normal) = sqrt(m / 2^30) * 2^31 = m * y / 2^29, in [2^31, 2^32)
+    uint32_t root = ((uint64_t)m * y) >> 29;
+    // The root is a few steps off, so the remainder is small: add remainder / (2 root),
+    // where 1 / (2 root) = y / 2^62
+    int64_t remainder = (int64_t)(normal - (uint64_t)root * root);
+    root += (int32_t)(((remainder >> 6) * (int64_t)y) >> 56);
+
+    // Undo the shift, rounding, then one step down or up where the squares say so:
+    // root - 1/2 >= sqrt(value) exactly when root^2 - root >= value, both integers
+    uint32_t half = shift / 2;
+    uint32_t result = ((uint64_t)root + ((1u << half) >> 1)) >> half;
+    result -= (uint64_t)result * result > value + result - 1;
+    result += (uint64_t)result * result + result < value;
+    return result;
+}
+
+/**
+ * @brief sqrt(a^2 + b^2) without overflow for any pair of Fixed8 inputs.
+ *
+ * The sum of squares is formed in 64 bits, where it is a 16 fractional bit number,
+ * so its integer root is already the Fixed8 result. Saturates at INT32_MAX.
+ */
+inline Fixed8 hypotFP(Fixed8 a, Fixed8 b)
+{
+    uint64_t sumSquares = (uint64_t)((int64_t)a * a) + (uint64_t)((int64_t)b * b);
+    uint32_t root = sqrtRounded64(sumSquares);
+    return root > INT32_MAX ? INT32_MAX : root;
+}
+
+// Q8 versions of the functions above. Angles are in quarter turns, the AngleHz scale.
+inline Q8 sinFP(Q8 x) { return Q8::fromRaw(sinFP(x.raw())); }
+inline Q8 cosFP(Q8 x) { return Q8::fromRaw(cosFP(x.raw())); }
+inline Q8 sqrtFP(Q8 x) { return Q8::fromRaw(sqrtFP(x.raw())); }
+inline Q8 rsqrtFP(Q8 x) { return Q8::fromRaw(rsqrtFP(x.raw())); }
+inline Q8 hypotFP(Q8 a, Q8 b) { return Q8::fromRaw(hypotFP(a.raw(), b.raw())); }
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <Arduino.h>
+#include "LEDSPI.h"
+
+// How a frame of a LED_FlashAnimation is stored.
+//   LED_FRAME_RAW    The SPI symbols themselves: sent by the DMA straight from flash.
+//   LED_FRAME_RLE    Run-length coded symbols, decoded into RAM before sending.
+//   LED_FRAME_DELTA  Run-length coded XOR with the previous frame, decoded into RAM.
+// Runs: a control byte c < 128 is followed by c + 1 literal bytes, c >= 128 by one byte
+// repeated c - LED_RLE_REPEAT_BIAS times.
+#define LED_FRAME_RAW 0
+#define LED_FRAME_RLE 1
+#define LED_FRAME_DELTA 2
+#define LED_RLE_MAX_LITERAL 128
+#define LED_RLE_REPEAT_BIAS 125
+#define LED_RLE_MAX_REPEAT (255 - LED_RLE_REPEAT_BIAS)
+
+/// One stored frame of a LED_FlashAnimation.
+struct LED_FlashFrame
+{
+    const uint8_t *data;
+    uint32_t size;    ///< Bytes at data.
+    uint8_t encoding; ///< LED_FRAME_RAW, LED_FRAME_RLE or LED_FRAME_DELTA.
+};
+
+/**
+ * @brief A sequence of frames encoded at build time, see tools/encode_animation.cpp.
+ *
+ * Each frame decodes to frameBytes of SPI symbols, exactly what LED_SPI_CH32 sends for
+ * the same colors without dithering, so gamma, white balance and MAX_BRIGHTNESS are baked
+ * in. The first frame is never LED_FRAME_DELTA, so playback can loop and restart.
+ */
+struct LED_FlashAnimation
+{
+    uint16_t numLEDs;
+    uint16_t frameCount;
+    uint32_t frameBytes;
+    const LED_FlashFrame *frames;
+};
+
+/**
+ * @fn void LED_DecodeRLE(uint8_t *out, size_t outSize, const uint8_t *in, const uint8_t *previous)
+ * @brief Decode one LED_FRAME_RLE frame, or a LED_FRAME_DELTA frame when previous is set.
+ *
+ * @param out outSize bytes, written.
+ * @param in Runs, see LED_FRAME_RLE.
+ * @param previous Symbols of the frame before, XORed in. Must not overlap out.
+ */
+inline void LED_DecodeRLE(uint8_t *out, size_t outSize, const uint8_t *in, const uint8_t *previous)
+{
+    uint8_t *end = out + outSize;
+    while (out < end)
+    {
+        uint8_t control = *in++;
+        if (control < LED_RLE_MAX_LITERAL)
+        {
+            size_t count = control + 1;
+            if (previous)
+                for (size_t i = 0; i < count; i++)
+                    out[i] = previous[i] ^ in[i];
+            else
+                memcpy(out, in, count);
+            in += count;
+            out += count;
+            if (previous)
+                previous += count;
+            continue;
+        }
+
+        size_t count = control - LED_RLE_REPEAT_BIAS;
+        uint8_t value = *in++;
+        if (!previous)
+            memset(out, value, count);
+        else if (!value)
+            memcpy(out, previous, count); // Unchanged bytes, the common case of a delta
+        else
+            for (size_t i = 0; i < count; i++)
+                out[i] = previous[i] ^ value;
+        out += count;
+        if (previous)
+            previous += count;
+    }
+}
+
+/**
+ * @brief Plays a LED_FlashAnimation through LED_SPI_CH32::showEncoded().
+ *
+ * LED_FRAME_RAW frames cost neither RAM nor encoding: the DMA reads them from flash. Only
+ * compressed frames are decoded, into one of two frame sized RAM buffers that are only
+ * allocated when the animation has such frames. The driver must be in LED_SPI_BUFFERED
+ * mode; dithering is paused while frames play and show() goes back to drawn frames.
+ * The frames are played as encoded: on APA102 they keep LED_SPI_GLOBAL_BRIGHTNESS from
+ * the encoder's build, whatever setGlobalBrightness() is set to.
+ */
+class LED_FlashPlayer
+{
+public:
+    /**
+     * @fn LED_FlashPlayer(LED_SPI_CH32 &leds, const LED_FlashAnimation &animation)
+     * @param leds Driver to play on, with as many LEDs as the animation.
+     * @param animation Frames to play, usually const data generated into a header.
+     */
+    LED_FlashPlayer(LED_SPI_CH32 &leds, const LED_FlashAnimation &animation) : _leds(leds), _animation(animation)
+    {
+        bool compressed = false;
+        for (size_t i = 0; i < animation.frameCount; i++)
+            compressed |= animation.frames[i].encoding != LED_FRAME_RAW;
+        if (compressed && valid())
+        {
+            _buffers[0] = new uint8_t[2 * animation.frameBytes];
+            _buffers[1] = _buffers[0] + animation.frameBytes;
+        }
+    }
+
+    ~LED_FlashPlayer() { delete[] _buffers[0]; }
+
+    /**
+     * @fn bool valid()
+     * @brief Whether the animation was encoded for this driver. Nothing is played otherwise.
+     */
+    bool valid() const
+    {
+        return _animation.frameCount && _animation.numLEDs == _leds._numLEDs &&
+               _animation.frameBytes == _leds._DMABufferSize && _leds._mode == LED_SPI_BUFFERED;
+    }
+
+    /**
+     * @fn void showNextFrame()
+     * @brief Queue the next frame for the next reset gap, looping at the end.
+     *
+     * Like show(), sleeps while the previous frame waits for its reset gap. A compressed
+     * frame is decoded first, after the frame before the previous one has left the wire.
+     */
+    void showNextFrame()
+    {
+        if (!valid())
+            return;
+
+        const LED_FlashFrame &frame = _animation.frames[_next];
+        const uint8_t *symbols = frame.data;
+        if (frame.encoding != LED_FRAME_RAW)
+        {
+            // The buffer two RAM frames back is free once the last commit has been taken
+            _leds.waitForCommit();
+            uint8_t *out = _buffers[_buffer];
+            _buffer ^= 1;
+            LED_DecodeRLE(out, _animation.frameBytes, frame.data, frame.encoding == LED_FRAME_DELTA ? _shown : nullptr);
+            symbols = out;
+        }
+        _leds.showEncoded(symbols);
+        _shown = symbols;
+        _next = _next + 1 < _animation.frameCount ? _next + 1 : 0;
+    }
+
+    /// Play from the first frame on the next showNextFrame().
+    void restart() { _next = 0; }
+
+    /// Index of the frame the next showNextFrame() queues.
+    size_t nextFrame() const { return _next; }
+
+    /// RAM allocated for decoding compressed frames, 0 when every frame is sent from flash.
+    size_t ramBytes() const { return _buffers[0] ? 2 * _animation.frameBytes : 0; }
+
+private:
+    LED_SPI_CH32 &_leds;
+    const LED_FlashAnimation &_animation;
+    uint8_t *_buffers[2] = {nullptr, nullptr};
+    uint8_t _buffer = 0;
+    const uint8_t *_shown = nullptr; ///< Symbols of the last frame queued, the base of a delta.
+    size_t _next = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include "LEDSPI.h"
+
+/**
+ * @brief Paces rendering to a target frame rate, in step with the frames the strip latches.
+ *
+ * wait() sleeps frame by frame with LED_SPI_CH32::waitForFrame() until the next render
+ * slot, so drawing starts right after a frame boundary instead of at an arbitrary point
+ * in a busy-wait. When a render overruns its slot, the slots it missed are dropped
+ * rather than rendered back to back to catch up.
+ */
+class LED_SPI_FrameScheduler
+{
+public:
+    /**
+     * @fn LED_SPI_FrameScheduler(LED_SPI_CH32 &leds, uint32_t targetFPS)
+     * @param leds Driver whose frame boundaries to render on.
+     * @param targetFPS Renders per second. Capped by the refresh rate of the strip.
+     */
+    LED_SPI_FrameScheduler(LED_SPI_CH32 &leds, uint32_t targetFPS)
+        : _leds(leds), _periodUs(1000000 / (targetFPS ? targetFPS : 1)) {}
+
+    /**
+     * @fn uint32_t wait()
+     * @brief Sleep until the first frame boundary at or after the next render slot.
+     *
+     * @return Number of slots dropped because the previous render ran late.
+     */
+    uint32_t wait()
+    {
+        uint32_t now = micros();
+        if (!_started)
+        {
+            _nextUs = now;
+            _started = true;
+        }
+
+        while ((int32_t)(now - _nextUs) < 0)
+        {
+            _leds.waitForFrame();
+            now = micros();
+        }
+
+        uint32_t late = (now - _nextUs) / _periodUs;
+        _nextUs += (late + 1) * _periodUs;
+        _dropped += late;
+        return late;
+    }
+
+    /**
+     * @fn uint32_t dropped()
+     * @brief Total number of render slots dropped so far.
+     */
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    LED_SPI_CH32 &_leds;
+    uint32_t _periodUs;
+    uint32_t _nextUs = 0;
+    uint32_t _dropped = 0;
+    bool _started = false;
+};
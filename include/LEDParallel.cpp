@@ -0,0 +1,268 @@
+#pragma once
+
+#include "LEDParallel.h"
+
+LED_Parallel_Buffers LED_Parallel_CH32::allocateBuffers(size_t numLEDs, uint8_t numOutputs)
+{
+    LED_Parallel_Buffers buffers = {};
+    buffers.colors = new uint8_t[numLEDs * LED_CHANNELS](); // Zero-initialized
+    buffers.frameBytes = (numLEDs + numOutputs - 1) / numOutputs * PARALLEL_SLICES_PER_LED;
+
+    // Words, so the frames are aligned like the static ones
+    size_t words = (buffers.frameBytes + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    buffers.frontBuffer = (uint8_t *)new uint32_t[words];
+    buffers.backBuffer = (uint8_t *)new uint32_t[words];
+    return buffers;
+}
+
+LED_Parallel_CH32::LED_Parallel_CH32(size_t numLEDs, uint8_t numOutputs)
+    : LED_Parallel_CH32(numLEDs < MAX_SUPPORTED_LEDS ? numLEDs : MAX_SUPPORTED_LEDS, numOutputs,
+                        allocateBuffers(numLEDs < MAX_SUPPORTED_LEDS ? numLEDs : MAX_SUPPORTED_LEDS, clampOutputs(numOutputs)))
+{
+    _ownsBuffers = true;
+}
+
+LED_Parallel_CH32::LED_Parallel_CH32(size_t numLEDs, uint8_t numOutputs, const LED_Parallel_Buffers &buffers)
+    : _numOutputs(clampOutputs(numOutputs)),
+      _segmentLength(std::min((numLEDs + _numOutputs - 1) / _numOutputs, buffers.frameBytes / PARALLEL_SLICES_PER_LED)),
+      _numLEDs(std::min(numLEDs, _segmentLength * _numOutputs)),
+      _frameBytes(_segmentLength * PARALLEL_SLICES_PER_LED),
+      _colors(buffers.colors),
+      _frontBuffer(buffers.frontBuffer),
+      _backBuffer(buffers.backBuffer),
+      _DMASettingsSendColorData(LED_SPI_DMASettings(_frameBytes, DMA_MemoryInc_Enable, DMA_Mode_Normal)),
+      _DMASettingsSendWait(LED_SPI_DMASettings(PARALLEL_RESET_SLICES, DMA_MemoryInc_Disable, DMA_Mode_Normal))
+{
+    // Dither depth 0: the fraction bit of each entry rounds the level, as in LED_SPI_CH32
+    LED_SPI_CH32::computeColorLUT(_colorLUT, _brightness, 1, LED_SPI_DITHER_BINARY);
+
+    // Black is a pattern of symbols rather than zeros, and the DMA may start before show()
+    for (size_t position = 0; position < _segmentLength; position++)
+        encodePosition(_frontBuffer + position * PARALLEL_SLICES_PER_LED, position);
+
+    // A byte from memory to the 16-bit output register: the DMA zero-extends it, which is
+    // why the upper pins of the port go low. The port is the driver's, see the class
+    _DMASettingsSendColorData.DMA_PeripheralBaseAddr = (uintptr_t)&LED_PARALLEL_GPIO->OUTDR;
+    _DMASettingsSendColorData.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uintptr_t)_frontBuffer;
+    _DMASettingsSendWait.DMA_PeripheralBaseAddr = (uintptr_t)&LED_PARALLEL_GPIO->OUTDR;
+    _DMASettingsSendWait.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    _DMASettingsSendWait.DMA_MemoryBaseAddr = (uintptr_t)&LED_SPI_CH32::ZERO;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+    RCC_APB2PeriphClockCmd(LED_PARALLEL_GPIO_CLOCK, ENABLE);
+
+    GPIO_InitTypeDef pins = {};
+    pins.GPIO_Pin = (1u << _numOutputs) - 1;
+    pins.GPIO_Speed = GPIO_Speed_50MHz;
+    pins.GPIO_Mode = GPIO_Mode_Out_PP;
+    GPIO_Init(LED_PARALLEL_GPIO, &pins);
+
+    // One update event, and so one port write, per slice
+    TIM_TimeBaseInitTypeDef timeBase = {};
+    timeBase.TIM_Prescaler = 0;
+    timeBase.TIM_CounterMode = TIM_CounterMode_Up;
+    timeBase.TIM_Period = PARALLEL_SLICE_CYCLES - 1;
+    timeBase.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInit(TIM2, &timeBase);
+    TIM_DMACmd(TIM2, TIM_DMA_Update, ENABLE);
+
+    DMA_ITConfig(DMA1_Channel2, DMA_IT_TC, ENABLE);
+    LED_DMA_Dispatch::attach(2, dispatchDMAInterrupt, this);
+    NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+}
+
+LED_Parallel_CH32::~LED_Parallel_CH32()
+{
+    stop();
+    DMA_Cmd(DMA1_Channel2, DISABLE);
+    TIM_Cmd(TIM2, DISABLE);
+    LED_DMA_Dispatch::detach(2, this);
+
+    if (!_ownsBuffers)
+        return;
+
+    delete[] _colors;
+    delete[] (uint32_t *)_frontBuffer;
+    delete[] (uint32_t *)_backBuffer;
+}
+
+void LED_Parallel_CH32::setLED(size_t index, int r, int g, int b, int w)
+{
+    if (index >= _numLEDs)
+        return;
+
+    const int color[4] = {r, g, b, w};
+    uint8_t *wire = _colors + index * LED_CHANNELS;
+    for (size_t slot = 0; slot < LED_CHANNELS; slot++)
+    {
+        LED_Channel channel = LED_Protocol::channel(slot);
+        uint32_t level = LED_SPI_CH32::quantize(_colorLUT[channel], color[channel]);
+        wire[slot] = (level >> 16) + (level & 1);
+    }
+}
+
+void LED_Parallel_CH32::clear()
+{
+    memset(_colors, 0, _numLEDs * LED_CHANNELS);
+}
+
+void LED_Parallel_CH32::setBrightness(uint8_t brightness)
+{
+    _brightness = brightness;
+    LED_SPI_CH32::computeColorLUT(_colorLUT, _brightness, 1, LED_SPI_DITHER_BINARY);
+}
+
+inline void LED_Parallel_CH32::transpose8(const uint8_t rows[8], uint8_t planes[8])
+{
+    // Row k of the matrix is rows[7 - k], so the column bits come out in output order
+    uint32_t x = (uint32_t)rows[7] << 24 | rows[6] << 16 | rows[5] << 8 | rows[4];
+    uint32_t y = (uint32_t)rows[3] << 24 | rows[2] << 16 | rows[1] << 8 | rows[0];
+    uint32_t t;
+
+    // Swap bits, then bit pairs, then nibbles across the diagonal
+    t = (x ^ (x >> 7)) & 0x00AA00AA;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;
+    y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC;
+    y = y ^ t ^ (t << 14);
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    planes[0] = x >> 24;
+    planes[1] = x >> 16;
+    planes[2] = x >> 8;
+    planes[3] = x;
+    planes[4] = y >> 24;
+    planes[5] = y >> 16;
+    planes[6] = y >> 8;
+    planes[7] = y;
+}
+
+/// Per slice of a symbol: 0xFF where both symbols are high, and where only PARALLEL_SIGNAL_HIGH is.
+struct LED_ParallelSymbol
+{
+    uint8_t both[PARALLEL_SLICES_PER_BIT];
+    uint8_t ones[PARALLEL_SLICES_PER_BIT];
+
+    constexpr LED_ParallelSymbol() : both(), ones()
+    {
+        for (int s = 0; s < PARALLEL_SLICES_PER_BIT; s++)
+        {
+            both[s] = (PARALLEL_SIGNAL_LOW >> (PARALLEL_SLICES_PER_BIT - 1 - s)) & 1 ? 0xFF : 0;
+            ones[s] = ((PARALLEL_SIGNAL_HIGH & ~PARALLEL_SIGNAL_LOW) >> (PARALLEL_SLICES_PER_BIT - 1 - s)) & 1 ? 0xFF : 0;
+        }
+    }
+};
+
+constexpr LED_ParallelSymbol LED_PARALLEL_SYMBOL;
+
+void LED_Parallel_CH32::encodePosition(uint8_t *out, size_t position) const
+{
+    // Outputs whose segment is shorter than position stay low, like the end of a strip
+    uint8_t active = 0;
+    for (uint8_t output = 0; output < _numOutputs; output++)
+        if (output * _segmentLength + position < _numLEDs)
+            active |= 1 << output;
+
+    for (size_t slot = 0; slot < LED_CHANNELS; slot++)
+    {
+        uint8_t rows[8] = {}, planes[8];
+        for (uint8_t output = 0; output < _numOutputs; output++)
+            if (active & (1 << output))
+                rows[output] = _colors[(output * _segmentLength + position) * LED_CHANNELS + slot];
+        transpose8(rows, planes);
+
+        // Slice s of a symbol is high on every active output where both symbols are high,
+        // and only on outputs sending a 1 where just PARALLEL_SIGNAL_HIGH is
+        for (uint8_t bit = 0; bit < 8; bit++, out += PARALLEL_SLICES_PER_BIT)
+            for (int s = 0; s < PARALLEL_SLICES_PER_BIT; s++)
+                out[s] = (LED_PARALLEL_SYMBOL.both[s] & active) | (LED_PARALLEL_SYMBOL.ones[s] & planes[bit]);
+    }
+}
+
+void LED_Parallel_CH32::swapBuffers()
+{
+    uint8_t *front = _frontBuffer;
+    _frontBuffer = _backBuffer;
+    _backBuffer = front;
+    _commitPending = false;
+}
+
+void LED_Parallel_CH32::show()
+{
+    // Same wait as LED_SPI_CH32::waitForCommit(): the back buffer may still be queued
+    __disable_irq();
+    while (_commitPending)
+    {
+        __WFI();
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
+
+    for (size_t position = 0; position < _segmentLength; position++)
+        encodePosition(_backBuffer + position * PARALLEL_SLICES_PER_LED, position);
+
+    _commitPending = true;
+    if (!_start)
+        swapBuffers();
+}
+
+void LED_Parallel_CH32::send(const DMA_InitTypeDef &settings)
+{
+    DMA_InitTypeDef DMASettings = settings;
+    DMA_Cmd(DMA1_Channel2, DISABLE);
+    // As in LED_SPI_CH32::send(): clear the flags of the last transfer while the channel is
+    // off, then read the channel back so the enable has landed before the caller goes on
+    DMA_ClearFlag(DMA1_IT_GL2);
+    DMA_Init(DMA1_Channel2, &DMASettings);
+    DMA_Cmd(DMA1_Channel2, ENABLE);
+    uint32_t enabled = DMA1_Channel2->CFGR;
+    (void)enabled;
+}
+
+void LED_Parallel_CH32::start()
+{
+    _start = true;
+    _sendWait = false;
+    send(_DMASettingsSendWait);
+    TIM_Cmd(TIM2, ENABLE);
+}
+
+void LED_Parallel_CH32::stop()
+{
+    _start = false;
+}
+
+void LED_Parallel_CH32::handleDMAInterrupt()
+{
+    DMA1->INTFCR = DMA1_IT_GL2;
+    if (!_start)
+        return;
+
+    if (_sendWait)
+    {
+        _sendWait = false;
+        send(_DMASettingsSendWait);
+        _frameCount++;
+        return;
+    }
+
+    // The reset gap has just gone out, the same point LED_SPI_CH32 swaps its buffers at
+    if (_commitPending)
+        swapBuffers();
+    _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uintptr_t)_frontBuffer;
+    _sendWait = true;
+    send(_DMASettingsSendColorData);
+}
+
+void LED_Parallel_CH32::dispatchDMAInterrupt(void *context)
+{
+    ((LED_Parallel_CH32 *)context)->handleDMAInterrupt();
+}
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include "LEDSPI.h"
+#include "LEDTiming.h"
+
+#if LED_SPI_CLOCKED
+#error "LED_Parallel_CH32 drives one-wire LEDs only, clocked LEDs need a clock pin per output"
+#endif
+
+// Outputs of LED_Parallel_CH32 are pins 0..numOutputs-1 of LED_PARALLEL_GPIO. The DMA
+// writes the whole output register of that port, see the class for what that means for
+// its other pins. The outputs cannot start at a higher pin: the DMA widens each frame byte with zeros above it.
+// Pins 0..7 of GPIOA hold SPI1 SCK (PA5) and MOSI (PA7), so the default port is GPIOB,
+// and on GPIOA the outputs stop below PA5 (see maxOutputs()).
+#define LED_PARALLEL_MAX_OUTPUTS 8
+#define LED_PARALLEL_SPI1_FIRST_PIN 5
+#ifndef LED_PARALLEL_GPIO
+#define LED_PARALLEL_GPIO GPIOB
+#define LED_PARALLEL_GPIO_CLOCK RCC_APB2Periph_GPIOB
+#endif
+
+// The timer paces the port writes itself, so unlike the SPI clock their rate is not limited
+// to power of two divisions of 48MHz, and does not follow BITS_PER_SIGNAL: every LED bit is
+// PARALLEL_SLICES_PER_BIT writes at 800kHz. Three 417ns slices meet the WS2812 timing
+// (T0H 417ns, T1H 833ns). The SK6812 takes at most 750ns for T1H, so it gets four 312ns
+// slices (T0H 312ns, T1H 625ns)
+#define PARALLEL_BIT_HZ 800000
+#if LED_SPI_PROTOCOL == LED_PROTOCOL_SK6812_RGBW
+#define PARALLEL_SLICES_PER_BIT 4
+#define PARALLEL_SIGNAL_LOW 0b1000
+#define PARALLEL_SIGNAL_HIGH 0b1100
+#else
+#define PARALLEL_SLICES_PER_BIT 3
+#define PARALLEL_SIGNAL_LOW 0b100
+#define PARALLEL_SIGNAL_HIGH 0b110
+#endif
+// HCLK cycles per port write, the timer period
+#define PARALLEL_SLICE_CYCLES (LED_SPI_CYCLES_HZ / (PARALLEL_BIT_HZ * PARALLEL_SLICES_PER_BIT))
+// Port writes per frame and LED
+#define PARALLEL_SLICES_PER_LED (8 * LED_CHANNELS * PARALLEL_SLICES_PER_BIT)
+// Low port writes between frames. The timer paces them exactly, so like WAIT_BYTES they
+// make the whole reset on their own
+#define PARALLEL_RESET_SLICES ((RESET_PERIOD_US * (LED_SPI_CYCLES_HZ / 1000000) + PARALLEL_SLICE_CYCLES - 1) / PARALLEL_SLICE_CYCLES)
+
+static_assert((PARALLEL_SIGNAL_LOW & ~PARALLEL_SIGNAL_HIGH) == 0, "The 1 symbol must be high wherever the 0 symbol is");
+static_assert(LED_SPI_CYCLES_HZ % (PARALLEL_BIT_HZ * PARALLEL_SLICES_PER_BIT) == 0, "HCLK must be a multiple of the parallel slice rate");
+
+/// Pulses of the parallel symbols in ns, checked against the LED datasheet below.
+struct LED_ParallelPulses
+{
+    static constexpr double SLICE_NS = 1e9 * PARALLEL_SLICE_CYCLES / LED_SPI_CYCLES_HZ;
+    static constexpr double T0H_NS = LED_SymbolHighBits(PARALLEL_SIGNAL_LOW, PARALLEL_SLICES_PER_BIT) * SLICE_NS;
+    static constexpr double T1H_NS = LED_SymbolHighBits(PARALLEL_SIGNAL_HIGH, PARALLEL_SLICES_PER_BIT) * SLICE_NS;
+    static constexpr double T0L_NS = PARALLEL_SLICES_PER_BIT * SLICE_NS - T0H_NS;
+    static constexpr double T1L_NS = PARALLEL_SLICES_PER_BIT * SLICE_NS - T1H_NS;
+};
+
+static_assert(LED_ParallelPulses::T0H_NS >= LED_PROTOCOL_PULSES.t0hMin && LED_ParallelPulses::T0H_NS <= LED_PROTOCOL_PULSES.t0hMax &&
+                  LED_ParallelPulses::T1H_NS >= LED_PROTOCOL_PULSES.t1hMin && LED_ParallelPulses::T1H_NS <= LED_PROTOCOL_PULSES.t1hMax &&
+                  LED_ParallelPulses::T0L_NS >= LED_PROTOCOL_PULSES.t0lMin && LED_ParallelPulses::T1L_NS >= LED_PROTOCOL_PULSES.t1lMin,
+              "Parallel symbol pulses are outside the LED datasheet tolerances");
+
+/**
+ * @brief Buffers LED_Parallel_CH32 works in, see LED_Parallel_CH32::allocateBuffers().
+ *
+ * The dynamic constructor allocates them on the heap; LED_Parallel_CH32_Static hands in
+ * statically sized arrays instead.
+ */
+struct LED_Parallel_Buffers {
+    uint8_t* colors;      ///< numLEDs * LED_CHANNELS wire levels, zeroed.
+    uint8_t* frontBuffer; ///< frameBytes, word aligned.
+    uint8_t* backBuffer;  ///< Same size as frontBuffer.
+    size_t frameBytes;    ///< Size of each frame buffer.
+};
+
+/**
+ * @class LED_Parallel_CH32
+ * @brief One logical strip split into up to 8 segments that are sent at the same time.
+ *
+ * LED i of the strip is LED i % segmentLength() of output i / segmentLength(), so 300
+ * LEDs on 8 outputs refresh as fast as a 38 LED strip. TIM2 update events at
+ * PARALLEL_SLICES_PER_BIT times the 800kHz LED bit rate pace DMA1 channel 2, which copies one byte of the
+ * frame buffer to the output port per event. Its interrupt is registered through
+ * LED_DMA_Dispatch, so it does not take DMA1 channel 3 away from LED_SPI_CH32.
+ *
+ * The frame buffer is bit transposed: byte n holds slice n of every output, bit k for
+ * output k. show() builds it with one 8x8 bit matrix transpose per channel byte (see
+ * transpose8()), after which every output pin carries the bits LED_SPI_CH32 with a dither
+ * depth of 0 would send for that segment, as PARALLEL_SLICES_PER_BIT slice symbols.
+ * Temporal dithering is not supported.
+ *
+ * The driver takes the whole of LED_PARALLEL_GPIO over while it runs. Every port write is
+ * a plain OUTDR write, zero above the outputs, so any other pin of the port configured as
+ * a general purpose output is forced low at the SPI bit rate, and anything else setting
+ * pins of that port through OUTDR, BSHR or BCR is overwritten within a slice. Input and
+ * alternate function pins do not follow OUTDR and are unaffected. Per pin BSHR writes would
+ * leave the port alone, but need a 32-bit set/reset word per port write: 4x the frame
+ * buffers.
+ *
+ * Both frame buffers take segmentLength() * PARALLEL_SLICES_PER_LED bytes whatever the
+ * number of outputs, so all 8 outputs are the cheapest in RAM: 300 WS2812 take 5472 bytes of
+ * frame buffers on 8 outputs, but 43200 on one, twice the SRAM. See LED_Parallel_Layout,
+ * and LED_Parallel_CH32_Static for a driver whose buffers are checked at compile time. At
+ * 2.4MHz the DMA has 20 HCLK cycles per port write.
+ */
+class LED_Parallel_CH32
+{
+public:
+    /**
+     * @fn LED_Parallel_CH32(size_t numLEDs, uint8_t numOutputs)
+     * @brief Allocate the buffers and set up the timer, DMA channel and output pins.
+     *
+     * Leave the rest of LED_PARALLEL_GPIO to inputs and alternate functions: once started,
+     * the driver drives every general purpose output of the port. The buffers come from the
+     * heap and nothing checks them against the SRAM, LED_Parallel_Layout has their size.
+     *
+     * @param numLEDs Length of the logical strip (clamped to MAX_SUPPORTED_LEDS).
+     * @param numOutputs Number of segments and output pins (1..maxOutputs(LED_PARALLEL_GPIO)).
+     */
+    LED_Parallel_CH32(size_t numLEDs, uint8_t numOutputs);
+
+    /**
+     * @fn LED_Parallel_CH32(size_t numLEDs, uint8_t numOutputs, const LED_Parallel_Buffers& buffers)
+     * @brief Same as above, working in buffers owned by the caller (see LED_Parallel_CH32_Static).
+     *
+     * numLEDs is taken as it is, 1..MAX_SUPPORTED_LEDS. LEDs whose segments do not fit in
+     * buffers.frameBytes are dropped.
+     */
+    LED_Parallel_CH32(size_t numLEDs, uint8_t numOutputs, const LED_Parallel_Buffers& buffers);
+    ~LED_Parallel_CH32();
+
+    /**
+     * @fn void setLED(size_t index, int r, int g, int b, int w)
+     * @brief Set the color of an LED of the logical strip, w for RGBW LEDs only.
+     */
+    void setLED(size_t index, int r, int g, int b, int w = 0);
+
+    /**
+     * @fn void clear()
+     * @brief Set every LED to black.
+     */
+    void clear();
+
+    /**
+     * @fn void setBrightness(uint8_t brightness)
+     * @brief Scale colors set from now on, like LED_SPI_CH32::setBrightness().
+     */
+    void setBrightness(uint8_t brightness);
+
+    /**
+     * @fn void show()
+     * @brief Transpose the colors into the back buffer and hand it over to the DMA.
+     *
+     * Blocks while the previous frame is still waiting to be swapped in.
+     */
+    void show();
+
+    /**
+     * @fn void start()
+     * @brief Start refreshing all outputs, beginning with a reset gap.
+     */
+    void start();
+
+    /**
+     * @fn void stop()
+     * @brief Stop after the transfer in flight.
+     */
+    void stop();
+
+    size_t segmentLength() const { return _segmentLength; }
+    uint8_t numOutputs() const { return _numOutputs; }
+
+    /**
+     * @fn static uint8_t maxOutputs(const GPIO_TypeDef* port)
+     * @brief Outputs the driver may use on port: all LED_PARALLEL_MAX_OUTPUTS, except on
+     * GPIOA, where pin LED_PARALLEL_SPI1_FIRST_PIN on is left to SPI1.
+     */
+    static uint8_t maxOutputs(const GPIO_TypeDef* port)
+    {
+        return port == GPIOA ? LED_PARALLEL_SPI1_FIRST_PIN : LED_PARALLEL_MAX_OUTPUTS;
+    }
+    uint32_t frameCount() const { return _frameCount; }
+
+    /**
+     * @fn static uint8_t clampOutputs(uint8_t numOutputs)
+     * @brief numOutputs limited to 1..maxOutputs(LED_PARALLEL_GPIO), as the driver uses it.
+     */
+    static uint8_t clampOutputs(uint8_t numOutputs)
+    {
+        uint8_t most = maxOutputs(LED_PARALLEL_GPIO);
+        return numOutputs < 1 ? 1 : numOutputs > most ? most : numOutputs;
+    }
+
+    /**
+     * @fn static LED_Parallel_Buffers allocateBuffers(size_t numLEDs, uint8_t numOutputs)
+     * @brief Allocate the buffers for numLEDs on numOutputs on the heap, both already clamped.
+     */
+    static LED_Parallel_Buffers allocateBuffers(size_t numLEDs, uint8_t numOutputs);
+
+    /**
+     * @fn static void transpose8(const uint8_t rows[8], uint8_t planes[8])
+     * @brief Transpose an 8x8 bit matrix: bit k of planes[b] is bit 7 - b of rows[k].
+     *
+     * Rows are the same channel byte of 8 outputs, planes are what the port has to show
+     * for each bit of it, most significant first. Three rounds of masked swaps on two
+     * 32-bit words instead of 64 single bit moves.
+     */
+    static inline void transpose8(const uint8_t rows[8], uint8_t planes[8]);
+
+    /**
+     * @fn void encodePosition(uint8_t* out, size_t position)
+     * @brief Write the PARALLEL_SLICES_PER_LED port values of LED position on every output.
+     */
+    void encodePosition(uint8_t* out, size_t position) const;
+
+    /**
+     * @fn static void dispatchDMAInterrupt(void* context)
+     * @brief LED_DMA_Dispatch handler of DMA1 channel 2, context is the driver.
+     */
+    static void dispatchDMAInterrupt(void* context);
+
+    void handleDMAInterrupt();
+    void send(const DMA_InitTypeDef& settings);
+    void swapBuffers();
+
+    uint8_t _numOutputs;
+    size_t _segmentLength;
+    size_t _numLEDs;
+    size_t _frameBytes;
+    uint8_t* _colors;      ///< Wire level of each channel, numLEDs * LED_CHANNELS in protocol order.
+    uint8_t* _frontBuffer; ///< Transposed frame the DMA is sending.
+    uint8_t* _backBuffer;  ///< Transposed frame show() writes.
+    uint16_t _colorLUT[LED_CHANNELS][256];
+    uint8_t _brightness = 255;
+    DMA_InitTypeDef _DMASettingsSendColorData;
+    DMA_InitTypeDef _DMASettingsSendWait;
+    volatile bool _commitPending = false;
+    volatile bool _start = false;
+    volatile bool _sendWait = false;
+    volatile uint32_t _frameCount = 0;
+    bool _ownsBuffers = false; ///< Buffers came from allocateBuffers() and are freed by the destructor.
+};
+
+/**
+ * @brief Sizes of the buffers LED_Parallel_CH32 works in for one configuration, known at compile time.
+ *
+ * Same sizes as LED_Parallel_CH32::allocateBuffers().
+ */
+template <size_t NumLEDs, uint8_t NumOutputs = LED_PARALLEL_MAX_OUTPUTS>
+struct LED_Parallel_Layout
+{
+    static constexpr size_t SEGMENT_LENGTH = (NumLEDs + NumOutputs - 1) / (NumOutputs ? NumOutputs : 1);
+    static constexpr size_t FRAME_BYTES = SEGMENT_LENGTH * PARALLEL_SLICES_PER_LED;
+    static constexpr size_t FRAME_WORDS = (FRAME_BYTES + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    static constexpr size_t COLOR_BYTES = NumLEDs * LED_CHANNELS;
+    /// The driver object itself, mostly its color lookup.
+    static constexpr size_t OBJECT_BYTES = sizeof(LED_Parallel_CH32);
+    static constexpr size_t RAM_BYTES = sizeof(uint32_t) * 2 * FRAME_WORDS + COLOR_BYTES + OBJECT_BYTES;
+};
+
+/**
+ * @brief The buffers of one LED_Parallel_CH32_Static, sized by its LED_Parallel_Layout.
+ *
+ * A base class of the driver rather than members, so the arrays exist before the
+ * LED_Parallel_CH32 base is constructed on them.
+ */
+template <class Layout>
+struct LED_Parallel_StaticBuffers
+{
+    uint8_t colors[Layout::COLOR_BYTES];
+    uint32_t frames[2][Layout::FRAME_WORDS];
+
+    LED_Parallel_Buffers buffers()
+    {
+        return {colors, (uint8_t *)frames[0], (uint8_t *)frames[1], Layout::FRAME_BYTES};
+    }
+};
+
+/**
+ * @brief LED_Parallel_CH32 with its buffers sized at compile time and held in the object.
+ *
+ * Nothing is allocated on the heap, and a configuration that cannot fit in SRAM fails to
+ * compile. Declare it at namespace scope, it is too large for the stack. On GPIOA, more
+ * than maxOutputs(GPIOA) outputs leave LEDs off the end of the strip: the segments get
+ * longer than the buffers.
+ *
+ * @tparam NumLEDs Length of the logical strip (1..MAX_SUPPORTED_LEDS).
+ * @tparam NumOutputs Number of segments and output pins (1..LED_PARALLEL_MAX_OUTPUTS).
+ */
+template <size_t NumLEDs, uint8_t NumOutputs = LED_PARALLEL_MAX_OUTPUTS>
+class LED_Parallel_CH32_Static : private LED_Parallel_StaticBuffers<LED_Parallel_Layout<NumLEDs, NumOutputs>>,
+                                 public LED_Parallel_CH32
+{
+    typedef LED_Parallel_Layout<NumLEDs, NumOutputs> Layout;
+    typedef LED_Parallel_StaticBuffers<Layout> Buffers;
+
+public:
+    static constexpr size_t FRAME_BYTES = Layout::FRAME_BYTES;
+    /// The buffers and the driver object, all of the SRAM one instance takes.
+    static constexpr size_t RAM_BYTES = Layout::RAM_BYTES;
+
+    static_assert(NumLEDs > 0 && NumLEDs <= MAX_SUPPORTED_LEDS, "NumLEDs must be 1..MAX_SUPPORTED_LEDS");
+    static_assert(NumOutputs > 0 && NumOutputs <= LED_PARALLEL_MAX_OUTPUTS, "NumOutputs must be 1..LED_PARALLEL_MAX_OUTPUTS");
+    static_assert(RAM_BYTES <= CH32X035_SRAM_BYTES, "LED buffers do not fit in SRAM: use more outputs or fewer LEDs");
+
+    LED_Parallel_CH32_Static() : Buffers(), LED_Parallel_CH32(NumLEDs, NumOutputs, Buffers::buffers())
+    {
+        static_assert(sizeof(LED_Parallel_CH32_Static) <= CH32X035_SRAM_BYTES, "LED buffers do not fit in SRAM");
+    }
+};
+
+#include "LEDParallel.cpp"
@@ -1,84 +1,185 @@
 #include "LEDSPI.h"
 #include "FixedPoint.cpp"
+#ifdef LED_SPI_STATS
+#include "debug.cpp"
+#endif
 
-LED_SPI_CH32::LED_SPI_CH32(size_t numLEDs, uint8_t ditherDepth = 0)
-    : _numLEDs(numLEDs),
-      _LEDColorsSize(numLEDs * 3),
-      _DMABufferSize(numLEDs * 3 * BITS_PER_SIGNAL),
-      _numDitherBuffers(ditherDepth + 1),
-      _LEDColors(nullptr),
-      _DMABuffer(nullptr)
+LED_SPI_Buffers LED_SPI_CH32::allocateBuffers(size_t numLEDs, uint8_t ditherDepth, LED_SPI_Mode mode, size_t paletteSize)
 {
-    // Validate inputs
-    if (_numLEDs > MAX_SUPPORTED_LEDS)
+    LED_SPI_Buffers buffers = {};
+
+    if (paletteSize)
+    {
+        // One byte per LED, the colors live in the palette
+        buffers.paletteIndices = new uint8_t[numLEDs]();
+        buffers.palette = new uint32_t[paletteSize * (ditherDepth + 1) * PALETTE_ENTRY_WORDS];
+    }
+    else
+    {
+        buffers.LEDColors = new uint32_t[numLEDs * LED_CHANNELS](); // Zero-initialized
+    }
+
+    // DMA buffers are allocated as words so the bulk encoder can store whole 32-bit patterns
+    if (mode == LED_SPI_STREAMING)
+    {
+        // Only the two halves of the ring are needed, the frame is encoded as it is sent
+        buffers.streamBuffer = (uint8_t *)new uint32_t[2 * STREAM_HALF_BYTES / sizeof(uint32_t)]();
+    }
+    else
     {
-        //return; // Failed validation; allocations will remain null
+        // Zero-initialized, which also fills in the reset gaps of circular mode for good
+        size_t frameStride = LED_SPI_FrameStride(numLEDs * LED_BYTES_PER_LED, mode);
+        size_t DMABufferWords = (frameStride * (ditherDepth + 1) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+        size_t gap = mode == LED_SPI_CIRCULAR ? CIRCULAR_GAP_BYTES : 0;
+        buffers.frontBuffer = (uint8_t *)new uint32_t[DMABufferWords]() + gap;
+        buffers.backBuffer = (uint8_t *)new uint32_t[DMABufferWords]() + gap;
     }
 
-    // Allocate buffers dynamically
-    _LEDColors = new uint32_t[_LEDColorsSize]();               // Zero-initialized
-    _DMABuffer = new uint8_t[_DMABufferSize * _numDitherBuffers](); // Zero-initialized
-    ZERO = new uint8_t[1]();
+    size_t dirtyWords = (numLEDs + 31) / 32;
+    buffers.frontDirty = new uint32_t[dirtyWords];
+    buffers.backDirty = new uint32_t[dirtyWords];
+    return buffers;
+}
+
+LED_SPI_CH32::LED_SPI_CH32(size_t numLEDs, uint8_t ditherDepth, LED_SPI_Mode mode, size_t paletteSize)
+    : LED_SPI_CH32(numLEDs < MAX_SUPPORTED_LEDS ? numLEDs : MAX_SUPPORTED_LEDS, ditherDepth, mode,
+                   paletteSize < MAX_PALETTE_SIZE ? paletteSize : MAX_PALETTE_SIZE,
+                   allocateBuffers(numLEDs < MAX_SUPPORTED_LEDS ? numLEDs : MAX_SUPPORTED_LEDS, ditherDepth, mode,
+                                   paletteSize < MAX_PALETTE_SIZE ? paletteSize : MAX_PALETTE_SIZE))
+{
+    _ownsBuffers = true;
+}
+
+LED_SPI_CH32::LED_SPI_CH32(size_t numLEDs, uint8_t ditherDepth, LED_SPI_Mode mode, size_t paletteSize, const LED_SPI_Buffers &buffers)
+    : _numLEDs(numLEDs),
+      _LEDColorsSize(numLEDs * LED_CHANNELS),
+      _DMABufferSize(numLEDs * LED_BYTES_PER_LED),
+      _numDitherBuffers(ditherDepth + 1),
+      _mode(mode),
+      _frameStride(LED_SPI_FrameStride(numLEDs * LED_BYTES_PER_LED, mode)),
+      _paletteSize(paletteSize),
+      _DMASettingsSendColorData(LED_SPI_DMASettings(numLEDs * LED_BYTES_PER_LED, DMA_MemoryInc_Enable, DMA_Mode_Normal)),
+      _DMASettingsSendWait(LED_SPI_DMASettings(WAIT_BYTES, DMA_MemoryInc_Disable, DMA_Mode_Normal)),
+      _LEDColors(buffers.LEDColors),
+      _DMABuffer(buffers.frontBuffer),
+      _backBuffer(buffers.backBuffer),
+      _streamBuffer(buffers.streamBuffer),
+      _dirty{buffers.frontDirty, buffers.backDirty},
+      _frontLength(numLEDs * LED_BYTES_PER_LED),
+      _backLength(numLEDs * LED_BYTES_PER_LED),
+      _ditherError(buffers.ditherError),
+      _paletteIndices(buffers.paletteIndices),
+      _palette(buffers.palette)
+{
+    // Every LED starts out dirty in both buffers so the first commits encode the whole strip
+    size_t dirtyWords = (_numLEDs + 31) / 32;
+    for (size_t i = 0; i < dirtyWords; i++)
+        _dirty[0][i] = _dirty[1][i] = UINT32_MAX;
+
+    updateColorLUT();
+
+    // Palette entries start out black, which is a pattern of zero bits rather than zero bytes
+    for (size_t entry = 0; entry < _paletteSize; entry++)
+        encodePaletteEntry(entry, {0, 0, 0});
 
     // Initialize DMA channel3 (SPI peripheral channel) for writing to the SPI transmit buffer
-    // Initialize DMASettings here so this helper owns the DMA configuration.
-    _DMASettingsSendColorData.DMA_PeripheralBaseAddr = (uint32_t)&(SPI1->DATAR);
-    _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uint32_t)_DMABuffer;
-    _DMASettingsSendColorData.DMA_DIR = DMA_DIR_PeripheralDST;
-    _DMASettingsSendColorData.DMA_BufferSize = _DMABufferSize;
-    _DMASettingsSendColorData.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
-    _DMASettingsSendColorData.DMA_MemoryInc = DMA_MemoryInc_Enable;
-    _DMASettingsSendColorData.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
-    _DMASettingsSendColorData.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
-    _DMASettingsSendColorData.DMA_Mode = DMA_Mode_Normal;
-    _DMASettingsSendColorData.DMA_Priority = DMA_Priority_High;
-    _DMASettingsSendColorData.DMA_M2M = DMA_M2M_Disable;
-
-    _DMASettingsSendWait.DMA_PeripheralBaseAddr = (uint32_t)&(SPI1->DATAR);
-    _DMASettingsSendWait.DMA_MemoryBaseAddr = (uint32_t)ZERO;
-    _DMASettingsSendWait.DMA_DIR = DMA_DIR_PeripheralDST;
-    _DMASettingsSendWait.DMA_BufferSize = WAIT_PERIOD_COUNT;
-    _DMASettingsSendWait.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
-    _DMASettingsSendWait.DMA_MemoryInc = DMA_MemoryInc_Disable;
-    _DMASettingsSendWait.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
-    _DMASettingsSendWait.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
-    _DMASettingsSendWait.DMA_Mode = DMA_Mode_Normal;
-    _DMASettingsSendWait.DMA_Priority = DMA_Priority_High;
-    _DMASettingsSendWait.DMA_M2M = DMA_M2M_Disable;
+    // Everything but the addresses comes from the constexpr descriptors above
+    _DMASettingsSendColorData.DMA_PeripheralBaseAddr = (uintptr_t)&(SPI1->DATAR);
+    _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uintptr_t)_DMABuffer;
+
+    if (_mode == LED_SPI_STREAMING)
+    {
+        // The ring is sent over and over, the ISR refills each half after it has gone out
+        _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uintptr_t)_streamBuffer;
+        _DMASettingsSendColorData.DMA_BufferSize = 2 * STREAM_HALF_BYTES;
+        _DMASettingsSendColorData.DMA_Mode = DMA_Mode_Circular;
+    }
+    else if (_mode == LED_SPI_CIRCULAR)
+    {
+        // Each transfer is the reset gap followed by the colors, repeated by the DMA
+        _DMASettingsSendColorData.DMA_BufferSize = CIRCULAR_GAP_BYTES + _DMABufferSize;
+        _DMASettingsSendColorData.DMA_Mode = DMA_Mode_Circular;
+    }
+
+    _DMASettingsSendWait.DMA_PeripheralBaseAddr = (uintptr_t)&(SPI1->DATAR);
+    _DMASettingsSendWait.DMA_MemoryBaseAddr = (uintptr_t)&ZERO;
 
     RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
 
-    // Enable interrupts on transfer complete
-    DMA_ITConfig(_DMAChannel, DMA_IT_TC, ENABLE);
+    // Enable interrupts on transfer complete, and on half transfer to refill the first half of the ring.
+    // Circular mode only takes the interrupt when start() or show() gives it something to do
+    if (_mode != LED_SPI_CIRCULAR)
+        DMA_ITConfig(_DMAChannel, DMA_IT_TC, ENABLE);
+    if (_mode == LED_SPI_STREAMING)
+        DMA_ITConfig(_DMAChannel, DMA_IT_HT, ENABLE);
+    LED_DMA_Dispatch::attach(3, dispatchDMAInterrupt, this);
     NVIC_EnableIRQ(DMA1_Channel3_IRQn);
 
     // Initialize the SPI peripheral
-    SPI.beginTransaction(SPISettings(6000000, MSBFIRST, SPI_MODE0, SPI_TRANSMITONLY));
+    SPI.beginTransaction(SPISettings(SPI_CLOCK, MSBFIRST, SPI_MODE0, SPI_TRANSMITONLY));
 
     // Set SPI to send DMA request when transmit buffer is empty
     SPI1->CTLR2 |= SPI_CTLR2_TXDMAEN;
 
-    // Set prescaler to 8 for 6MHz SPI clock (48MHz / 8 = 6MHz)
+    // Set prescaler for SPI_CLOCK (48MHz / 8 = 6MHz for 8-bit symbols, 48MHz / 16 = 3MHz for 3 and 4,
+    // 48MHz / 4 = 12MHz for clocked LEDs)
     SPI1->CTLR1 &= ~SPI_CTLR1_BR; // Unset the Timing bits
-    SPI1->CTLR1 |= SPI_BaudRatePrescaler_8;
+    SPI1->CTLR1 |= SPI_PRESCALER;
 
     // Register this instance as the singleton for interrupt handler access
     _instance = this;
 }
 
+LED_SPI_CH32::~LED_SPI_CH32()
+{
+    stop();
+    DMA_Cmd(_DMAChannel, DISABLE);
+
+    if (_instance == this)
+        _instance = nullptr;
+    LED_DMA_Dispatch::detach(3, this);
+
+    if (!_ownsBuffers)
+        return;
+
+    size_t gap = _mode == LED_SPI_CIRCULAR ? CIRCULAR_GAP_BYTES : 0;
+    delete[] _LEDColors;
+    delete[] (uint32_t *)(_DMABuffer - gap);
+    delete[] (uint32_t *)(_backBuffer - gap);
+    delete[] (uint32_t *)_streamBuffer;
+    delete[] _ditherError;
+    delete[] _dirty[0];
+    delete[] _dirty[1];
+    delete[] _paletteIndices;
+    delete[] _palette;
+}
+
 void LED_SPI_CH32::send(DMA_InitTypeDef DMASettings)
 {
     // Initialize DMASettings here so this helper owns the DMA configuration.
 
     SPI_Cmd(SPI1, ENABLE);
     DMA_Cmd(_DMAChannel, DISABLE);
+    // Flags left over from the last transfer are cleared while the channel is off, so they
+    // cannot raise the interrupt of this one as soon as DMA_Init() enables it
+    DMA_ClearFlag(DMA1_IT_GL3);
     DMA_Init(_DMAChannel, &DMASettings);
     DMA_Cmd(_DMAChannel, ENABLE);
-    DMA_ClearFlag(DMA1_IT_GL3);
+    // Peripheral writes are buffered on their way to the bus: reading the channel back makes
+    // the core wait until the clear and the enable have landed, before the caller goes on to
+    // sleep in WFI or to look at the transfer
+    uint32_t enabled = _DMAChannel->CFGR;
+    (void)enabled;
     _isBusy = true;
+
+    // The next interrupt is due once the transfer (or half of the streaming ring) is out
+    LED_SPI_STAT(
+        uint32_t bytes = _mode == LED_SPI_STREAMING ? DMASettings.DMA_BufferSize / 2 : DMASettings.DMA_BufferSize;
+        _stats.expectedIRQ = LED_SPI_CYCLES() + bytes * LED_SPI_CYCLES_PER_BYTE;
+        _stats.expectValid = true;)
 }
 
-void LED_SPI_CH32::sendColors()
+uint8_t LED_SPI_CH32::nextDitherBuffer()
 {
     // Select the buffer to sisplay based on temporal dithering
     // The buffer selected should be the position of the highest set bit (LSB = 0)
@@ -86,12 +187,34 @@ void LED_SPI_CH32::sendColors()
     uint8_t currentBuffer = 0;
     while (_ditherCounter >> (currentBuffer + 1)) currentBuffer++;
 
-    _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uint32_t)(_DMABuffer + currentBuffer * _DMABufferSize);
-
     // Increment ditherCounter and clamp it to the range 1..(2^numBuffers-1)
     _ditherCounter++;
     if (_ditherCounter >= (1 << _numDitherBuffers)) _ditherCounter = 1;
 
+    return currentBuffer;
+}
+
+void LED_SPI_CH32::sendColors()
+{
+    // The reset gap has just gone out and no colour data is in flight, so this is the
+    // point where the buffers can be exchanged without the strip latching a mix of two
+    // frames. Swapping at the end of the gap rather than its start picks up a show()
+    // made right after the frame callback within the same gap.
+    if (_commitPending)
+        swapBuffers();
+
+    if (_frontEncoded)
+    {
+        // Pre-encoded frames have a single level, the dither sequence waits for show()
+        _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uintptr_t)_frontEncoded;
+        _DMASettingsSendColorData.DMA_BufferSize = _DMABufferSize;
+    }
+    else
+    {
+        uint8_t currentBuffer = nextDitherBuffer();
+        _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uintptr_t)(_DMABuffer + currentBuffer * _frameStride);
+        _DMASettingsSendColorData.DMA_BufferSize = _frontLength;
+    }
 
     _sendWait = true;
     send(_DMASettingsSendColorData);
@@ -101,93 +224,692 @@ void LED_SPI_CH32::sendWait()
 {
     _sendWait = false;
     send(_DMASettingsSendWait);
+    frameComplete();
 }
 
-void LED_SPI_CH32::start()
+void LED_SPI_CH32::swapBuffers()
 {
-    _start = true;
-    sendWait();
-    __NOP(); // Doesn't work without this NOP, but why????
+    // A pre-encoded frame is only a pointer: the frame buffers stay as they are for show()
+    _frontEncoded = _backEncoded;
+    if (_backEncoded)
+    {
+        _backEncoded = nullptr;
+        _commitPending = false;
+        return;
+    }
+
+    uint8_t *front = _DMABuffer;
+    _DMABuffer = _backBuffer;
+    _backBuffer = front;
+
+    // The dirty bitmaps and transfer lengths belong to the buffers, so they swap with them
+    _backDirty ^= 1;
+    _frontLength = _backLength;
+
+    _commitPending = false;
 }
 
-void LED_SPI_CH32::stop()
+void LED_SPI_CH32::frameComplete()
 {
-    _start = false;
+    _frameCount++;
+
+    LED_SPI_STAT(
+        uint32_t now = LED_SPI_CYCLES();
+        if (_stats.frames)
+            _stats.frameCycles = now - _stats.lastFrame;
+        _stats.lastFrame = now;
+        _stats.frames++;
+        // Streaming sends whatever _LEDColors holds, so every show() but the last since the
+        // previous frame started never made it to the strip whole
+        if (_stats.showsSinceFrame > 1)
+            _stats.framesOverwritten += _stats.showsSinceFrame - 1;
+        _stats.showsSinceFrame = 0;)
+
+    if (_frameCallback)
+        _frameCallback(_frameCallbackContext);
+}
+
+void LED_SPI_CH32::setFrameCallback(LED_SPI_FrameCallback callback, void *context)
+{
+    // Keep the interrupt from seeing a new callback with the old context
+    _frameCallback = nullptr;
+    _frameCallbackContext = context;
+    _frameCallback = callback;
+
+    if (_mode == LED_SPI_CIRCULAR && _start && callback)
+        _DMAChannel->CFGR |= DMA_CFGR1_TCIE;
 }
 
-void LED_SPI_CH32::setLED(size_t index, Fixed8 r, Fixed8 g, Fixed8 b)
+void LED_SPI_CH32::waitForFrame()
 {
-    if (index >= _numLEDs)
+    if (!_start)
         return;
 
-    size_t offset = index * 3;
+    uint32_t frame = _frameCount;
+    _frameWaiting = true;
+    if (_mode == LED_SPI_CIRCULAR)
+        _DMAChannel->CFGR |= DMA_CFGR1_TCIE;
 
-    size_t dmaIndex = index * 3 * BITS_PER_SIGNAL;
+    // Interrupts are masked between the check and WFI so the frame interrupt cannot slip
+    // in unnoticed and leave the core asleep. A pending interrupt still wakes WFI, and is
+    // taken as soon as they are unmasked again.
+    __disable_irq();
+    while (_frameCount == frame)
+    {
+        __WFI();
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
+    _frameWaiting = false;
+}
+
+void LED_SPI_CH32::waitForCommit()
+{
+    LED_SPI_STAT(uint32_t start = LED_SPI_CYCLES());
 
-    for (uint8_t i = 0; i < 3; i++)
+    // Masked between the check and WFI for the same reason as in waitForFrame()
+    __disable_irq();
+    while (_commitPending)
     {
-        Fixed8 colorChannel = (i == 0) ? g : (i == 1) ? r
-                                                     : b; // WS2812 uses GRB order
+        __WFI();
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
 
-        // Colors are represented in fixed point notation with the lowest COLOR_BIT_DEPTH bits representing the fractional part
-        // They are provided as an integer value from 0 to (2^COLOR_BIT_DEPTH - 1)
-        // This is considered to be a fraction from 0.0 - 1.0
-        const int FRACTION_MAX = FP_FRACTION_MASK;
-        uint32_t ditherBins = (1 << _numDitherBuffers) - 1; // 2^(numBuffers) - 1, the smallest representable fraction of an integer
+    LED_SPI_STAT(_stats.commitWaitCycles = LED_SPI_CYCLES() - start);
+}
 
-        colorChannel = CLAMP(colorChannel, 0, FRACTION_MAX);
+void LED_SPI_CH32::markDirty(size_t index)
+{
+    // Both bitmaps, whichever buffer is the back one: the interrupt may swap them at any time
+    uint32_t bit = 1u << (index % 32);
+    _dirty[0][index / 32] |= bit;
+    _dirty[1][index / 32] |= bit;
+}
 
-        // Return the integer part of the fixed point as an integral value
-        uint32_t colorInteger = colorChannel * MAX_BRIGHTNESS / FRACTION_MAX;
-        // Take the fractional part and determine which dither bin it belongs into
-        // Represented in fixed-point
-        uint32_t colorFractional = (colorChannel * MAX_BRIGHTNESS) % FRACTION_MAX * ditherBins;
-        // add 1 to the first fractional bit so that it rounds to the nearest integer when truncating, then truncate to an integer
-        colorFractional = (colorFractional + (1 << (COLOR_BIT_DEPTH - 1))) >> COLOR_BIT_DEPTH;
-        _LEDColors[offset + i] = colorInteger << 16 | colorFractional;
+void LED_SPI_CH32::storePixel(size_t index, const uint32_t wire[LED_CHANNELS])
+{
+    uint32_t *LEDColor = _LEDColors + index * LED_CHANNELS;
+    uint32_t changed = 0, lit = 0;
+    for (size_t slot = 0; slot < LED_CHANNELS; slot++)
+    {
+        changed |= LEDColor[slot] ^ wire[slot];
+        lit |= wire[slot];
+    }
+    if (!changed)
+        return;
 
-        for (size_t ditherBuffer = 0; ditherBuffer < _numDitherBuffers; ditherBuffer++)
+    for (size_t slot = 0; slot < LED_CHANNELS; slot++)
+        LEDColor[slot] = wire[slot];
+    markDirty(index);
+
+    if (lit && (int32_t)index > _lastLitLED)
+        _lastLitLED = index;
+}
+
+inline void LED_SPI_CH32::encodeDirty(size_t numLEDs, size_t numDitherBuffers, size_t bufferSize)
+{
+    LED_SPI_STAT(uint32_t start = LED_SPI_CYCLES(); _stats.encodedLEDs = 0);
+
+    // Only the LEDs that changed since this buffer was last encoded need new patterns
+    uint32_t *backDirty = _dirty[_backDirty];
+    size_t dirtyWords = (numLEDs + 31) / 32;
+    for (size_t word = 0; word < dirtyWords; word++)
+    {
+        uint32_t dirty = backDirty[word];
+        backDirty[word] = 0;
+        while (dirty)
         {
-            uint8_t colorValue = colorInteger + (colorFractional & (1 << ditherBuffer) ? 1 : 0);
+            size_t index = word * 32 + __builtin_ctz(dirty);
+            dirty &= dirty - 1;
+            if (index >= numLEDs)
+                break;
+
+            uint8_t *out = _backBuffer + index * LED_BYTES_PER_LED;
+            if (_paletteSize)
+            {
+                // The entry is already encoded for every level, consecutive in the palette
+                const uint32_t *pattern = palettePattern(_paletteIndices[index], 0);
+                for (size_t ditherBuffer = 0; ditherBuffer < numDitherBuffers; ditherBuffer++, out += bufferSize, pattern += PALETTE_ENTRY_WORDS)
+                    copyPaletteLED(out, pattern);
+            }
+            else
+            {
+                for (size_t ditherBuffer = 0; ditherBuffer < numDitherBuffers; ditherBuffer++, out += bufferSize)
+                    encodeLED(out, _LEDColors + index * LED_CHANNELS, ditherBuffer);
+            }
+            LED_SPI_STAT(_stats.encodedLEDs++);
+        }
+    }
+
+    LED_SPI_STAT(
+        _stats.encodeCycles = LED_SPI_CYCLES() - start;
+        if (_stats.encodeCycles > _stats.encodeCyclesMax) _stats.encodeCyclesMax = _stats.encodeCycles;)
+}
+
+void LED_SPI_CH32::commitBack()
+{
+    // Stop the transfer after the last LED that has ever been lit. LEDs past it have
+    // never been sent anything but black, so skipping them leaves the strip unchanged.
+    size_t activeLEDs = _numLEDs;
+    if (_trimToLit)
+        activeLEDs = _lastLitLED < 0 ? 1 : _lastLitLED + 1;
+    _backLength = activeLEDs * LED_BYTES_PER_LED;
+
+    _commitPending = true;
+    LED_SPI_STAT(_stats.commits++);
+
+    // Nothing is streaming, so there is no reset gap to wait for
+    if (!_start)
+        swapBuffers();
+    else if (_mode == LED_SPI_CIRCULAR)
+        _DMAChannel->CFGR |= DMA_CFGR1_TCIE; // Have the next transfer complete swap the buffers in
+}
+
+void LED_SPI_CH32::show()
+{
+    // Streaming encodes straight from _LEDColors, there are no frame buffers to update
+    if (_mode == LED_SPI_STREAMING)
+    {
+        LED_SPI_STAT(_stats.showsSinceFrame++);
+        return;
+    }
 
-            // Look up the WS2812 bit patterns for the high and low nibbles from the compile-time table
-            uint32_t bitPatternHigh = WS2812_LUT[(colorValue >> 4) & 0x0F];
-            uint32_t bitPatternLow = WS2812_LUT[colorValue & 0x0F];
+    waitForCommit();
+    encodeDirty(_numLEDs, _numDitherBuffers, _frameStride);
+    commitBack();
+}
 
-            // Assign the 24 bits (3 bytes) of the WS2812 bit pattern for each color channel to the DMA buffer
-            for (int i = 0; i < 4; i++)
+void LED_SPI_CH32::showEncoded(const uint8_t *frame)
+{
+    if (_mode != LED_SPI_BUFFERED)
+        return;
+
+    waitForCommit();
+    _backEncoded = frame;
+    _commitPending = true;
+    LED_SPI_STAT(_stats.commits++);
+
+    // Nothing is streaming, so there is no reset gap to wait for
+    if (!_start)
+        swapBuffers();
+}
+
+void LED_SPI_CH32::fillStreamHalf(uint8_t *half)
+{
+    size_t frameLEDs = _trimToLit ? (size_t)(_lastLitLED + 1) : _numLEDs;
+
+    // A new frame starts on a half boundary once the reset gap is long enough
+    if (_streamLED >= frameLEDs && _streamZeros >= STREAM_RESET_BYTES)
+    {
+        _streamLED = 0;
+        _streamZeros = 0;
+        _streamDither = nextDitherBuffer();
+        frameComplete();
+    }
+
+    size_t LEDs = 0;
+    if (_streamLED < frameLEDs)
+    {
+        LEDs = frameLEDs - _streamLED;
+        if (LEDs > STREAM_CHUNK_LEDS)
+            LEDs = STREAM_CHUNK_LEDS;
+
+        const uint32_t *color = _LEDColors + _streamLED * LED_CHANNELS;
+        uint8_t *out = half;
+        if (_paletteSize)
+        {
+            const uint8_t *entry = _paletteIndices + _streamLED;
+            for (size_t i = 0; i < LEDs; i++, out += LED_BYTES_PER_LED)
+                copyPaletteLED(out, palettePattern(entry[i], _streamDither));
+        }
+        else if (_ditherMode == LED_SPI_DITHER_SIGMA_DELTA)
+        {
+            uint8_t *error = _ditherError + _streamLED * LED_CHANNELS;
+            for (size_t i = 0; i < LEDs; i++, color += LED_CHANNELS, error += LED_CHANNELS, out += LED_BYTES_PER_LED)
+                encodeLEDSigmaDelta(out, color, error);
+        }
+        else
+        {
+            for (size_t i = 0; i < LEDs; i++, color += LED_CHANNELS, out += LED_BYTES_PER_LED)
+                encodeLED(out, color, _streamDither);
+        }
+        _streamLED += LEDs;
+    }
+
+    // Whatever is left of the half after the last LED starts the reset gap
+    size_t zeros = STREAM_HALF_BYTES - LEDs * LED_BYTES_PER_LED;
+    if (zeros)
+        memset(half + STREAM_HALF_BYTES - zeros, 0, zeros);
+    _streamZeros += zeros;
+}
+
+void LED_SPI_CH32::setDitherMode(LED_SPI_Dither ditherMode)
+{
+    // Sigma-delta needs each frame to be encoded as it is sent, from a color per LED
+    if (_mode != LED_SPI_STREAMING || _paletteSize)
+        return;
+
+    // The accumulators come first: once started, the HT/TC interrupt indexes them as soon
+    // as it sees the sigma-delta mode
+    if (ditherMode == LED_SPI_DITHER_SIGMA_DELTA && !_ditherError)
+        _ditherError = new uint8_t[_LEDColorsSize]();
+    __disable_irq();
+    _ditherMode = ditherMode;
+    __enable_irq();
+    updateColorLUT();
+}
+
+void LED_SPI_CH32::start()
+{
+    _start = true;
+    LED_SPI_STAT(LED_SPI_CYCLES_INIT(); resetStats());
+
+    if (_mode == LED_SPI_STREAMING)
+    {
+        // Prime both halves, from then on the HT/TC interrupts keep one half ahead of the DMA
+        _streamLED = 0;
+        _streamZeros = 0;
+        _streamUnderruns = 0;
+        _streamDither = nextDitherBuffer();
+        fillStreamHalf(_streamBuffer);
+        fillStreamHalf(_streamBuffer + STREAM_HALF_BYTES);
+        send(_DMASettingsSendColorData);
+        return;
+    }
+
+    if (_mode == LED_SPI_CIRCULAR)
+    {
+        // One DMA_Init for the lifetime of the transfer, the interrupt only moves MADDR
+        _DMASettingsSendColorData.DMA_MemoryBaseAddr = (uintptr_t)(_DMABuffer + nextDitherBuffer() * _frameStride - CIRCULAR_GAP_BYTES);
+        send(_DMASettingsSendColorData);
+        if (needsFrameInterrupt())
+            _DMAChannel->CFGR |= DMA_CFGR1_TCIE;
+        return;
+    }
+
+    // The reset gap in front of the first frame. Not through sendWait(): no frame has gone
+    // out yet, so there is no frame boundary to report. send() waits for the DMA to take the
+    // transfer, which the NOP that used to follow this stood in for
+    _sendWait = false;
+    send(_DMASettingsSendWait);
+}
+
+void LED_SPI_CH32::stop()
+{
+    _start = false;
+}
+
+void LED_SPI_CH32::setBrightness(uint8_t brightness)
+{
+    _brightness = brightness;
+    updateColorLUT();
+}
+
+void LED_SPI_CH32::setGlobalBrightness(uint8_t level)
+{
+#if LED_SPI_CLOCKED
+    _globalBrightness = level > LED_APA102::MAX_GLOBAL_BRIGHTNESS ? LED_APA102::MAX_GLOBAL_BRIGHTNESS : level;
+
+    // The level is the low bits of the first byte of every LED, in the palette and both frames
+    for (size_t entry = 0; entry < _paletteSize; entry++)
+        for (size_t ditherBuffer = 0; ditherBuffer < _numDitherBuffers; ditherBuffer++)
+            encodeHeader((uint8_t *)palettePattern(entry, ditherBuffer));
+    for (size_t index = 0; index < _numLEDs; index++)
+        markDirty(index);
+#else
+    (void)level;
+#endif
+}
+
+void LED_SPI_CH32::updateColorLUT()
+{
+    computeColorLUT(_colorLUT, _brightness, _numDitherBuffers, _ditherMode);
+}
+
+void LED_SPI_CH32::computeColorLUT(uint16_t lut[LED_CHANNELS][256], uint8_t brightness, uint8_t numDitherBuffers, LED_SPI_Dither ditherMode)
+{
+    // Output level of each entry as an exact fraction: light / 65535 * brightness / 255 * MAX_BRIGHTNESS.
+    // Split into the integer level and the dither bits here, once, instead of on every setLED().
+    // The numerator and every remainder scaled by the dither bins fit in 32 bits, so this
+    // is 32-bit divides the core does in hardware rather than 64-bit ones from libgcc
+    static_assert(65535ull * 255 * MAX_BRIGHTNESS < (1ull << 32), "The level numerator has to fit in 32 bits");
+    static_assert(65535ull * 255 * 256 < (1ull << 32), "A remainder scaled by the dither bins has to fit in 32 bits");
+    const uint32_t denominator = 65535u * 255;
+    uint32_t ditherBins = (1 << numDitherBuffers) - 1; // 2^(numBuffers) - 1, the smallest representable fraction of an integer
+    uint32_t fractionBits = numDitherBuffers > COLOR_BIT_DEPTH ? COLOR_BIT_DEPTH : numDitherBuffers;
+
+    for (size_t channel = 0; channel < LED_CHANNELS; channel++)
+    {
+        for (int value = 0; value < 256; value++)
+        {
+            uint32_t numerator = (uint32_t)LED_SPI_COLOR_TABLE.levels[channel][value] * brightness * MAX_BRIGHTNESS;
+            uint32_t colorInteger = numerator / denominator;
+            uint32_t remainder = numerator % denominator;
+            uint32_t colorFractional;
+            if (ditherMode == LED_SPI_DITHER_SIGMA_DELTA)
             {
-                _DMABuffer[dmaIndex + i + ditherBuffer * _DMABufferSize] = (bitPatternHigh >> ((3 - i) * BITS_PER_SIGNAL)) & 0xFF;
+                // Round the level to numDitherBuffers fractional bits, then store that
+                // fraction left aligned in 8 bits for the sigma-delta accumulator
+                uint32_t fraction = ((remainder << fractionBits) + denominator / 2) / denominator;
+                uint32_t scaled = (colorInteger << fractionBits) + fraction;
+                colorInteger = scaled >> fractionBits;
+                colorFractional = (scaled & ((1 << fractionBits) - 1)) << (COLOR_BIT_DEPTH - fractionBits);
             }
-            for (int i = 0; i < 4; i++)
+            else
             {
-                _DMABuffer[dmaIndex + i + 4 + ditherBuffer * _DMABufferSize] = (bitPatternLow >> ((3 - i) * BITS_PER_SIGNAL)) & 0xFF;
+                // Take the fractional part and round it to the nearest dither bin
+                colorFractional = (remainder * ditherBins + denominator / 2) / denominator;
             }
+            lut[channel][value] = colorInteger << 8 | colorFractional;
         }
-        dmaIndex += 8;
     }
 }
 
+inline uint32_t LED_SPI_CH32::quantize(const uint16_t lut[256], int colorChannel)
+{
+    uint16_t entry = lut[CLAMP(colorChannel, 0, 255)];
+    return (uint32_t)(entry >> 8) << 16 | (entry & 0xFF);
+}
+
+inline void LED_SPI_CH32::quantizePixel(uint32_t wire[LED_CHANNELS], int r, int g, int b, int w) const
+{
+    const int color[4] = {r, g, b, w};
+    for (size_t slot = 0; slot < LED_CHANNELS; slot++)
+    {
+        LED_Channel channel = LED_Protocol::channel(slot);
+        wire[slot] = quantize(_colorLUT[channel], color[channel]);
+    }
+}
+
+void LED_SPI_CH32::setLED(size_t index, int r, int g, int b, int w)
+{
+    if (index >= _numLEDs || _paletteSize)
+        return;
+
+    // Stored in the channel order of the protocol (GRB for the WS2812). Encoding is deferred to show()
+    LED_SPI_STAT(uint32_t start = LED_SPI_CYCLES());
+    uint32_t wire[LED_CHANNELS];
+    quantizePixel(wire, r, g, b, w);
+    storePixel(index, wire);
+    LED_SPI_STAT(_stats.setLEDCalls++; _stats.setLEDCycles += LED_SPI_CYCLES() - start);
+}
+
+inline uint8_t *LED_SPI_CH32::encodeChannel(uint8_t *out, uint8_t colorValue)
+{
+#if LED_SPI_CLOCKED
+    // Clocked LEDs read the byte as it is
+    *out = colorValue;
+    return out + 1;
+#elif BITS_PER_SIGNAL % 4 == 0
+    // Each channel is a whole number of words, so patterns are stored word by word
+    uint32_t *outWords = (uint32_t *)out;
+    const uint32_t *pattern = WS2812_BYTE_LUT.words[colorValue];
+    for (uint8_t w = 0; w < WS2812_WORDS_PER_BYTE; w++)
+        *outWords++ = pattern[w];
+    return (uint8_t *)outWords;
+#else
+    // 3-bit symbols make an LED 9 bytes long, so channels are not word aligned
+    uint32_t pattern = WS2812_BYTE_LUT.words[colorValue][0];
+    for (uint8_t b = 0; b < BITS_PER_SIGNAL; b++, pattern >>= 8)
+        *out++ = pattern;
+    return out;
+#endif
+}
+
+inline uint8_t *LED_SPI_CH32::encodeHeader(uint8_t *out)
+{
+#if LED_SPI_CLOCKED
+    *out++ = LED_APA102::HEADER | _globalBrightness;
+#endif
+    return out;
+}
+
+inline void LED_SPI_CH32::encodeLED(uint8_t *out, const uint32_t color[LED_CHANNELS], uint8_t ditherBuffer)
+{
+    out = encodeHeader(out);
+    for (uint8_t i = 0; i < LED_CHANNELS; i++)
+        out = encodeChannel(out, (color[i] >> 16) + ((color[i] >> ditherBuffer) & 1));
+}
+
+void LED_SPI_CH32::encodeLEDSigmaDelta(uint8_t *out, const uint32_t color[LED_CHANNELS], uint8_t error[LED_CHANNELS])
+{
+    out = encodeHeader(out);
+    for (uint8_t i = 0; i < LED_CHANNELS; i++)
+    {
+        // First order sigma-delta: the fraction is added to the error left over from the
+        // last frame and the carry out of the 8-bit accumulator becomes the extra step
+        uint32_t sum = error[i] + (color[i] & 0xFF);
+        error[i] = sum;
+        out = encodeChannel(out, (color[i] >> 16) + (sum >> 8));
+    }
+}
+
+void LED_SPI_CH32::setPixels(const RGB *pixels, size_t count, size_t start)
+{
+    if (start >= _numLEDs || _paletteSize)
+        return;
+    if (count > _numLEDs - start)
+        count = _numLEDs - start;
+
+    LED_SPI_STAT(uint32_t startCycles = LED_SPI_CYCLES());
+    uint32_t wire[LED_CHANNELS];
+    for (size_t index = start; index < start + count; index++, pixels++)
+    {
+        quantizePixel(wire, pixels->r, pixels->g, pixels->b, 0);
+        storePixel(index, wire);
+    }
+    LED_SPI_STAT(_stats.setLEDCalls += count; _stats.setLEDCycles += LED_SPI_CYCLES() - startCycles);
+}
+
+void LED_SPI_CH32::fill(size_t start, size_t count, RGB color)
+{
+    if (start >= _numLEDs || _paletteSize)
+        return;
+    if (count > _numLEDs - start)
+        count = _numLEDs - start;
+
+    LED_SPI_STAT(uint32_t startCycles = LED_SPI_CYCLES());
+    uint32_t wire[LED_CHANNELS];
+    quantizePixel(wire, color.r, color.g, color.b, 0);
+    for (size_t index = start; index < start + count; index++)
+        storePixel(index, wire);
+    LED_SPI_STAT(_stats.setLEDCalls += count; _stats.setLEDCycles += LED_SPI_CYCLES() - startCycles);
+}
+
+void LED_SPI_CH32::setPixels(const HSV *pixels, size_t count, size_t start)
+{
+    if (start >= _numLEDs || _paletteSize)
+        return;
+    if (count > _numLEDs - start)
+        count = _numLEDs - start;
+
+    LED_SPI_STAT(uint32_t startCycles = LED_SPI_CYCLES());
+    uint32_t wire[LED_CHANNELS];
+    for (size_t index = start; index < start + count; index++, pixels++)
+    {
+        RGB color = hsvToRGB(*pixels);
+        quantizePixel(wire, color.r, color.g, color.b, 0);
+        storePixel(index, wire);
+    }
+    LED_SPI_STAT(_stats.setLEDCalls += count; _stats.setLEDCycles += LED_SPI_CYCLES() - startCycles);
+}
+
 void LED_SPI_CH32::setLEDf(size_t index, float r, float g, float b) {
-    const uint16_t MAX_VAL = (1 << COLOR_BIT_DEPTH) - 1;
+    const int32_t MAX_VAL = (1 << COLOR_BIT_DEPTH) - 1;
 
-    // Clamp to range 0-1;
-    r = CLAMP(r, 0.0, 1.0);
-    g = CLAMP(g, 0.0, 1.0);
-    b = CLAMP(b, 0.0, 1.0);
-    return setLED(index, r * MAX_VAL, g * MAX_VAL, b * MAX_VAL);
+    // Clamped and scaled from the float bits: the core has no FPU
+    return setLED(index, scaleUnitFloat(r, MAX_VAL), scaleUnitFloat(g, MAX_VAL), scaleUnitFloat(b, MAX_VAL));
 }
 
 void LED_SPI_CH32::clear()
 {
-    for (uint16_t i = 0; i < _numLEDs; i++)
+    if (_paletteSize)
+    {
+        for (size_t index = 0; index < _numLEDs; index++)
+            setIndex(index, 0);
+        return;
+    }
+    fill(0, _numLEDs, {0, 0, 0});
+}
+
+inline void LED_SPI_CH32::copyPaletteLED(uint8_t *out, const uint32_t *pattern)
+{
+    if (LED_BYTES_PER_LED % 4 == 0)
+    {
+        // LEDs are a whole number of words, so every LED in the DMA buffer is word aligned
+        uint32_t *outWords = (uint32_t *)out;
+        for (uint8_t w = 0; w < PALETTE_ENTRY_WORDS; w++)
+            outWords[w] = pattern[w];
+    }
+    else
+    {
+        // 9 byte LEDs with 3-bit symbols, only every fourth one is aligned
+        memcpy(out, pattern, LED_BYTES_PER_LED);
+    }
+}
+
+void LED_SPI_CH32::encodePaletteEntry(uint8_t entry, RGB color)
+{
+    // Quantized through the color lookup like setLED(), in wire order
+    uint32_t quantized[LED_CHANNELS];
+    quantizePixel(quantized, color.r, color.g, color.b, 0);
+    for (size_t ditherBuffer = 0; ditherBuffer < _numDitherBuffers; ditherBuffer++)
+        encodeLED((uint8_t *)palettePattern(entry, ditherBuffer), quantized, ditherBuffer);
+
+    uint32_t lit = 0;
+    for (size_t slot = 0; slot < LED_CHANNELS; slot++)
+        lit |= quantized[slot];
+    uint32_t bit = 1u << (entry % 32);
+    if (lit)
+        _paletteLit[entry / 32] |= bit;
+    else
+        _paletteLit[entry / 32] &= ~bit;
+}
+
+void LED_SPI_CH32::setPaletteColor(uint8_t entry, RGB color)
+{
+    if (entry >= _paletteSize)
+        return;
+
+    encodePaletteEntry(entry, color);
+
+    // The LEDs showing this entry hold copies of the old patterns in the frame buffers
+    bool lit = _paletteLit[entry / 32] & (1u << (entry % 32));
+    for (size_t index = 0; index < _numLEDs; index++)
     {
-        setLED(i, (uint16_t)0, 0, 0);
+        if (_paletteIndices[index] != entry)
+            continue;
+        markDirty(index);
+        if (lit && (int32_t)index > _lastLitLED)
+            _lastLitLED = index;
     }
 }
 
+void LED_SPI_CH32::setIndex(size_t index, uint8_t entry)
+{
+    if (index >= _numLEDs || entry >= _paletteSize || _paletteIndices[index] == entry)
+        return;
+
+    _paletteIndices[index] = entry;
+    markDirty(index);
+    if ((_paletteLit[entry / 32] & (1u << (entry % 32))) && (int32_t)index > _lastLitLED)
+        _lastLitLED = index;
+}
+
+void LED_SPI_CH32::setIndices(const uint8_t *entries, size_t count, size_t start)
+{
+    if (start >= _numLEDs)
+        return;
+    if (count > _numLEDs - start)
+        count = _numLEDs - start;
+
+    for (size_t i = 0; i < count; i++)
+        setIndex(start + i, entries[i]);
+}
+
 void LED_SPI_CH32::handleDMAInterrupt(void)
 {
+    if (_mode == LED_SPI_STREAMING)
+    {
+        uint32_t flags = DMA1->INTFR;
+        DMA1->INTFCR = DMA1_IT_GL3;
+
+        if (!_start)
+        {
+            DMA_Cmd(_DMAChannel, DISABLE);
+            return;
+        }
+
+        // Both: this interrupt came more than a half late and the DMA has already sent one
+        // half again unrefilled. Refilling both would also overwrite the half it is reading
+        // now, so only the other one is, and the underrun is counted
+        const uint32_t bothHalves = DMA1_IT_HT3 | DMA1_IT_TC3;
+        if ((flags & bothHalves) == bothHalves)
+        {
+            _streamUnderruns++;
+            LED_SPI_STAT(_stats.expectValid = false); // The phase of the ring is lost
+            // CNTR counts down over the whole ring, above one half the DMA is in the first
+            bool inFirstHalf = _DMAChannel->CNTR > STREAM_HALF_BYTES;
+            fillStreamHalf(inFirstHalf ? _streamBuffer + STREAM_HALF_BYTES : _streamBuffer);
+            return;
+        }
+
+        // Half transfer: the DMA has moved on to the second half, refill the first.
+        // Transfer complete: it has wrapped around to the first half, refill the second.
+        LED_SPI_STAT(
+            if (!_stats.expectValid) { _stats.expectedIRQ = LED_SPI_CYCLES(); _stats.expectValid = true; }
+            _stats.expectedIRQ += STREAM_HALF_BYTES * LED_SPI_CYCLES_PER_BYTE;)
+        if (flags & DMA1_IT_HT3)
+            fillStreamHalf(_streamBuffer);
+        if (flags & DMA1_IT_TC3)
+            fillStreamHalf(_streamBuffer + STREAM_HALF_BYTES);
+        return;
+    }
+
+    if (_mode == LED_SPI_CIRCULAR)
+    {
+        DMA1->INTFCR = DMA1_IT_GL3;
+
+        if (!_start)
+        {
+            _DMAChannel->CFGR &= ~DMA_CFGR1_EN;
+            return;
+        }
+
+        // The colors have just gone out and the DMA has wrapped around to the reset gap
+        // in front of them. Restarting anywhere in a gap only makes the reset longer.
+        bool swapped = _commitPending;
+        if (swapped)
+            swapBuffers();
+
+        if (_numDitherBuffers > 1 || swapped)
+        {
+            // MADDR and CNTR can only be written while the channel is disabled
+            uint8_t *frame = _DMABuffer + nextDitherBuffer() * _frameStride - CIRCULAR_GAP_BYTES;
+            _DMAChannel->CFGR &= ~DMA_CFGR1_EN;
+            _DMAChannel->MADDR = (uintptr_t)frame;
+            _DMAChannel->CNTR = CIRCULAR_GAP_BYTES + _DMABufferSize;
+            _DMAChannel->CFGR |= DMA_CFGR1_EN;
+            LED_SPI_STAT(_stats.expectedIRQ = LED_SPI_CYCLES(); _stats.expectValid = true);
+        }
+        LED_SPI_STAT(
+            if (!_stats.expectValid) { _stats.expectedIRQ = LED_SPI_CYCLES(); _stats.expectValid = true; }
+            _stats.expectedIRQ += (CIRCULAR_GAP_BYTES + _DMABufferSize) * LED_SPI_CYCLES_PER_BYTE;)
+
+        frameComplete();
+
+        // Without dithering the DMA repeats the frame on its own until the next show()
+        if (!needsFrameInterrupt())
+        {
+            _DMAChannel->CFGR &= ~DMA_CFGR1_TCIE;
+            LED_SPI_STAT(_stats.expectValid = false); // Unknown phase when it is next enabled
+        }
+        return;
+    }
+
     // Check if this is a Transfer Complete (TC) interrupt
     if (DMA1->INTFR & DMA1_IT_TC3)
     {
@@ -225,31 +947,85 @@ bool LED_SPI_CH32::busy()
     return _isBusy;
 }
 
+#ifdef LED_SPI_STATS
+void LED_SPI_CH32::statsISREnter(uint32_t now)
+{
+    _stats.isrCount++;
+    if (!_stats.expectValid)
+        return;
+
+    // Entered early only through measurement noise, count it as no latency
+    int32_t latency = now - _stats.expectedIRQ;
+    _stats.isrLatency = latency > 0 ? latency : 0;
+    if (_stats.isrLatency > _stats.isrLatencyMax)
+        _stats.isrLatencyMax = _stats.isrLatency;
+}
+
+void LED_SPI_CH32::statsISRExit(uint32_t entry)
+{
+    _stats.isrCycles = LED_SPI_CYCLES() - entry;
+    if (_stats.isrCycles > _stats.isrCyclesMax)
+        _stats.isrCyclesMax = _stats.isrCycles;
+}
+
+void LED_SPI_CH32::dumpStats()
+{
+    // Copy first so the record is consistent even if the interrupt updates it meanwhile
+    NVIC_DisableIRQ(DMA1_Channel3_IRQn);
+    LED_SPI_Stats stats = _stats;
+    NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+    dumpBinary('S', &stats, LED_SPI_STATS_DUMP_WORDS * sizeof(uint32_t));
+}
+#endif
+
 /// Singleton instance pointer definition.
 LED_SPI_CH32 *LED_SPI_CH32::_instance = nullptr;
 
+/// Source of the reset gap zeros, shared by every instance.
+uint8_t LED_SPI_CH32::ZERO = 0;
+
+LED_DMA_Dispatch::Handler LED_DMA_Dispatch::_handlers[9] = {};
+void *LED_DMA_Dispatch::_contexts[9] = {};
+
+void LED_SPI_CH32::dispatchDMAInterrupt(void *context)
+{
+    LED_SPI_CH32 *leds = (LED_SPI_CH32 *)context;
+    LED_SPI_STAT(uint32_t entry = LED_SPI_CYCLES(); leds->statsISREnter(entry));
+    leds->handleDMAInterrupt();
+    LED_SPI_STAT(leds->statsISRExit(entry));
+}
+
 /**
- * @brief DMA1 Channel 3 interrupt handler for WS2812 DMA transfer completion.
+ * @brief DMA1 channel 2 and 3 interrupt handlers.
  *
- * Automatically restarts the DMA transfer when the previous transfer completes,
- * enabling continuous LED refresh without software intervention.
+ * Both go through LED_DMA_Dispatch, so each channel serves whichever driver instance
+ * owns it: channel 3 restarts the SPI transfers of LED_SPI_CH32, channel 2 those of
+ * LED_Parallel_CH32.
  */
 
 extern "C"
 {
+#ifdef LED_SPI_HOST
+    // Called synchronously by the simulator in host/ch32x035_sim.h
+    void DMA1_Channel2_IRQHandler(void);
+    void DMA1_Channel3_IRQHandler(void);
+#else
+    void DMA1_Channel2_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
     void DMA1_Channel3_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+#endif
+    void DMA1_Channel2_IRQHandler(void)
+    {
+        LED_DMA_Dispatch::dispatch(2);
+    }
+
     void DMA1_Channel3_IRQHandler(void)
     {
-        if (LED_SPI_CH32::getInstance())
-        {
-            LED_SPI_CH32::getInstance()->handleDMAInterrupt();
-        }
+        LED_DMA_Dispatch::dispatch(3);
     }
 }
 
 /* TODO:
 Fix IRQ
-Set up LUT to work with different singnal bit widths
 Break out processor specific settings into their own function
 Breake out LED type specific settings into their own function
 */
\ No newline at end of file
@@ -4,17 +4,352 @@
 #include <SPI.h>
 #include <cstddef>
 #include <cstdint>
+#include "Fixed.h"
+#include "Color.h"
 
 #define MAX_SUPPORTED_LEDS 300
+
+// LED protocols the driver can be built for, see the LED_Protocol policies below.
+// Select one with -D LED_SPI_PROTOCOL=LED_PROTOCOL_APA102 in build_flags.
+#define LED_PROTOCOL_WS2812 0      // GRB, one-wire
+#define LED_PROTOCOL_WS2811 1      // RGB, one-wire, WS2812 timing (800kHz mode)
+#define LED_PROTOCOL_SK6812_RGBW 2 // GRBW, one-wire, 80us reset
+#define LED_PROTOCOL_APA102 3      // APA102/SK9822, separate clock and data lines
+#ifndef LED_SPI_PROTOCOL
+#define LED_SPI_PROTOCOL LED_PROTOCOL_WS2812
+#endif
+
+#if LED_SPI_PROTOCOL == LED_PROTOCOL_APA102
+// Clocked LEDs take SPI SCK and MOSI directly: one SPI bit per data bit, no symbol
+// encoding. 12MHz (48MHz / 4), the LEDs are rated for more but long runs need the margin
+#define LED_SPI_CLOCKED 1
+#define SPI_CLOCK 12000000
+#define SPI_PRESCALER SPI_BaudRatePrescaler_4
+#else
+#define LED_SPI_CLOCKED 0
+#endif
+
+// Number of SPI bits used to send one WS2812 bit. Each color byte takes BITS_PER_SIGNAL
+// bytes of DMA buffer, so 4 and 3 shrink the buffers 2x and 2.67x compared to 8.
+// Override with -D BITS_PER_SIGNAL=4 in build_flags (3 is out of the datasheet timing, see
+// below). Not used by clocked protocols.
+#ifndef BITS_PER_SIGNAL
 #define BITS_PER_SIGNAL 8
-#define SIGNAL_LOW 0b11000000
-#define SIGNAL_HIGH 0b11111000
-#define WAIT_PERIOD_COUNT 10 // Delay to get to 50us wait time to send the reset signal. There is about 40us of overhead delay
+#endif
+
+#if LED_SPI_CLOCKED
+// Only the symbol table below needs these, and it is not used
+#define SIGNAL_LOW 0
+#define SIGNAL_HIGH 0
+#elif BITS_PER_SIGNAL == 8
+// 6MHz SPI clock (48MHz / 8), 167ns per SPI bit, 1.33us per WS2812 bit
+#define SIGNAL_LOW 0b11000000  // 333ns high
+#if LED_SPI_PROTOCOL == LED_PROTOCOL_SK6812_RGBW
+#define SIGNAL_HIGH 0b11110000 // 667ns high, the SK6812 takes at most 750ns
+#else
+#define SIGNAL_HIGH 0b11111000 // 833ns high
+#endif
+#define SPI_CLOCK 6000000
+#define SPI_PRESCALER SPI_BaudRatePrescaler_8
+#elif BITS_PER_SIGNAL == 4
+// 3MHz SPI clock (48MHz / 16), 333ns per SPI bit, 1.33us per WS2812 bit
+#define SIGNAL_LOW 0b1000  // 333ns high
+#define SIGNAL_HIGH 0b1100 // 667ns high
+#define SPI_CLOCK 3000000
+#define SPI_PRESCALER SPI_BaudRatePrescaler_16
+#elif BITS_PER_SIGNAL == 3
+// 3MHz SPI clock (48MHz / 16), 333ns per SPI bit, 1.0us per WS2812 bit.
+// The symbols only meet the datasheets between 2.1 and 2.85MHz (usually 2.4MHz), which the
+// power of two SPI prescalers cannot reach from 48MHz. At 3MHz T0L is 667ns, short of the
+// 700ns WS2812B and 750ns SK6812 minimums: most LEDs still read it, but it has to be asked for
+#ifndef LED_SPI_ALLOW_OUT_OF_SPEC
+#error "3-bit symbols are outside the LED datasheet timing at 48MHz: define LED_SPI_ALLOW_OUT_OF_SPEC to use them anyway"
+#endif
+#define SIGNAL_LOW 0b100  // 333ns high
+#define SIGNAL_HIGH 0b110 // 667ns high
+#define SPI_CLOCK 3000000
+#define SPI_PRESCALER SPI_BaudRatePrescaler_16
+#else
+#error "BITS_PER_SIGNAL must be 3, 4 or 8"
+#endif
+// Output level of a full channel at setBrightness(255); the WS2812 is very bright at 255.
+// Clocked LEDs keep all 256 color steps and are dimmed by their 5-bit hardware brightness
+// instead, see setGlobalBrightness()
+#ifndef MAX_BRIGHTNESS
+#if LED_SPI_CLOCKED
+#define MAX_BRIGHTNESS 255
+#else
 #define MAX_BRIGHTNESS 4
+#endif
+#endif
+// Hardware brightness clocked LEDs start at, 0..31. The dimmest step, in the same range as
+// MAX_BRIGHTNESS 4 on one-wire LEDs
+#ifndef LED_SPI_GLOBAL_BRIGHTNESS
+#define LED_SPI_GLOBAL_BRIGHTNESS 1
+#endif
+// Perceptual gamma applied to every channel by LED_SPI_COLOR_TABLE. 1.0 passes values
+// through linearly, as before gamma correction was added
+#ifndef LED_SPI_GAMMA
+#define LED_SPI_GAMMA 2.2
+#endif
+// White balance: the level each channel is scaled to at full input, 0..255
+#ifndef LED_SPI_WHITE_R
+#define LED_SPI_WHITE_R 255
+#endif
+#ifndef LED_SPI_WHITE_G
+#define LED_SPI_WHITE_G 255
+#endif
+#ifndef LED_SPI_WHITE_B
+#define LED_SPI_WHITE_B 255
+#endif
+#ifndef LED_SPI_WHITE_W
+#define LED_SPI_WHITE_W 255
+#endif
+#if LED_SPI_PROTOCOL == LED_PROTOCOL_SK6812_RGBW
+#define RESET_PERIOD_US 80 // Minimum low time that latches an SK6812 frame
+#else
+#define RESET_PERIOD_US 50 // Minimum low time that latches a WS2812 frame
+#endif
+// Zeros sent by the buffered modes before each frame. They make the whole reset on their
+// own: the interrupt restarting the DMA adds about 40us of low time, but nothing
+// guarantees it, so it is not counted on (see LED_SPI_BUFFERED_OVERHEAD_US)
+#define WAIT_BYTES STREAM_RESET_BYTES
 #define COLOR_BIT_DEPTH 8
 
 #define CLAMP(x, min, max) (x < min) ? min : (x > max) ? max : x
 
+// Hot path statistics, see LED_SPI_Stats. Enable with -D LED_SPI_STATS in build_flags;
+// without it the counters and every LED_SPI_STAT() statement compile out.
+#ifdef LED_SPI_STATS
+#define LED_SPI_STAT(statement) statement
+#else
+#define LED_SPI_STAT(statement)
+#endif
+
+// Time base of the statistics. SysTick counts HCLK on the CH32X035, set up by start() with
+// LED_SPI_CYCLES_INIT(); the host build counts simulated wire time plus host CPU time at the
+// same rate. A LED_SPI_CYCLES defined in build_flags has to run on its own.
+#ifndef LED_SPI_CYCLES
+#ifdef LED_SPI_HOST
+#define LED_SPI_CYCLES() LEDSim::cycles()
+#else
+#define LED_SPI_CYCLES() ((uint32_t)SysTick->CNT)
+#define LED_SPI_CYCLES_INIT() LED_SPI_StartSysTick()
+
+/**
+ * @brief Run SysTick as a free-running up-counter of HCLK for LED_SPI_CYCLES().
+ *
+ * CTLR gets STE (on) and STCLK (HCLK rather than HCLK / 8), with STRE, MODE and STIE clear:
+ * no reload at CMP, counting up, no interrupt. A SysTick that is already running, such as a
+ * millis() tick, is left as it is. The statistics then only hold if it counts HCLK up
+ * without reloading; otherwise define LED_SPI_CYCLES as another free-running counter.
+ */
+inline void LED_SPI_StartSysTick()
+{
+    const uint32_t STE = 1u << 0, STCLK = 1u << 2;
+    if (SysTick->CTLR & STE)
+        return;
+    SysTick->CNT = 0;
+    SysTick->CTLR = STCLK | STE;
+}
+#endif
+#endif
+#ifndef LED_SPI_CYCLES_INIT
+#define LED_SPI_CYCLES_INIT()
+#endif
+#ifndef LED_SPI_CYCLES_HZ
+#define LED_SPI_CYCLES_HZ 48000000
+#endif
+#define LED_SPI_CYCLES_PER_BYTE (8 * (LED_SPI_CYCLES_HZ / SPI_CLOCK))
+
+/**
+ * @brief Counters kept by LED_SPI_CH32 when built with LED_SPI_STATS.
+ *
+ * Times are in LED_SPI_CYCLES() ticks. "Last" values are overwritten on every event,
+ * "max" values hold until resetStats().
+ */
+struct LED_SPI_Stats
+{
+    uint32_t setLEDCalls;       ///< setLED()/setPixels()/fill() pixels stored.
+    uint32_t setLEDCycles;      ///< Total ticks spent storing them.
+    uint32_t commits;           ///< show() calls that committed a frame.
+    uint32_t encodedLEDs;       ///< LEDs encoded by the last commit.
+    uint32_t encodeCycles;      ///< Ticks the last commit spent encoding.
+    uint32_t encodeCyclesMax;
+    uint32_t commitWaitCycles;  ///< Ticks the last show() slept waiting for the previous commit.
+    uint32_t isrCount;
+    uint32_t isrCycles;         ///< Duration of the last DMA interrupt.
+    uint32_t isrCyclesMax;
+    uint32_t isrLatency;        ///< Ticks from the expected end of the transfer to ISR entry.
+    uint32_t isrLatencyMax;
+    uint32_t frames;            ///< Frame events, as frameCount().
+    uint32_t frameCycles;       ///< Ticks between the last two frame events: the refresh period.
+    uint32_t framesOverwritten; ///< Streaming mode: show() calls replaced before the strip started sending them.
+
+    // Bookkeeping for the measurements above, not part of the dump
+    uint32_t lastFrame;
+    uint32_t expectedIRQ;
+    uint32_t showsSinceFrame;
+    bool expectValid;
+};
+
+/// Number of leading LED_SPI_Stats fields sent by LED_SPI_CH32::dumpStats().
+#define LED_SPI_STATS_DUMP_WORDS 15
+
+/// How the driver feeds color data to the DMA.
+enum LED_SPI_Mode : uint8_t {
+    LED_SPI_BUFFERED,  ///< Whole frame pre-encoded for each dither level, double buffered.
+    LED_SPI_STREAMING, ///< Small circular ring encoded from _LEDColors by the DMA interrupts.
+    LED_SPI_CIRCULAR,  ///< Like buffered, with the reset gap in the buffer and the DMA in circular mode.
+};
+
+/// How fractional brightness is spread over frames.
+enum LED_SPI_Dither : uint8_t {
+    LED_SPI_DITHER_BINARY,      ///< One pre-encoded frame per bit, shown 1, 2, 4... times per cycle.
+    LED_SPI_DITHER_SIGMA_DELTA, ///< Per-channel error accumulator, streaming mode only.
+};
+
+/// Input channels of a color, in the order setLED() takes them.
+enum LED_Channel : uint8_t {
+    LED_R,
+    LED_G,
+    LED_B,
+    LED_W,
+};
+
+/**
+ * @brief Protocol policy for one-wire LEDs, each data bit sent as a BITS_PER_SIGNAL bit symbol.
+ *
+ * @tparam Channels Channels per LED, 3 or 4.
+ * @tparam C0 The channel sent first, then C1, C2 and C3.
+ */
+template <size_t Channels, LED_Channel C0, LED_Channel C1, LED_Channel C2, LED_Channel C3 = LED_W>
+struct LED_OneWireProtocol
+{
+    static constexpr size_t CHANNELS = Channels;
+    static constexpr bool CLOCKED = false;
+    static constexpr size_t HEADER_BYTES = 0;
+    static constexpr size_t BYTES_PER_LED = CHANNELS * BITS_PER_SIGNAL;
+
+    /// Input channel sent in position slot of each LED.
+    static constexpr LED_Channel channel(size_t slot) { return slot == 0 ? C0 : slot == 1 ? C1 : slot == 2 ? C2 : C3; }
+};
+
+typedef LED_OneWireProtocol<3, LED_G, LED_R, LED_B> LED_WS2812;
+typedef LED_OneWireProtocol<3, LED_R, LED_G, LED_B> LED_WS2811;
+typedef LED_OneWireProtocol<4, LED_G, LED_R, LED_B, LED_W> LED_SK6812_RGBW;
+
+/**
+ * @brief Protocol policy for APA102/SK9822: 32-bit LED frames on SPI clock and data.
+ *
+ * Each LED is 0b111 plus a 5-bit global brightness, then blue, green and red bytes as
+ * they are. A frame is framed by 32 zero bits in front and at least numLEDs / 2 clocks
+ * behind; both are covered by the run of zeros the driver sends between frames anyway.
+ */
+struct LED_APA102
+{
+    static constexpr size_t CHANNELS = 3;
+    static constexpr bool CLOCKED = true;
+    static constexpr size_t HEADER_BYTES = 1;
+    static constexpr size_t BYTES_PER_LED = HEADER_BYTES + CHANNELS;
+    static constexpr uint8_t HEADER = 0xE0; ///< Top 3 bits of the first byte of every LED.
+    static constexpr uint8_t MAX_GLOBAL_BRIGHTNESS = 31;
+
+    static constexpr LED_Channel channel(size_t slot) { return slot == 0 ? LED_B : slot == 1 ? LED_G : LED_R; }
+};
+
+#if LED_SPI_PROTOCOL == LED_PROTOCOL_WS2812
+typedef LED_WS2812 LED_Protocol;
+#elif LED_SPI_PROTOCOL == LED_PROTOCOL_WS2811
+typedef LED_WS2811 LED_Protocol;
+#elif LED_SPI_PROTOCOL == LED_PROTOCOL_SK6812_RGBW
+typedef LED_SK6812_RGBW LED_Protocol;
+#elif LED_SPI_PROTOCOL == LED_PROTOCOL_APA102
+typedef LED_APA102 LED_Protocol;
+#else
+#error "Unknown LED_SPI_PROTOCOL"
+#endif
+
+// Channels per LED and bytes of DMA buffer per LED of the selected protocol
+#define LED_CHANNELS (LED_Protocol::CHANNELS)
+#define LED_BYTES_PER_LED (LED_Protocol::BYTES_PER_LED)
+
+// Streaming ring geometry: two halves of STREAM_CHUNK_LEDS LEDs each
+#ifndef STREAM_CHUNK_LEDS
+#define STREAM_CHUNK_LEDS 8
+#endif
+#define STREAM_HALF_BYTES (STREAM_CHUNK_LEDS * LED_BYTES_PER_LED)
+#if LED_SPI_CLOCKED
+// Zeros between clocked frames: the 4 byte start frame of the next one, plus the end frame
+// of MAX_SUPPORTED_LEDS / 2 clocks that pushes the data through to the last LED
+#define STREAM_RESET_BYTES (4 + (MAX_SUPPORTED_LEDS + 15) / 16)
+#else
+// In streaming mode the reset gap is clocked out as zeros without any ISR overhead
+#define STREAM_RESET_BYTES ((RESET_PERIOD_US * (SPI_CLOCK / 8) + 999999) / 1000000)
+#endif
+// Circular mode sends the same gap from zeros stored in front of each frame, rounded up so
+// the colors that follow stay word aligned for the encoder
+#define CIRCULAR_GAP_BYTES ((STREAM_RESET_BYTES + 3) & ~3)
+
+// Largest palette LED_SPI_CH32 accepts, entries are addressed with a uint8_t
+#define MAX_PALETTE_SIZE 256
+// Words of SPI pattern stored per palette entry and dither level: one LED, padded to a word
+#define PALETTE_ENTRY_WORDS ((LED_BYTES_PER_LED + 3) / 4)
+
+/**
+ * @brief Distance in bytes between the frames of two dither levels in the DMA buffers.
+ *
+ * In LED_SPI_CIRCULAR mode every frame is preceded by CIRCULAR_GAP_BYTES of zeros and
+ * padded to a whole word.
+ */
+constexpr size_t LED_SPI_FrameStride(size_t frameBytes, LED_SPI_Mode mode)
+{
+    return mode == LED_SPI_CIRCULAR ? CIRCULAR_GAP_BYTES + ((frameBytes + 3) & ~(size_t)3) : frameBytes;
+}
+
+/// Called from the DMA interrupt each time a frame has been clocked out and the reset gap starts.
+typedef void (*LED_SPI_FrameCallback)(void *context);
+
+/**
+ * @brief Buffers the driver works in, see LED_SPI_CH32::allocateBuffers() for the sizes.
+ *
+ * The dynamic constructor allocates them on the heap; LED_SPI_CH32_Static hands in
+ * statically sized arrays instead. Buffers a mode does not use are nullptr.
+ */
+struct LED_SPI_Buffers {
+    uint32_t* LEDColors;     ///< numLEDs * LED_CHANNELS quantized channels, nullptr in palette mode.
+    uint8_t* frontBuffer;    ///< LED_SPI_FrameStride() bytes per dither level, circular mode points past the first gap.
+    uint8_t* backBuffer;     ///< Same size as frontBuffer.
+    uint8_t* streamBuffer;   ///< Streaming mode: 2 * STREAM_HALF_BYTES.
+    uint32_t* frontDirty;    ///< (numLEDs + 31) / 32 words.
+    uint32_t* backDirty;     ///< (numLEDs + 31) / 32 words.
+    uint8_t* ditherError;    ///< numLEDs * LED_CHANNELS, or nullptr to allocate on setDitherMode().
+    uint8_t* paletteIndices; ///< Palette mode: numLEDs entries.
+    uint32_t* palette;       ///< Palette mode: paletteSize * (ditherDepth + 1) * PALETTE_ENTRY_WORDS.
+};
+
+/**
+ * @brief DMA descriptor for sending bytes to SPI1, with the addresses left to be filled in.
+ *
+ * @param bufferSize Number of bytes per transfer.
+ * @param memoryInc DMA_MemoryInc_Enable to walk a buffer, DMA_MemoryInc_Disable to repeat one byte.
+ * @param mode DMA_Mode_Normal or DMA_Mode_Circular.
+ */
+constexpr DMA_InitTypeDef LED_SPI_DMASettings(uint32_t bufferSize, uint32_t memoryInc, uint32_t mode)
+{
+    DMA_InitTypeDef settings = {};
+    settings.DMA_DIR = DMA_DIR_PeripheralDST;
+    settings.DMA_BufferSize = bufferSize;
+    settings.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    settings.DMA_MemoryInc = memoryInc;
+    settings.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    settings.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    settings.DMA_Mode = mode;
+    settings.DMA_Priority = DMA_Priority_High;
+    settings.DMA_M2M = DMA_M2M_Disable;
+    return settings;
+}
+
 struct LED_SPI_Settings {
     uint16_t numLEDs;
     uint16_t ditherDepth;
@@ -24,23 +359,86 @@ struct LED_SPI_Settings {
 
 };
 
+/**
+ * @brief DMA1 interrupt dispatch table.
+ *
+ * The driver that owns a DMA channel attaches a handler to it, and the IRQ handler of the
+ * channel calls whatever is attached. This lets several drivers run at once, each on its
+ * own channel (LED_SPI_CH32 on channel 3, LED_Parallel_CH32 on channel 2). Channels are
+ * numbered 1..8 like DMA1_ChannelN.
+ */
+struct LED_DMA_Dispatch
+{
+    typedef void (*Handler)(void* context);
+
+    static void attach(uint8_t channel, Handler handler, void* context)
+    {
+        _handlers[channel] = handler;
+        _contexts[channel] = context;
+    }
+
+    /// Detach only if context still owns the channel, a newer driver on it stays attached.
+    static void detach(uint8_t channel, void* context)
+    {
+        if (_contexts[channel] == context)
+            _handlers[channel] = nullptr;
+    }
+
+    static inline void dispatch(uint8_t channel)
+    {
+        if (_handlers[channel])
+            _handlers[channel](_contexts[channel]);
+    }
+
+    static Handler _handlers[9];
+    static void* _contexts[9];
+};
+
 /**
  * @class LED_SPI_CH32
  * @brief WS2812 LED driver using SPI + DMA on CH32X035.
  *
  * Controls addressable RGB LEDs (WS2812/NeoPixel) via SPI with DMA transfers.
- * Buffers are dynamically allocated based on the number of LEDs.
+ * Buffers are dynamically allocated based on the number of LEDs. The LED type is chosen
+ * at build time with LED_SPI_PROTOCOL, see LED_Protocol.
  */
 class LED_SPI_CH32
 {
 public:
     /**
-     * @fn LED_SPI_CH32(size_t numLEDs)
+     * @fn LED_SPI_CH32(size_t numLEDs, uint8_t ditherDepth, LED_SPI_Mode mode, size_t paletteSize)
      * @brief Construct an LED controller and allocate buffers for the given number of LEDs.
      *
-     * @param numLEDs Number of addressable LEDs to control (must be <= MAX_SUPPORTED_LEDS).
+     * In LED_SPI_STREAMING mode the DMA runs a 2 x STREAM_CHUNK_LEDS ring in circular mode
+     * and the half transfer/transfer complete interrupts encode the next chunk from
+     * _LEDColors just in time. DMA RAM no longer grows with the LED count or the dither
+     * depth. Changes made with setLED() show up from the next chunk, so a frame drawn
+     * while it is being sent can tear; show() is not needed.
+     *
+     * In LED_SPI_CIRCULAR mode each dither level is stored as [reset zeros][colors] and
+     * the DMA sends it in circular mode, so the strip refreshes without any CPU work. The
+     * transfer complete interrupt is only enabled while there is something to do: rotating
+     * dither levels, or swapping in a frame after show(). It then only rewrites MADDR and
+     * CNTR. setTrimToLit() has no effect in this mode.
+     *
+     * With a paletteSize, each LED stores a one byte index into a palette instead of its
+     * color (1 byte of RAM per LED instead of 12), see setPaletteColor() and setIndex().
+     * Every entry keeps its SPI patterns for all dither levels already encoded, so show()
+     * and the streaming interrupt only copy words. setLED(), setPixels() and fill() have
+     * no effect in palette mode and dithering is always binary.
+     *
+     * @param numLEDs Number of addressable LEDs to control (clamped to MAX_SUPPORTED_LEDS).
+     * @param ditherDepth Number of extra temporal dither levels.
+     * @param mode Buffered (default), streaming or circular.
+     * @param paletteSize Number of palette entries (up to MAX_PALETTE_SIZE), 0 for direct color.
+     */
+    explicit LED_SPI_CH32(size_t numLEDs, uint8_t ditherDepth = 0, LED_SPI_Mode mode = LED_SPI_BUFFERED, size_t paletteSize = 0);
+
+    /**
+     * @fn ~LED_SPI_CH32()
+     * @brief Stop the DMA channel and release the buffers if they were allocated here.
      */
-    explicit LED_SPI_CH32(size_t numLEDs, uint8_t ditherDepth = 0);
+    ~LED_SPI_CH32();
 
     /**
      * @fn void start()
@@ -58,17 +456,82 @@ public:
      * @fn void setLED(uint16_t index, uint8_t r, uint8_t g, uint8_t b)
      * @brief Set the color of an LED.
      *
+     * Only the logical color is stored and the LED is marked dirty if it changed. The
+     * SPI patterns are encoded by show().
+     *
+     * Values go through the gamma, white balance and brightness of the color lookup, see
+     * setBrightness().
+     *
      * @param index LED index (0 to numLEDs-1).
      * @param r Red component (0..255).
      * @param g Green component (0..255).
      * @param b Blue component (0..255).
      */
-    void setLED(size_t index, int r, int g, int b);
+    void setLED(size_t index, int r, int g, int b) { setLED(index, r, g, b, 0); }
 
-        /**
-     * @fn void setLED(uint16_t index, float r, float g, float b)
+    /**
+     * @fn void setLED(size_t index, int r, int g, int b, int w)
+     * @brief Set the color of an LED including the white channel of RGBW LEDs.
+     *
+     * w is ignored by 3 channel protocols; the 3 channel versions set it to 0.
+     */
+    void setLED(size_t index, int r, int g, int b, int w);
+
+    /**
+     * @fn void setLED(size_t index, Q8 r, Q8 g, Q8 b)
+     * @brief Set the color of an LED from fixed point channels, 0 (off) to 255/256 (max brightness).
+     *
+     * Same scale as the integer version: the raw Q8 value is the 0..255 channel value.
+     */
+    void setLED(size_t index, Q8 r, Q8 g, Q8 b) { setLED(index, r.raw(), g.raw(), b.raw()); }
+
+    /**
+     * @fn void setPixels(const RGB* pixels, size_t count, size_t start)
+     * @brief Set a run of LEDs from an array of colors.
+     *
+     * Equivalent to calling setLED() for each LED.
+     *
+     * @param pixels Colors to write, pixels[0] goes to LED start.
+     * @param count Number of LEDs to write. Clipped to the end of the strip.
+     * @param start Index of the first LED to write.
+     */
+    void setPixels(const RGB* pixels, size_t count, size_t start = 0);
+
+    /**
+     * @fn void fill(size_t start, size_t count, RGB color)
+     * @brief Set a run of LEDs to one color. The color is only quantized once.
+     *
+     * @param start Index of the first LED to write.
+     * @param count Number of LEDs to write. Clipped to the end of the strip.
+     * @param color Color to write.
+     */
+    void fill(size_t start, size_t count, RGB color);
+
+    /**
+     * @fn void setLED(size_t index, HSV color)
+     * @brief Set the color of an LED from hue, saturation and value, see hsvToRGB().
+     */
+    void setLED(size_t index, HSV color) { setPixels(&color, 1, index); }
+
+    /**
+     * @fn void setPixels(const HSV* pixels, size_t count, size_t start)
+     * @brief Set a run of LEDs from an array of HSV colors.
+     *
+     * Each color goes through hsvToRGB() and straight into the encoder input, with no RGB
+     * array in between. Integer only, like the rest of the color path.
+     *
+     * @param pixels Colors to write, pixels[0] goes to LED start.
+     * @param count Number of LEDs to write. Clipped to the end of the strip.
+     * @param start Index of the first LED to write.
+     */
+    void setPixels(const HSV* pixels, size_t count, size_t start = 0);
+
+    /**
+     * @fn void setLEDf(size_t index, float r, float g, float b)
      * @brief Set the color of an LED to an RGB value. Values are reprsented from 0 (off) to 1.0 (max brightness)
      *
+     * The floats are converted with scaleUnitFloat(), which only uses integer instructions.
+     *
      * @param index LED index (0 to numLEDs-1).
      * @param r Red component (0.0 .. 1.0).
      * @param g Green component (0.0 .. 1.0).
@@ -78,12 +541,193 @@ public:
 
     /**
      * @fn void clear()
-     * @brief Clear all LED colors to black (0, 0, 0).
+     * @brief Clear all LED colors to black (0, 0, 0). In palette mode, set every LED to entry 0.
      */
     void clear();
 
+    /**
+     * @fn void setPaletteColor(uint8_t entry, RGB color)
+     * @brief Set the color of a palette entry. Palette mode only.
+     *
+     * Only this entry is quantized and encoded, once per dither level. LEDs showing it are
+     * marked dirty and pick up the new color at the next show(), which makes palette
+     * animation cheap. Entries start out black.
+     */
+    void setPaletteColor(uint8_t entry, RGB color);
+
+    /**
+     * @fn void setIndex(size_t index, uint8_t entry)
+     * @brief Show palette entry entry on LED index. Palette mode only.
+     *
+     * Entries past the palette size are ignored.
+     */
+    void setIndex(size_t index, uint8_t entry);
+
+    /**
+     * @fn void setIndices(const uint8_t* entries, size_t count, size_t start)
+     * @brief Set a run of LEDs from an array of palette entries, like setIndex() for each.
+     */
+    void setIndices(const uint8_t* entries, size_t count, size_t start = 0);
+
+    /**
+     * @fn void show()
+     * @brief Hand the frame drawn with setLED() over to the DMA.
+     *
+     * Encodes the LEDs that changed since the back buffer was last committed into it,
+     * then marks it for commit. The interrupt handler swaps the front and back buffers
+     * at the next reset gap, so a frame is only ever latched whole. Each buffer keeps its
+     * own dirty bitmap, so no data is copied between them.
+     *
+     * Sleeps while the previous show() is still waiting for its reset gap.
+     */
+    void show();
+
+    /**
+     * @fn void showEncoded(const uint8_t* frame)
+     * @brief Send a frame that is already encoded, straight from where it is stored.
+     *
+     * frame holds _DMABufferSize bytes of SPI symbols, as this driver encodes them without
+     * dithering (see LED_FlashAnimation). The DMA reads it in place, so it can be const data
+     * in flash and costs no RAM. It is swapped in at the next reset gap like a show() and
+     * sent every frame until the next show() or showEncoded(). The frame buffers are not
+     * touched, so a later show() carries on from the colors last set with setLED().
+     * APA102 frames hold the hardware brightness they were encoded with in every LED, so
+     * setGlobalBrightness() has no effect on them.
+     *
+     * Sleeps while the previous commit is still waiting for its reset gap. LED_SPI_BUFFERED
+     * mode only, ignored in the other modes.
+     */
+    void showEncoded(const uint8_t* frame);
+
+    /**
+     * @fn void setDitherMode(LED_SPI_Dither ditherMode)
+     * @brief Choose how fractional brightness is dithered. Call before setting any LEDs.
+     *
+     * LED_SPI_DITHER_SIGMA_DELTA keeps an 8-bit error accumulator per channel and adds
+     * the fraction to it every frame, sending one extra step whenever it carries. The
+     * extra steps are spread evenly instead of in binary weighted runs, and the number of
+     * levels is 2^(ditherDepth + 1) with no extra frame buffers: only 3 bytes of RAM per
+     * LED. Only available in LED_SPI_STREAMING mode; ignored otherwise. May be called
+     * after start(): the next half the interrupt encodes uses the new mode.
+     */
+    void setDitherMode(LED_SPI_Dither ditherMode);
+
+    /**
+     * @fn void setBrightness(uint8_t brightness)
+     * @brief Scale every channel at run time, 255 being MAX_BRIGHTNESS.
+     *
+     * Rebuilds the per-channel lookup from 0..255 input to output level and dither bits,
+     * which folds LED_SPI_GAMMA, the LED_SPI_WHITE_R/G/B balance and the brightness into
+     * a single table read per channel. Applies to colors set from then on; redraw the
+     * frame (or set the palette colors again) to dim what is already shown.
+     */
+    void setBrightness(uint8_t brightness);
+
+    uint8_t brightness() const { return _brightness; }
+
+    /**
+     * @fn void setGlobalBrightness(uint8_t level)
+     * @brief Set the 5-bit hardware brightness sent with every LED, APA102/SK9822 only.
+     *
+     * The LEDs scale their output by level / 31 on top of the color, so dimming this way
+     * keeps all 256 color steps where setBrightness() and MAX_BRIGHTNESS give up most of
+     * them. Every LED is re-sent with the new level from the next show(). Ignored by
+     * one-wire protocols, and by frames sent with showEncoded(), which keep the level
+     * they were encoded with.
+     *
+     * @param level 0 (off) to 31 (full), LED_SPI_GLOBAL_BRIGHTNESS until set.
+     */
+    void setGlobalBrightness(uint8_t level);
+
+    /**
+     * @fn void setTrimToLit(bool enable)
+     * @brief End each transfer at the last LED that has ever been lit.
+     *
+     * When only the start of a long strip is in use, the frames get shorter and refresh
+     * faster. LEDs past the last lit one are never sent anything, so they stay dark.
+     * Takes effect at the next show().
+     */
+    void setTrimToLit(bool enable) { _trimToLit = enable; }
+
+    /**
+     * @fn bool commitPending()
+     * @brief Check whether the last show() is still waiting for the reset gap.
+     *
+     * Drawing with setLED() is always safe. show() will block until this returns false.
+     */
+    bool commitPending() { return _commitPending; }
+
+    /**
+     * @fn void setFrameCallback(LED_SPI_FrameCallback callback, void *context)
+     * @brief Register a function to call from the DMA interrupt at every frame boundary.
+     *
+     * The callback runs when the colors of a frame have gone out and the reset gap that
+     * latches them begins. A show() that finishes before the gap ends is sent as the very
+     * next frame (in LED_SPI_CIRCULAR mode, the one after). It first runs after the first
+     * frame, never for the reset start() begins with. Keep it short, it runs in interrupt
+     * context. Pass nullptr to remove it.
+     *
+     * LED_SPI_STREAMING has no buffer to swap: each frame is encoded from the colors half
+     * a ring ahead of the wire. There the callback runs once the reset gap is queued, just
+     * before the first LEDs of the next frame are encoded, so colors set in the callback
+     * are all in that frame, while colors set after it returns miss its first
+     * STREAM_CHUNK_LEDS LEDs.
+     */
+    void setFrameCallback(LED_SPI_FrameCallback callback, void *context = nullptr);
+
+    /**
+     * @fn uint32_t frameCount()
+     * @brief Number of frames clocked out since start().
+     *
+     * In LED_SPI_CIRCULAR mode without dithering the transfer runs without interrupts,
+     * so frames are only counted while a callback is set or waitForFrame() is waiting.
+     */
+    uint32_t frameCount() const { return _frameCount; }
+
+    /**
+     * @fn uint32_t streamUnderruns()
+     * @brief LED_SPI_STREAMING interrupts that came too late, since start().
+     *
+     * An interrupt held off for longer than a ring half finds both halves sent. The DMA has
+     * then already sent a stale half again, and the frame on the strip is corrupt. Each
+     * such interrupt counts once; a non-zero count means the other interrupts, or
+     * sections with interrupts masked, take too long for STREAM_CHUNK_LEDS.
+     */
+    uint32_t streamUnderruns() const { return _streamUnderruns; }
+
+    /**
+     * @fn void waitForFrame()
+     * @brief Sleep with WFI until the next frame boundary.
+     *
+     * Drawing and calling show() right after this returns gives the new frame the most
+     * time before the next swap, and renders once per transmitted frame. Returns
+     * immediately if the driver is not started. In LED_SPI_STREAMING mode the frame that
+     * has just begun already holds its first STREAM_CHUNK_LEDS LEDs, see setFrameCallback().
+     */
+    void waitForFrame();
+
     void handleDMAInterrupt(void);
 
+#ifdef LED_SPI_STATS
+    /**
+     * @fn const LED_SPI_Stats& stats()
+     * @brief Counters collected since start() or the last resetStats().
+     */
+    const LED_SPI_Stats& stats() const { return _stats; }
+
+    void resetStats() { _stats = LED_SPI_Stats(); }
+
+    /**
+     * @fn void dumpStats()
+     * @brief Send the counters over USBSerial as one binary record, see dumpBinary().
+     */
+    void dumpStats();
+
+    /// Timestamp of the current interrupt's entry, taken by DMA1_Channel3_IRQHandler.
+    void statsISREnter(uint32_t now);
+    void statsISRExit(uint32_t entry);
+#endif
+
     /**
      * @fn static LED_SPI_CH32* getInstance()
      * @brief Get the singleton instance for interrupt handler access.
@@ -91,6 +735,12 @@ public:
      * @return Pointer to the singleton instance.
      */
     static LED_SPI_CH32* getInstance() { return _instance; }
+
+    /**
+     * @fn static void dispatchDMAInterrupt(void* context)
+     * @brief LED_DMA_Dispatch handler of DMA1 channel 3, context is the driver.
+     */
+    static void dispatchDMAInterrupt(void* context);
     
     bool busy();
 
@@ -99,23 +749,88 @@ public:
     const size_t _LEDColorsSize;
     const size_t _DMABufferSize;
     const size_t _numDitherBuffers;
+    const LED_SPI_Mode _mode;
+    const size_t _frameStride; ///< Bytes from one dither level to the next in _DMABuffer.
+    const size_t _paletteSize; ///< Palette entries, 0 when each LED stores its own color.
 
     DMA_Channel_TypeDef* _DMAChannel = DMA1_Channel3;
     SPI_TypeDef* _SPI = SPI1;
     DMA_InitTypeDef _DMASettingsSendColorData;
     DMA_InitTypeDef _DMASettingsSendWait;
 
-    uint32_t* _LEDColors;     ///< Dynamically allocated RGB color buffer.
-    uint8_t* _DMABuffer;     ///< Dynamically allocated DMA/SPI bit pattern buffer.
-    uint8_t* ZERO;
+    uint32_t* _LEDColors;     ///< RGB color buffer.
+    uint8_t* volatile _DMABuffer;   ///< DMA/SPI bit pattern buffer being transmitted.
+    uint8_t* volatile _backBuffer;  ///< Buffer show() encodes into, swapped with _DMABuffer on commit.
+    uint8_t* _streamBuffer;         ///< Two STREAM_HALF_BYTES halves used in streaming mode.
+    static uint8_t ZERO;
+    bool _ownsBuffers = false;      ///< Buffers came from allocateBuffers() and are freed by the destructor.
+    /// LEDs whose patterns are stale in each frame buffer, one bit per LED. markDirty() sets
+    /// both and the commit interrupt only flips _backDirty, so they cannot race.
+    uint32_t* _dirty[2];
+    volatile uint8_t _backDirty = 1; ///< Index in _dirty of the bitmap of _backBuffer.
+    size_t _frontLength;       ///< Bytes of _DMABuffer sent per frame.
+    size_t _backLength;
+    int32_t _lastLitLED = -1;  ///< Highest LED index ever set to a non-black color.
+    bool _trimToLit = false;
     bool _start = false;
     bool _isBusy = false;
     bool _sendWait = false;
+    volatile bool _commitPending = false;
+    const uint8_t* _frontEncoded = nullptr; ///< Frame sent instead of _DMABuffer, see showEncoded().
+    const uint8_t* _backEncoded = nullptr;  ///< Frame committed by showEncoded(), swapped in like _backBuffer.
     uint8_t _ditherCounter = 1;
+    size_t _streamLED = 0;    ///< Next LED the streaming encoder will send.
+    size_t _streamZeros = 0;  ///< Reset bytes queued since the last LED of the frame.
+    uint8_t _streamDither = 0;
+    LED_SPI_Dither _ditherMode = LED_SPI_DITHER_BINARY;
+    uint8_t* _ditherError;    ///< Sigma-delta accumulator per channel, in _LEDColors order.
+    uint8_t _brightness = 255;
+    uint16_t _colorLUT[LED_CHANNELS][256]; ///< Per LED_Channel input to output level << 8 | dither bits.
+    uint8_t _globalBrightness = LED_SPI_GLOBAL_BRIGHTNESS; ///< APA102 hardware brightness, 0..31.
+    uint8_t* _paletteIndices;   ///< Palette entry shown by each LED.
+    uint32_t* _palette;         ///< Encoded patterns, PALETTE_ENTRY_WORDS per entry and dither level.
+    uint32_t _paletteLit[MAX_PALETTE_SIZE / 32] = {}; ///< Entries that are not black, one bit each.
+    LED_SPI_FrameCallback _frameCallback = nullptr;
+    void* _frameCallbackContext = nullptr;
+    volatile uint32_t _frameCount = 0;
+    volatile uint32_t _streamUnderruns = 0;
+    volatile bool _frameWaiting = false; ///< waitForFrame() needs frame interrupts in circular mode.
+#ifdef LED_SPI_STATS
+    LED_SPI_Stats _stats = {};
+#endif
 
     /// Singleton instance pointer for interrupt handler access.
     static LED_SPI_CH32* _instance;
 
+    /**
+     * @fn LED_SPI_CH32(size_t numLEDs, uint8_t ditherDepth, LED_SPI_Mode mode, size_t paletteSize, const LED_SPI_Buffers& buffers)
+     * @brief Construct a controller on buffers owned by the caller.
+     */
+    LED_SPI_CH32(size_t numLEDs, uint8_t ditherDepth, LED_SPI_Mode mode, size_t paletteSize, const LED_SPI_Buffers& buffers);
+
+    static LED_SPI_Buffers allocateBuffers(size_t numLEDs, uint8_t ditherDepth, LED_SPI_Mode mode, size_t paletteSize);
+
+    /**
+     * @fn void encodeDirty(size_t numLEDs, size_t numDitherBuffers, size_t bufferSize)
+     * @brief Encode every LED marked in the bitmap of the back buffer into it and clear the marks.
+     *
+     * Inlined with the sizes as arguments so LED_SPI_CH32_Static can pass compile-time
+     * constants and get loops specialised for its configuration.
+     */
+    inline void encodeDirty(size_t numLEDs, size_t numDitherBuffers, size_t bufferSize);
+
+    /**
+     * @fn void waitForCommit()
+     * @brief Sleep with WFI until the ISR has taken the frame committed by the last show() or showEncoded().
+     */
+    void waitForCommit();
+
+    /**
+     * @fn void commitBack()
+     * @brief Mark the freshly encoded back buffer for the ISR to swap in.
+     */
+    void commitBack();
+
     /**
      * @fn void send()
      * @brief Start a DMA transfer using the settings provided
@@ -125,13 +840,124 @@ public:
     void sendColors();
 
     void sendWait();
+
+    void swapBuffers();
+
+    /**
+     * @fn void frameComplete()
+     * @brief Count a frame and run the frame callback. Called from the DMA interrupt.
+     */
+    void frameComplete();
+
+    /**
+     * @fn bool needsFrameInterrupt()
+     * @brief Whether circular mode has to take the transfer complete interrupt.
+     */
+    bool needsFrameInterrupt() { return _numDitherBuffers > 1 || _commitPending || _frameCallback || _frameWaiting; }
+
+    /**
+     * @fn uint8_t nextDitherBuffer()
+     * @brief Advance the binary weighted dither sequence and return the level to send.
+     */
+    uint8_t nextDitherBuffer();
+
+    /**
+     * @fn void fillStreamHalf(uint8_t* half)
+     * @brief Encode the next STREAM_CHUNK_LEDS LEDs, or reset zeros, into one half of the ring.
+     */
+    void fillStreamHalf(uint8_t* half);
+
+    /**
+     * @fn void updateColorLUT()
+     * @brief Rebuild _colorLUT for the current brightness and dither mode.
+     */
+    void updateColorLUT();
+
+    /**
+     * @fn void computeColorLUT(uint16_t lut[LED_CHANNELS][256], uint8_t brightness, uint8_t numDitherBuffers, LED_SPI_Dither ditherMode)
+     * @brief Fill a color lookup in the _colorLUT format, also used by LED_Parallel_CH32.
+     *
+     * Two or three 32-bit divides per entry, 256 entries per channel: setBrightness() is
+     * cheap next to a frame, but not something to call per LED.
+     */
+    static void computeColorLUT(uint16_t lut[LED_CHANNELS][256], uint8_t brightness, uint8_t numDitherBuffers, LED_SPI_Dither ditherMode);
+
+    /**
+     * @fn uint32_t quantize(const uint16_t lut[256], int colorChannel)
+     * @brief Look up the integer output level and dither bits of a 0..255 channel value.
+     *
+     * @param lut The _colorLUT row of the channel.
+     * @return colorInteger << 16 | colorFractional, the format stored in _LEDColors.
+     */
+    static inline uint32_t quantize(const uint16_t lut[256], int colorChannel);
+
+    /**
+     * @fn void quantizePixel(uint32_t wire[LED_CHANNELS], int r, int g, int b, int w)
+     * @brief Quantize a color into the channel order of the protocol.
+     */
+    inline void quantizePixel(uint32_t wire[LED_CHANNELS], int r, int g, int b, int w) const;
+
+    /**
+     * @fn void storePixel(size_t index, const uint32_t wire[LED_CHANNELS])
+     * @brief Store quantized channels in _LEDColors and mark the LED dirty if they changed.
+     */
+    void storePixel(size_t index, const uint32_t wire[LED_CHANNELS]);
+
+    void markDirty(size_t index);
+
+    /**
+     * @fn uint8_t* encodeChannel(uint8_t* out, uint8_t colorValue)
+     * @brief Write the SPI pattern of one color byte.
+     *
+     * @return Pointer just past the written pattern.
+     */
+    static inline uint8_t* encodeChannel(uint8_t* out, uint8_t colorValue);
+
+    /**
+     * @fn void encodeLED(uint8_t* out, const uint32_t color[LED_CHANNELS], uint8_t ditherBuffer)
+     * @brief Write the SPI patterns of one LED at one dither level.
+     */
+    inline void encodeLED(uint8_t* out, const uint32_t color[LED_CHANNELS], uint8_t ditherBuffer);
+
+    /**
+     * @fn uint8_t* encodeHeader(uint8_t* out)
+     * @brief Write the bytes a protocol sends in front of the channels of each LED.
+     */
+    inline uint8_t* encodeHeader(uint8_t* out);
+
+    /**
+     * @fn const uint32_t* palettePattern(uint8_t entry, uint8_t ditherBuffer)
+     * @brief Encoded SPI patterns of one LED showing a palette entry at one dither level.
+     */
+    const uint32_t* palettePattern(uint8_t entry, uint8_t ditherBuffer) const
+    {
+        return _palette + (entry * _numDitherBuffers + ditherBuffer) * PALETTE_ENTRY_WORDS;
+    }
+
+    /**
+     * @fn void copyPaletteLED(uint8_t* out, const uint32_t* pattern)
+     * @brief Write the pre-encoded patterns of one LED, see palettePattern().
+     */
+    static inline void copyPaletteLED(uint8_t* out, const uint32_t* pattern);
+
+    /**
+     * @fn void encodePaletteEntry(uint8_t entry, RGB color)
+     * @brief Quantize a palette color and encode it for every dither level.
+     */
+    void encodePaletteEntry(uint8_t entry, RGB color);
+
+    /**
+     * @fn void encodeLEDSigmaDelta(uint8_t* out, const uint32_t color[LED_CHANNELS], uint8_t error[LED_CHANNELS])
+     * @brief Write the SPI patterns of one LED for the next sigma-delta frame.
+     */
+    void encodeLEDSigmaDelta(uint8_t* out, const uint32_t color[LED_CHANNELS], uint8_t error[LED_CHANNELS]);
 };
 
 /**
  * @brief Compile-time helper to convert a 4-bit nibble to WS2812 SPI bit pattern.
  *
  * @param nibble 4-bit value (0..15).
- * @return 12-bit SPI pattern encoding the nibble as WS2812 bits.
+ * @return 4 * BITS_PER_SIGNAL bit SPI pattern encoding the nibble as WS2812 bits.
  */
 constexpr uint32_t _computeWS2812Pattern(uint8_t nibble)
 {
@@ -147,7 +973,7 @@ constexpr uint32_t _computeWS2812Pattern(uint8_t nibble)
 /**
  * @brief Compile-time generated lookup table for WS2812 bit patterns.
  *
- * Maps 4-bit color nibbles (0..15) to their 32-bit SPI encodings.
+ * Maps 4-bit color nibbles (0..15) to their 4 * BITS_PER_SIGNAL bit SPI encodings.
  * Table is computed at compile time using constexpr.
  */
 constexpr uint32_t WS2812_LUT[16] = {
@@ -169,7 +995,243 @@ constexpr uint32_t WS2812_LUT[16] = {
     _computeWS2812Pattern(0xF),
 };
 
+#define WS2812_WORDS_PER_BYTE ((BITS_PER_SIGNAL + 3) / 4)
+
+/**
+ * @brief Compile-time generated lookup table from a full color byte to its SPI pattern.
+ *
+ * A color byte is 8 symbols of BITS_PER_SIGNAL bits, which is exactly BITS_PER_SIGNAL
+ * bytes of SPI data. Each entry holds those bytes built from the WS2812_LUT patterns of
+ * the high and low nibble, already packed across byte boundaries and laid out in DMA
+ * memory order (little-endian words). 8 and 4 bit symbols are written with aligned word
+ * stores; 3 bit symbols use the low 3 bytes of the word.
+ */
+struct WS2812ByteTable
+{
+    uint32_t words[256][WS2812_WORDS_PER_BYTE];
+
+    constexpr WS2812ByteTable() : words()
+    {
+        for (int value = 0; value < 256; value++)
+        {
+            uint64_t pattern = (uint64_t)WS2812_LUT[value >> 4] << (4 * BITS_PER_SIGNAL) | WS2812_LUT[value & 0x0F];
+            for (int byte = 0; byte < BITS_PER_SIGNAL; byte++)
+            {
+                uint8_t patternByte = pattern >> (8 * (BITS_PER_SIGNAL - 1 - byte));
+                words[value][byte / 4] |= (uint32_t)patternByte << (8 * (byte % 4));
+            }
+        }
+    }
+};
+
+constexpr WS2812ByteTable WS2812_BYTE_LUT;
+
+/**
+ * @brief x^gamma for x in (0, 1], evaluated by the compiler.
+ *
+ * exp(gamma * ln(x)), with ln from the atanh series after scaling x into [0.5, 1] and exp
+ * from its Taylor series after halving the argument into [-0.5, 0.5].
+ */
+constexpr double _computeGammaPow(double x, double gamma)
+{
+    const double LN2 = 0.69314718055994530942;
+    int halvings = 0;
+    while (x < 0.5)
+    {
+        x *= 2;
+        halvings++;
+    }
+    double z = (x - 1) / (x + 1), z2 = z * z, term = z, ln = 0;
+    for (int n = 1; n < 40; n += 2, term *= z2)
+        ln += term / n;
+    double y = gamma * (2 * ln - halvings * LN2);
+
+    int squarings = 0;
+    while (y < -0.5 || y > 0.5)
+    {
+        y /= 2;
+        squarings++;
+    }
+    double result = 1;
+    term = 1;
+    for (int n = 1; n < 20; n++)
+    {
+        term *= y / n;
+        result += term;
+    }
+    while (squarings--)
+        result *= result;
+    return result;
+}
+
+/**
+ * @brief Compile-time gamma and white balance curves, one per LED_Channel.
+ *
+ * levels[c][v] is the light output for input v as a fraction of full scale in 1/65535
+ * steps: round(65535 * (v / 255)^LED_SPI_GAMMA * white[c] / 255). With a gamma of 1 and
+ * full white balance that is exactly v * 257. LED_SPI_CH32 combines it with the run-time
+ * brightness into its _colorLUT.
+ */
+struct LED_SPI_ColorTable
+{
+    uint16_t levels[LED_CHANNELS][256];
+
+    constexpr LED_SPI_ColorTable() : levels()
+    {
+        const double WHITE[4] = {LED_SPI_WHITE_R / 255.0, LED_SPI_WHITE_G / 255.0, LED_SPI_WHITE_B / 255.0, LED_SPI_WHITE_W / 255.0};
+        for (size_t channel = 0; channel < LED_CHANNELS; channel++)
+            for (int value = 1; value < 256; value++)
+                levels[channel][value] = 65535 * _computeGammaPow(value / 255.0, LED_SPI_GAMMA) * WHITE[channel] + 0.5;
+    }
+};
+
+constexpr LED_SPI_ColorTable LED_SPI_COLOR_TABLE;
+
 #include "LEDSPI.cpp"
 
+/// SRAM of the CH32X035, the static buffers of LED_SPI_CH32_Static have to fit in it.
+#define CH32X035_SRAM_BYTES (20 * 1024)
+
+/**
+ * @brief Sizes of the buffers LED_SPI_CH32 works in for one configuration, known at compile time.
+ *
+ * Same sizes as LED_SPI_CH32::allocateBuffers(). Used by LED_SPI_CH32_Static to declare its
+ * arrays and by LED_SPI_Timing to report the RAM a configuration needs.
+ */
+template <size_t NumLEDs, uint8_t DitherDepth = 0, class Protocol = LED_Protocol, LED_SPI_Mode Mode = LED_SPI_BUFFERED, size_t PaletteSize = 0>
+struct LED_SPI_Layout
+{
+    static constexpr size_t FRAME_BYTES = NumLEDs * Protocol::BYTES_PER_LED;
+    static constexpr size_t FRAME_STRIDE = LED_SPI_FrameStride(FRAME_BYTES, Mode);
+    static constexpr size_t DMA_WORDS = Mode == LED_SPI_STREAMING
+        ? 1
+        : (FRAME_STRIDE * (DitherDepth + 1) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    static constexpr size_t STREAM_WORDS = Mode == LED_SPI_STREAMING ? 2 * STREAM_HALF_BYTES / sizeof(uint32_t) : 1;
+    static constexpr size_t DIRTY_WORDS = (NumLEDs + 31) / 32;
+    static constexpr size_t COLOR_WORDS = PaletteSize ? 0 : NumLEDs * Protocol::CHANNELS;
+    static constexpr size_t ERROR_BYTES = Mode == LED_SPI_STREAMING && !PaletteSize ? NumLEDs * Protocol::CHANNELS : 0;
+    static constexpr size_t PALETTE_WORDS = PaletteSize * (DitherDepth + 1) * PALETTE_ENTRY_WORDS;
+    static constexpr size_t INDEX_BYTES = PaletteSize ? NumLEDs : 0;
+    /// Both frame buffers, or the streaming ring: what the DMA reads from.
+    static constexpr size_t DMA_BYTES = sizeof(uint32_t) * (Mode == LED_SPI_STREAMING ? STREAM_WORDS : 2 * DMA_WORDS);
+    /// The driver object itself, mostly its color lookup (see LED_SPI_CH32::_colorLUT).
+    static constexpr size_t OBJECT_BYTES = sizeof(LED_SPI_CH32);
+    static constexpr size_t RAM_BYTES = sizeof(uint32_t) * (COLOR_WORDS + 2 * DMA_WORDS + STREAM_WORDS + 2 * DIRTY_WORDS + PALETTE_WORDS)
+        + ERROR_BYTES + INDEX_BYTES + OBJECT_BYTES;
+};
+
+/**
+ * @brief The buffers of one LED_SPI_CH32_Static, sized by its LED_SPI_Layout.
+ *
+ * A base class of the driver rather than members, so the arrays exist before the
+ * LED_SPI_CH32 base is constructed on them.
+ */
+template <class Layout, LED_SPI_Mode Mode, size_t PaletteSize>
+struct LED_SPI_StaticBuffers
+{
+    // Zero length arrays are not standard C++, unused buffers keep one element
+    uint32_t colors[Layout::COLOR_WORDS ? Layout::COLOR_WORDS : 1];
+    uint32_t frames[2][Layout::DMA_WORDS];
+    uint32_t stream[Layout::STREAM_WORDS];
+    uint32_t dirty[2][Layout::DIRTY_WORDS];
+    uint32_t palette[Layout::PALETTE_WORDS ? Layout::PALETTE_WORDS : 1];
+    uint8_t error[Layout::ERROR_BYTES ? Layout::ERROR_BYTES : 1];
+    uint8_t indices[Layout::INDEX_BYTES ? Layout::INDEX_BYTES : 1];
+
+    LED_SPI_Buffers buffers()
+    {
+        LED_SPI_Buffers buffers = {};
+        buffers.frontDirty = dirty[0];
+        buffers.backDirty = dirty[1];
+        if (PaletteSize)
+        {
+            buffers.paletteIndices = indices;
+            buffers.palette = palette;
+        }
+        else
+        {
+            buffers.LEDColors = colors;
+        }
+        if (Mode == LED_SPI_STREAMING)
+        {
+            buffers.streamBuffer = (uint8_t *)stream;
+            buffers.ditherError = Layout::ERROR_BYTES ? error : nullptr;
+        }
+        else
+        {
+            buffers.frontBuffer = (uint8_t *)frames[0] + (Mode == LED_SPI_CIRCULAR ? CIRCULAR_GAP_BYTES : 0);
+            buffers.backBuffer = (uint8_t *)frames[1] + (Mode == LED_SPI_CIRCULAR ? CIRCULAR_GAP_BYTES : 0);
+        }
+        return buffers;
+    }
+};
+
+/**
+ * @brief LED_SPI_CH32 with every buffer sized at compile time and held in the object.
+ *
+ * Nothing is allocated on the heap. Declared at namespace scope, the driver and its buffers
+ * are placed in .bss, so the RAM used is visible in the link map; it is too large for the
+ * stack. A configuration that cannot fit in SRAM fails to compile. show() is specialised
+ * with the sizes as constants so the encode loops are unrolled for this strip.
+ *
+ * @tparam NumLEDs Number of addressable LEDs (1..MAX_SUPPORTED_LEDS).
+ * @tparam DitherDepth Number of binary dither bits, see LED_SPI_CH32().
+ * @tparam Protocol LED protocol, has to be the LED_Protocol the driver is built for.
+ * @tparam Mode LED_SPI_BUFFERED, LED_SPI_STREAMING or LED_SPI_CIRCULAR.
+ * @tparam PaletteSize Palette entries for palette mode, 0 for direct color.
+ */
+template <size_t NumLEDs, uint8_t DitherDepth = 0, class Protocol = LED_Protocol, LED_SPI_Mode Mode = LED_SPI_BUFFERED, size_t PaletteSize = 0>
+class LED_SPI_CH32_Static : private LED_SPI_StaticBuffers<LED_SPI_Layout<NumLEDs, DitherDepth, Protocol, Mode, PaletteSize>, Mode, PaletteSize>,
+                           public LED_SPI_CH32
+{
+    typedef LED_SPI_Layout<NumLEDs, DitherDepth, Protocol, Mode, PaletteSize> Layout;
+    typedef LED_SPI_StaticBuffers<Layout, Mode, PaletteSize> Buffers;
+
+public:
+    static constexpr size_t FRAME_BYTES = Layout::FRAME_BYTES;
+    static constexpr size_t FRAME_STRIDE = Layout::FRAME_STRIDE;
+    static constexpr size_t DMA_WORDS = Layout::DMA_WORDS;
+    static constexpr size_t STREAM_WORDS = Layout::STREAM_WORDS;
+    static constexpr size_t DIRTY_WORDS = Layout::DIRTY_WORDS;
+    static constexpr size_t COLOR_WORDS = Layout::COLOR_WORDS;
+    static constexpr size_t ERROR_BYTES = Layout::ERROR_BYTES;
+    static constexpr size_t PALETTE_WORDS = Layout::PALETTE_WORDS;
+    static constexpr size_t INDEX_BYTES = Layout::INDEX_BYTES;
+    /// The buffers and the driver object, all of the SRAM one instance takes.
+    static constexpr size_t RAM_BYTES = Layout::RAM_BYTES;
+
+    static_assert(NumLEDs > 0 && NumLEDs <= MAX_SUPPORTED_LEDS, "NumLEDs must be 1..MAX_SUPPORTED_LEDS");
+    static_assert(std::is_same<Protocol, LED_Protocol>::value, "The driver is built for LED_SPI_PROTOCOL only");
+    static_assert(PaletteSize <= MAX_PALETTE_SIZE, "PaletteSize must be at most MAX_PALETTE_SIZE");
+    static_assert(RAM_BYTES <= CH32X035_SRAM_BYTES, "LED buffers do not fit in SRAM");
+
+    LED_SPI_CH32_Static() : Buffers(), LED_SPI_CH32(NumLEDs, DitherDepth, Mode, PaletteSize, Buffers::buffers())
+    {
+        // RAM_BYTES leaves out padding and the one element stand-ins for unused buffers
+        static_assert(sizeof(LED_SPI_CH32_Static) <= CH32X035_SRAM_BYTES, "LED buffers do not fit in SRAM");
+    }
+
+    /**
+     * @fn void show()
+     * @brief Same as LED_SPI_CH32::show(), with the strip size known at compile time.
+     *
+     * Hides LED_SPI_CH32::show(), which is not virtual: called through a LED_SPI_CH32
+     * pointer or reference, as the effects and the frame scheduler do, the generic show()
+     * runs instead, with the same result at the generic speed.
+     */
+    void show()
+    {
+        if (Mode == LED_SPI_STREAMING)
+        {
+            LED_SPI_STAT(_stats.showsSinceFrame++);
+            return;
+        }
+
+        waitForCommit();
+        encodeDirty(NumLEDs, DitherDepth + 1, FRAME_STRIDE);
+        commitBack();
+    }
+};
+
 
 
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "LEDSPI.h"
+
+// Extra low time per frame in LED_SPI_BUFFERED mode: the DMA stops after the colors and
+// after the zeros and the interrupt restarts it. It lengthens the frame, but the reset check
+// does not count on it: WAIT_BYTES alone are the guaranteed low time. Circular and streaming
+// modes never stop the DMA.
+#ifndef LED_SPI_BUFFERED_OVERHEAD_US
+#define LED_SPI_BUFFERED_OVERHEAD_US 40
+#endif
+
+/**
+ * @brief High and low times a one-wire LED accepts, in ns.
+ *
+ * The LEDs sample each bit a fixed time after its rising edge, so the high times are the
+ * critical ones. The low times have the datasheet minimums, but only have to stay clear of
+ * the reset above them, which is why lowMax is far above the datasheet's nominal values.
+ */
+struct LED_PulseSpec
+{
+    uint16_t t0hMin, t0hMax;
+    uint16_t t1hMin, t1hMax;
+    uint16_t t0lMin, t1lMin, lowMax;
+};
+
+// WS2812B: T0H 0.4us, T1H 0.8us, T0L 0.85us, T1L 0.45us, all +-150ns. WS2811 in 800kHz mode is the same
+constexpr LED_PulseSpec LED_WS2812_PULSES = {250, 550, 650, 950, 700, 300, 5000};
+// SK6812: T0H 0.3us, T1H 0.6us, T0L 0.9us, T1L 0.6us, all +-150ns
+constexpr LED_PulseSpec LED_SK6812_PULSES = {150, 450, 450, 750, 750, 450, 5000};
+
+#if LED_SPI_PROTOCOL == LED_PROTOCOL_SK6812_RGBW
+#define LED_PROTOCOL_PULSES LED_SK6812_PULSES
+#else
+#define LED_PROTOCOL_PULSES LED_WS2812_PULSES
+#endif
+
+/// Leading ones of a width bit symbol: the SPI bits (or port writes) its high pulse lasts.
+constexpr uint32_t LED_SymbolHighBits(uint32_t symbol, uint32_t width = BITS_PER_SIGNAL)
+{
+    uint32_t bits = 0;
+    while (bits < width && (symbol >> (width - 1 - bits)) & 1)
+        bits++;
+    return bits;
+}
+
+/**
+ * @brief Timing model of one driver configuration: what it costs on the wire, in RAM and
+ * in CPU time, all known at compile time.
+ *
+ * Frame times follow the bytes the driver actually queues for each mode, so they match the
+ * host simulation exactly; FRAME_NS adds LED_SPI_BUFFERED_OVERHEAD_US on top in buffered
+ * mode. With binary dithering a color is only complete after DITHER_FRAMES frames, so
+ * DITHER_HZ is the rate that has to stay above the flicker threshold.
+ *
+ * With TargetFPS set the configuration fails to compile unless it shows TargetFPS full
+ * dither cycles per second, its buffers fit in SRAM, the reset gap latches the LEDs and
+ * the symbols are within the LED datasheet tolerances at SpiClock:
+ *
+ *     template struct LED_SPI_Timing<300, 3, LED_SPI_BUFFERED, 100>; // Does not build
+ *
+ * @tparam NumLEDs Number of LEDs.
+ * @tparam DitherDepth Number of binary dither bits, see LED_SPI_CH32().
+ * @tparam Mode LED_SPI_BUFFERED, LED_SPI_STREAMING or LED_SPI_CIRCULAR.
+ * @tparam TargetFPS Full dither cycles per second to require, 0 to only report.
+ * @tparam SpiClock SPI bit rate, LED_SPI_CYCLES_HZ divided by the SPI prescaler.
+ */
+template <size_t NumLEDs, uint8_t DitherDepth = 0, LED_SPI_Mode Mode = LED_SPI_BUFFERED, uint32_t TargetFPS = 0, uint32_t SpiClock = SPI_CLOCK>
+struct LED_SPI_Timing
+{
+    typedef LED_SPI_Layout<NumLEDs, DitherDepth, LED_Protocol, Mode> Layout;
+
+    static constexpr double BIT_NS = 1e9 / SpiClock;
+
+    // Streaming sends whole ring halves: the LEDs, then halves of zeros until the gap is long enough
+    static constexpr size_t STREAM_LED_HALVES = (NumLEDs + STREAM_CHUNK_LEDS - 1) / STREAM_CHUNK_LEDS;
+    static constexpr size_t STREAM_TAIL_ZEROS = STREAM_LED_HALVES * STREAM_HALF_BYTES - Layout::FRAME_BYTES;
+    static constexpr size_t STREAM_ZERO_HALVES = STREAM_TAIL_ZEROS >= STREAM_RESET_BYTES
+        ? 0
+        : (STREAM_RESET_BYTES - STREAM_TAIL_ZEROS + STREAM_HALF_BYTES - 1) / STREAM_HALF_BYTES;
+
+    /// Bytes clocked out per frame, colors and reset gap.
+    static constexpr size_t WIRE_BYTES = Mode == LED_SPI_STREAMING ? (STREAM_LED_HALVES + STREAM_ZERO_HALVES) * STREAM_HALF_BYTES
+                                       : Mode == LED_SPI_CIRCULAR  ? CIRCULAR_GAP_BYTES + Layout::FRAME_BYTES
+                                                                   : Layout::FRAME_BYTES + WAIT_BYTES;
+    /// Zeros between the last LED of one frame and the first of the next.
+    static constexpr size_t GAP_BYTES = WIRE_BYTES - Layout::FRAME_BYTES;
+    static constexpr double OVERHEAD_NS = Mode == LED_SPI_BUFFERED ? LED_SPI_BUFFERED_OVERHEAD_US * 1000.0 : 0;
+
+    static constexpr double WIRE_NS = WIRE_BYTES * 8 * BIT_NS;
+    static constexpr double FRAME_NS = WIRE_NS + OVERHEAD_NS;
+    /// Low time between frames, guaranteed by the zeros on the wire; GAP_NS adds the overhead.
+    static constexpr double WIRE_GAP_NS = GAP_BYTES * 8 * BIT_NS;
+    static constexpr double GAP_NS = WIRE_GAP_NS + OVERHEAD_NS;
+    static constexpr double FRAME_HZ = 1e9 / FRAME_NS;
+    /// Frames per binary dither cycle: the buffer of dither bit k is shown 2^k times.
+    static constexpr uint32_t DITHER_FRAMES = (2u << DitherDepth) - 1;
+    static constexpr double DITHER_HZ = FRAME_HZ / DITHER_FRAMES;
+
+    static constexpr size_t DMA_BYTES = Layout::DMA_BYTES;
+    static constexpr size_t RAM_BYTES = Layout::RAM_BYTES;
+
+    /**
+     * HCLK cycles available per LED and dither level to encode a new image once per dither
+     * cycle in the buffered modes, or per LED in the streaming interrupt before the other
+     * half of the ring runs out.
+     */
+    static constexpr double ENCODE_BUDGET_CYCLES = Mode == LED_SPI_STREAMING
+        ? LED_BYTES_PER_LED * 8 * BIT_NS * LED_SPI_CYCLES_HZ / 1e9
+        : FRAME_NS * DITHER_FRAMES * LED_SPI_CYCLES_HZ / 1e9 / (NumLEDs * (DitherDepth + 1));
+
+    // Pulses of the one-wire symbols, see LED_PulseSpec
+    static constexpr double T0H_NS = LED_SymbolHighBits(SIGNAL_LOW) * BIT_NS;
+    static constexpr double T1H_NS = LED_SymbolHighBits(SIGNAL_HIGH) * BIT_NS;
+    static constexpr double T0L_NS = BITS_PER_SIGNAL * BIT_NS - T0H_NS;
+    static constexpr double T1L_NS = BITS_PER_SIGNAL * BIT_NS - T1H_NS;
+
+    static constexpr bool PULSES_OK = LED_SPI_CLOCKED ||
+        (T0H_NS >= LED_PROTOCOL_PULSES.t0hMin && T0H_NS <= LED_PROTOCOL_PULSES.t0hMax &&
+         T1H_NS >= LED_PROTOCOL_PULSES.t1hMin && T1H_NS <= LED_PROTOCOL_PULSES.t1hMax &&
+         T0L_NS >= LED_PROTOCOL_PULSES.t0lMin && T1L_NS >= LED_PROTOCOL_PULSES.t1lMin &&
+         T0L_NS <= LED_PROTOCOL_PULSES.lowMax && T1L_NS <= LED_PROTOCOL_PULSES.lowMax);
+    static constexpr bool RESET_OK = LED_SPI_CLOCKED || WIRE_GAP_NS >= RESET_PERIOD_US * 1000.0;
+    static constexpr bool RAM_OK = RAM_BYTES <= CH32X035_SRAM_BYTES;
+
+    /// Whether the configuration holds fps full dither cycles per second and can run at all.
+    static constexpr bool meets(uint32_t fps) { return DITHER_HZ >= fps && PULSES_OK && RESET_OK && RAM_OK; }
+
+    static_assert(!TargetFPS || RAM_OK, "LED buffers do not fit in SRAM");
+    static_assert(!TargetFPS || RESET_OK, "The gap between frames is shorter than RESET_PERIOD_US at this SPI clock");
+    static_assert(!TargetFPS || PULSES_OK, "Symbol pulses are outside the LED datasheet tolerances at this SPI clock");
+    static_assert(!TargetFPS || DITHER_HZ >= TargetFPS, "Cannot show TargetFPS full dither cycles per second: use fewer LEDs, less dither or fewer bits per signal");
+};
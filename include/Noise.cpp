@@ -0,0 +1,254 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "FixedPoint.cpp"
+
+/*
+ * Value and simplex noise in Fixed8: coordinates are Q8 with one lattice cell per unit,
+ * results are in -FP_FIXED_VAL..FP_FIXED_VAL. Everything is table lookups, multiplies and
+ * shifts; there are no divides, floats or sinFP() calls per sample.
+ *
+ * The lattice repeats every 256 cells in each direction.
+ */
+
+/**
+ * @brief Ken Perlin style permutation of 0..255, shuffled at compile time, stored twice so
+ * that values[i + values[j]] needs no mask.
+ */
+struct NoisePermutation
+{
+    uint8_t values[512];
+
+    constexpr NoisePermutation() : values()
+    {
+        for (int i = 0; i < 256; i++)
+            values[i] = i;
+        // Fisher-Yates with a fixed LCG, so the pattern is the same on every build
+        uint32_t state = 0x2545F491;
+        for (int i = 255; i > 0; i--)
+        {
+            state = state * 1664525 + 1013904223;
+            int j = (state >> 8) % (i + 1);
+            uint8_t swap = values[i];
+            values[i] = values[j];
+            values[j] = swap;
+        }
+        for (int i = 0; i < 256; i++)
+            values[256 + i] = values[i];
+    }
+};
+
+constexpr NoisePermutation NOISE_PERMUTATION;
+
+/**
+ * @brief Smoothstep 3t^2 - 2t^3 of every Q8 fraction, in Q8: the blend weight of value noise.
+ */
+struct NoiseSmoothstepTable
+{
+    uint16_t values[FP_FIXED_VAL];
+
+    constexpr NoiseSmoothstepTable() : values()
+    {
+        for (int64_t t = 0; t < FP_FIXED_VAL; t++)
+            values[t] = (t * t * (3 * FP_FIXED_VAL - 2 * t) + (1 << (2 * FP_FIXED_BITS - 1))) >> (2 * FP_FIXED_BITS);
+    }
+};
+
+constexpr NoiseSmoothstepTable NOISE_SMOOTHSTEP;
+
+/// Gradients of 2D simplex noise: eight directions of unit length, in Fixed8.
+constexpr int16_t NOISE_GRADIENTS_2D[8][2] = {
+    {256, 0}, {-256, 0}, {0, 256}, {0, -256}, {181, 181}, {-181, 181}, {181, -181}, {-181, -181},
+};
+
+inline uint8_t noiseHash(int32_t i) { return NOISE_PERMUTATION.values[i & 255]; }
+
+inline uint8_t noiseHash(int32_t i, int32_t j) { return NOISE_PERMUTATION.values[(i & 255) + noiseHash(j)]; }
+
+/// Random lattice value, -255..255.
+inline Fixed8 noiseLattice(uint8_t hash) { return (hash << 1) - 255; }
+
+/// a + (b - a) w, w in Q8.
+inline Fixed8 noiseLerp(Fixed8 a, Fixed8 b, Fixed8 w) { return a + (((b - a) * w) >> FP_FIXED_BITS); }
+
+/**
+ * @brief 1D value noise: random values at the integers, blended with smoothstep.
+ */
+inline Fixed8 valueNoise(Fixed8 x)
+{
+    int32_t i = x >> FP_FIXED_BITS;
+    return noiseLerp(noiseLattice(noiseHash(i)), noiseLattice(noiseHash(i + 1)), NOISE_SMOOTHSTEP.values[x & FP_FRACTION_MASK]);
+}
+
+/**
+ * @brief 2D value noise: random values on the integer grid, blended with smoothstep on both axes.
+ */
+inline Fixed8 valueNoise(Fixed8 x, Fixed8 y)
+{
+    int32_t i = x >> FP_FIXED_BITS, j = y >> FP_FIXED_BITS;
+    Fixed8 u = NOISE_SMOOTHSTEP.values[x & FP_FRACTION_MASK], v = NOISE_SMOOTHSTEP.values[y & FP_FRACTION_MASK];
+    Fixed8 bottom = noiseLerp(noiseLattice(noiseHash(i, j)), noiseLattice(noiseHash(i + 1, j)), u);
+    Fixed8 top = noiseLerp(noiseLattice(noiseHash(i, j + 1)), noiseLattice(noiseHash(i + 1, j + 1)), u);
+    return noiseLerp(bottom, top, v);
+}
+
+/**
+ * @brief (r^2 - d^2)^4 in Q16 for r^2 and d^2 in Q16, 0 beyond r: the falloff of a simplex corner.
+ *
+ * r^2 must be at most 1/2 for the products to fit in 32 bits.
+ */
+inline int32_t noiseFalloff(int32_t radiusSquared, int32_t distanceSquared)
+{
+    int32_t t = radiusSquared - distanceSquared;
+    if (t <= 0)
+        return 0;
+    t = (t * t) >> 16;
+    return (t * t) >> 16;
+}
+
+// Scales from the sums of corner contributions (Q24) to Fixed8, in Q8. Measured over a
+// dense sampling so the extremes come close to +-FP_FIXED_VAL; the results are clamped.
+#define NOISE_SIMPLEX_1D_SCALE 12900
+#define NOISE_SIMPLEX_2D_SCALE 25200
+
+inline Fixed8 noiseClamp(int32_t value)
+{
+    return value < -FP_FIXED_VAL ? -FP_FIXED_VAL : value > FP_FIXED_VAL ? FP_FIXED_VAL : value;
+}
+
+/**
+ * @brief 1D simplex (gradient) noise: a random slope at each integer, with a (1 - d^2)^4 falloff.
+ */
+inline Fixed8 simplexNoise(Fixed8 x)
+{
+    int32_t i = x >> FP_FIXED_BITS;
+    int32_t sum = 0;
+    for (int32_t corner = 0; corner < 2; corner++)
+    {
+        int32_t d = x - ((i + corner) << FP_FIXED_BITS); // Q8, -1..1
+        uint8_t hash = noiseHash(i + corner);
+        // Slopes of 1/8 to 1 in steps of 1/8, either sign
+        int32_t gradient = ((hash & 7) + 1) << (FP_FIXED_BITS - 3);
+        int32_t dot = (gradient * d) >> FP_FIXED_BITS;
+        // (1 - d^2)^4 / 16, as (1/2 - d^2/2)^4 stays within 32 bits
+        sum += noiseFalloff(1 << 15, (d * d) >> 1) * (hash & 8 ? -dot : dot);
+    }
+    return noiseClamp(((sum >> FP_FIXED_BITS) * NOISE_SIMPLEX_1D_SCALE) >> 16);
+}
+
+/**
+ * @brief 2D simplex noise: gradients on a triangular grid, three corners per sample.
+ *
+ * The input is skewed by (sqrt(3) - 1) / 2 so the triangles become half squares of the
+ * integer grid, which picks the cell and its three corners with shifts and one compare.
+ */
+inline Fixed8 simplexNoise(Fixed8 x, Fixed8 y)
+{
+    const int32_t SKEW = 23987;   // (sqrt(3) - 1) / 2 in Q16
+    const uint32_t UNSKEW = 13849; // (3 - sqrt(3)) / 6 in Q16
+    const int32_t RADIUS_SQUARED = 1 << 15; // 0.5 in Q16
+
+    int32_t skew = ((int64_t)(x + y) * SKEW) >> 16;
+    int32_t i = (x + skew) >> FP_FIXED_BITS, j = (y + skew) >> FP_FIXED_BITS;
+    // Offsets from the first corner in Q12: the skewed grid puts them between Q8 steps. The
+    // terms are large far from the origin but their sum is not, so wrapping 32 bit math is exact.
+    uint32_t unskew = (uint32_t)(i + j) * UNSKEW;
+    int32_t x0 = (int32_t)(((uint32_t)x << 8) - ((uint32_t)i << 16) + unskew) >> 4;
+    int32_t y0 = (int32_t)(((uint32_t)y << 8) - ((uint32_t)j << 16) + unskew) >> 4;
+    // The middle corner is one step along x in the lower triangle, along y in the upper one
+    int32_t stepI = x0 > y0, stepJ = 1 - stepI;
+    const int32_t ONE = 1 << 12, G = UNSKEW >> 4;
+    int32_t x1 = x0 - stepI * ONE + G, y1 = y0 - stepJ * ONE + G;
+    int32_t x2 = x0 - ONE + 2 * G, y2 = y0 - ONE + 2 * G;
+
+    const int32_t cornerX[3] = {x0, x1, x2}, cornerY[3] = {y0, y1, y2};
+    const uint8_t hashes[3] = {noiseHash(i, j), noiseHash(i + stepI, j + stepJ), noiseHash(i + 1, j + 1)};
+    int32_t sum = 0;
+    for (int corner = 0; corner < 3; corner++)
+    {
+        int32_t dx = cornerX[corner], dy = cornerY[corner];
+        int32_t falloff = noiseFalloff(RADIUS_SQUARED, (dx * dx + dy * dy) >> 8);
+        if (!falloff)
+            continue;
+        const int16_t *gradient = NOISE_GRADIENTS_2D[hashes[corner] & 7];
+        sum += falloff * ((gradient[0] * dx + gradient[1] * dy) >> FP_FIXED_BITS);
+    }
+    // Q16 falloff times Q12 dot products
+    return noiseClamp(((sum >> 12) * NOISE_SIMPLEX_2D_SCALE) >> 16);
+}
+
+/// 2D value noise, as the Noise parameter of fractalNoise().
+struct ValueNoise
+{
+    static Fixed8 at(Fixed8 x, Fixed8 y) { return valueNoise(x, y); }
+};
+
+/// 2D simplex noise, as the Noise parameter of fractalNoise().
+struct SimplexNoise
+{
+    static Fixed8 at(Fixed8 x, Fixed8 y) { return simplexNoise(x, y); }
+};
+
+// Lattice offset between octaves so their cells do not line up, in Q8
+#define NOISE_OCTAVE_OFFSET (37 * FP_FIXED_VAL + 91)
+
+/**
+ * @brief Fractal noise along a line of the noise plane, one value per LED of a strip.
+ *
+ * Octave k samples at 2^k times the frequency and counts half as much as octave k - 1.
+ * The weights add up to exactly one, so the result stays in -FP_FIXED_VAL..FP_FIXED_VAL.
+ * Octaves are the outer loop: each pass over the strip is one noise function inlined.
+ * Animate by moving y (or x0) a little every frame.
+ *
+ * @tparam Noise ValueNoise or SimplexNoise.
+ * @param out count values, written.
+ * @param count Number of LEDs.
+ * @param x0 Position of the first LED, Q8 cells.
+ * @param dx Distance between LEDs, Q8 cells: FP_FIXED_VAL / 8 puts a cell every 8 LEDs.
+ * @param y Position across the line, Q8 cells.
+ * @param octaves Number of octaves, 1 or more.
+ */
+template <class Noise = ValueNoise>
+void fractalNoise(Fixed8 *out, size_t count, Fixed8 x0, Fixed8 dx, Fixed8 y, uint8_t octaves)
+{
+    for (uint8_t octave = 0; octave < octaves; octave++)
+    {
+        // Octave 0 also takes the weight the last octave would have passed on
+        Fixed8 offset = octave * NOISE_OCTAVE_OFFSET;
+        Fixed8 yk = (y << octave) + offset, dxk = dx << octave, x = (x0 << octave) + offset;
+        uint8_t shift = octave + 1;
+        for (size_t i = 0; i < count; i++, x += dxk)
+        {
+            Fixed8 value = Noise::at(x, yk);
+            if (octave)
+                out[i] += value >> shift;
+            else
+                out[i] = (value >> shift) + (value >> octaves);
+        }
+    }
+}
+
+/**
+ * @brief Fractal noise over an LED matrix, written in LED order.
+ *
+ * LED index = row * width + column, with every other row reversed for serpentine wiring.
+ * See fractalNoise() for the octaves and the range.
+ *
+ * @param out width * height values, written.
+ * @param x0 Position of column 0, Q8 cells.
+ * @param y0 Position of row 0, Q8 cells.
+ * @param step Distance between neighbouring LEDs, Q8 cells.
+ */
+template <class Noise = ValueNoise>
+void fractalNoiseMatrix(Fixed8 *out, uint16_t width, uint16_t height, bool serpentine, Fixed8 x0, Fixed8 y0,
+                        Fixed8 step, uint8_t octaves)
+{
+    for (uint16_t row = 0; row < height; row++, out += width)
+    {
+        Fixed8 y = y0 + row * step;
+        if (serpentine && (row & 1))
+            fractalNoise<Noise>(out, width, x0 + (width - 1) * step, -step, y, octaves);
+        else
+            fractalNoise<Noise>(out, width, x0, step, y, octaves);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "LEDSPI.h"
+#include "FixedPoint.cpp"
+#include "Effect.cpp"
+
+/**
+ * @brief The three-colour plasma as an effect, for strips of up to MaxLEDs LEDs.
+ *
+ * Each channel is the sine of the distance from the LED to a point orbiting the strip,
+ * so the pattern drifts and folds differently for red, green and blue. The orbits move
+ * every 15 to 17 frames, so the distances are cached and most frames only take one sine
+ * per channel and LED.
+ */
+template <size_t MaxLEDs = MAX_SUPPORTED_LEDS>
+using PlasmaEffect = EffectRGB<EffectSine<EffectCached<EffectOrbitDistance<15>, MaxLEDs>, 7, 54>,
+                               EffectSine<EffectCached<EffectOrbitDistance<16, FP_2PI / 3>, MaxLEDs>, 3, 116>,
+                               EffectSine<EffectCached<EffectOrbitDistance<17, -FP_2PI / 3>, MaxLEDs>, 2, 73>,
+                               120>;
+
+/// The same plasma without the caches, so it keeps nothing from one frame to the next.
+using PlasmaEffectUncached = EffectRGB<EffectSine<EffectOrbitDistance<15>, 7, 54>,
+                                       EffectSine<EffectOrbitDistance<16, FP_2PI / 3>, 3, 116>,
+                                       EffectSine<EffectOrbitDistance<17, -FP_2PI / 3>, 2, 73>,
+                                       120>;
+
+/**
+ * @brief Render one frame of the three-colour plasma into the LED buffer.
+ *
+ * Takes no RAM beyond the stack and works for any numLEDs, but evaluates every term each
+ * frame. To draw frame after frame, own a PlasmaEffect<numLEDs> and call its draw(): its
+ * caches take 3 * sizeof(Q8) bytes per LED and skip most of the square roots.
+ *
+ * @param leds Driver to write the frame into.
+ * @param numLEDs Number of LEDs to render.
+ * @param t Frame counter, advanced by one every tick.
+ */
+void drawPlasma(LED_SPI_CH32 &leds, size_t numLEDs, int t)
+{
+    PlasmaEffectUncached plasma;
+    plasma.draw(leds, numLEDs, t);
+}
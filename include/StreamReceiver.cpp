@@ -0,0 +1,271 @@
+#pragma once
+
+#include <Arduino.h>
+#include "LEDSPI.h"
+
+// Framings understood by LED_SPI_StreamReceiver. Colors are RGB in LED order in all of them.
+//   Adalight:        'A' 'd' 'a', (LEDs - 1) high, low, high ^ low ^ 0x55, RGB...
+//   Adalight + CRC:  'A' 'd' 'c', same header, RGB..., CRC-16/CCITT-FALSE of the RGB bytes (big endian)
+//   TPM2:            0xC9, 0xDA, payload bytes high, low, RGB..., 0x36
+#define ADALIGHT_CHECK_XOR 0x55
+#define TPM2_START 0xC9
+#define TPM2_DATA 0xDA
+#define TPM2_END 0x36
+
+static_assert(sizeof(RGB) == 3, "Payload bytes are handed to setPixels() as RGB in place");
+
+/**
+ * @brief CRC-16/CCITT-FALSE (polynomial 0x1021, MSB first) of every byte value.
+ */
+struct LED_CRC16Table
+{
+    uint16_t entries[256];
+
+    constexpr LED_CRC16Table() : entries()
+    {
+        for (int value = 0; value < 256; value++)
+        {
+            uint16_t crc = value << 8;
+            for (int bit = 0; bit < 8; bit++)
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+            entries[value] = crc;
+        }
+    }
+};
+
+constexpr LED_CRC16Table LED_CRC16_TABLE;
+
+/**
+ * @brief Decodes LED frames streamed from a PC (Adalight or TPM2 over USB CDC) into a driver.
+ *
+ * Bytes are fed in as they arrive, in chunks of any size. Whole pixels go to setPixels()
+ * straight from the chunk, so there is no frame sized buffer: a pixel split across two
+ * chunks is the only thing copied. show() is called as soon as the last byte of a frame
+ * checks out, and in LED_SPI_BUFFERED mode the next frame then decodes while the DMA is
+ * still sending this one.
+ *
+ * A frame with a bad CRC or TPM2 end byte is not shown, but only in LED_SPI_BUFFERED and
+ * LED_SPI_CIRCULAR mode does that keep it off the strip. Its pixels have already gone to
+ * setPixels(), as there is no frame buffer to stage them in. In those two modes they only
+ * reach the colors the next show() encodes, and the next good frame of the same length
+ * overwrites all of them. In LED_SPI_STREAMING mode the interrupt encodes the colors while
+ * it sends them, so pixels of a bad frame can go out before the check fails.
+ * Pixels past the end of the strip are ignored.
+ */
+class LED_SPI_StreamReceiver
+{
+public:
+    /**
+     * @fn LED_SPI_StreamReceiver(LED_SPI_CH32 &leds)
+     * @param leds Driver the frames are decoded into.
+     */
+    LED_SPI_StreamReceiver(LED_SPI_CH32 &leds) : _leds(leds) {}
+
+    /**
+     * @fn void receive(const uint8_t *data, size_t length)
+     * @brief Decode the next bytes of the stream.
+     */
+    void receive(const uint8_t *data, size_t length)
+    {
+        while (length)
+        {
+            if (_state == PAYLOAD)
+            {
+                size_t run = length < _remaining ? length : _remaining;
+                decodePayload(data, run);
+                data += run;
+                length -= run;
+                if (!(_remaining -= run))
+                    payloadDone();
+                continue;
+            }
+            receiveHeaderByte(*data++);
+            length--;
+        }
+    }
+
+    /**
+     * @fn uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length)
+     * @brief Continue a CRC-16/CCITT-FALSE over more bytes. Start from 0xFFFF.
+     */
+    static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length)
+    {
+        while (length--)
+            crc = (crc << 8) ^ LED_CRC16_TABLE.entries[(crc >> 8) ^ *data++];
+        return crc;
+    }
+
+    /// Frames shown so far.
+    uint32_t frames() const { return _frames; }
+
+    /// Frames dropped for a bad CRC or a missing TPM2 end byte.
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    enum State : uint8_t
+    {
+        SYNC,
+        ADALIGHT_D,
+        ADALIGHT_A,
+        COUNT_HIGH,
+        COUNT_LOW,
+        COUNT_CHECK,
+        TPM2_TYPE,
+        SIZE_HIGH,
+        SIZE_LOW,
+        PAYLOAD,
+        CRC_HIGH,
+        CRC_LOW,
+        END_BYTE,
+    };
+
+    enum Framing : uint8_t
+    {
+        ADALIGHT,
+        ADALIGHT_CRC,
+        TPM2,
+    };
+
+    void receiveHeaderByte(uint8_t byte)
+    {
+        switch (_state)
+        {
+        case SYNC:
+            _state = syncState(byte);
+            break;
+        // The byte that breaks a magic may start the next one, as the second 'A' of "AAda"
+        case ADALIGHT_D:
+            _state = byte == 'd' ? ADALIGHT_A : syncState(byte);
+            break;
+        case ADALIGHT_A:
+            _framing = byte == 'c' ? ADALIGHT_CRC : ADALIGHT;
+            _state = byte == 'a' || byte == 'c' ? COUNT_HIGH : syncState(byte);
+            break;
+        case COUNT_HIGH:
+            _high = byte;
+            _state = COUNT_LOW;
+            break;
+        case COUNT_LOW:
+            _low = byte;
+            _state = COUNT_CHECK;
+            break;
+        case COUNT_CHECK:
+            // A header that does not check out was noise, look for the next one
+            if (byte == (_high ^ _low ^ ADALIGHT_CHECK_XOR))
+                startPayload(3 * ((_high << 8 | _low) + 1), true);
+            else
+                _state = syncState(byte);
+            break;
+        case TPM2_TYPE:
+            // Other packet types (commands, requests) are skipped over
+            _framing = TPM2;
+            _isData = byte == TPM2_DATA;
+            _state = SIZE_HIGH;
+            break;
+        case SIZE_HIGH:
+            _high = byte;
+            _state = SIZE_LOW;
+            break;
+        case SIZE_LOW:
+            startPayload(_high << 8 | byte, _isData);
+            if (!_remaining)
+                payloadDone();
+            break;
+        case CRC_HIGH:
+            _high = byte;
+            _state = CRC_LOW;
+            break;
+        case CRC_LOW:
+            frameDone((_high << 8 | byte) == _crc);
+            _state = SYNC;
+            break;
+        case END_BYTE:
+            if (_isData)
+                frameDone(byte == TPM2_END);
+            _state = SYNC;
+            break;
+        case PAYLOAD:
+            break;
+        }
+    }
+
+    /// State after byte while looking for the start of a frame.
+    static State syncState(uint8_t byte)
+    {
+        return byte == 'A' ? ADALIGHT_D : byte == TPM2_START ? TPM2_TYPE : SYNC;
+    }
+
+    void startPayload(size_t bytes, bool isData)
+    {
+        _remaining = bytes;
+        _isData = isData;
+        _led = 0;
+        _partial = 0;
+        _crc = 0xFFFF;
+        _state = PAYLOAD;
+    }
+
+    void decodePayload(const uint8_t *data, size_t length)
+    {
+        if (!_isData)
+            return;
+        if (_framing == ADALIGHT_CRC)
+            _crc = crc16(_crc, data, length);
+
+        // Finish a pixel split across chunks
+        while (_partial && length)
+        {
+            _pixel[_partial++] = *data++;
+            length--;
+            if (_partial == 3)
+            {
+                _leds.setPixels((const RGB *)_pixel, 1, _led++);
+                _partial = 0;
+            }
+        }
+
+        size_t whole = length / 3;
+        _leds.setPixels((const RGB *)data, whole, _led);
+        _led += whole;
+        for (data += 3 * whole, length -= 3 * whole; length; length--)
+            _pixel[_partial++] = *data++;
+    }
+
+    void payloadDone()
+    {
+        if (_framing == TPM2)
+            _state = END_BYTE;
+        else if (_framing == ADALIGHT_CRC)
+            _state = CRC_HIGH;
+        else
+        {
+            frameDone(true);
+            _state = SYNC;
+        }
+    }
+
+    void frameDone(bool good)
+    {
+        if (!good)
+        {
+            _dropped++;
+            return;
+        }
+        _leds.show();
+        _frames++;
+    }
+
+    LED_SPI_CH32 &_leds;
+    State _state = SYNC;
+    Framing _framing = ADALIGHT;
+    bool _isData = false;
+    uint8_t _high = 0;
+    uint8_t _low = 0;
+    uint8_t _pixel[3];
+    uint8_t _partial = 0;
+    uint16_t _crc = 0xFFFF;
+    size_t _remaining = 0;
+    size_t _led = 0;
+    uint32_t _frames = 0;
+    uint32_t _dropped = 0;
+};
@@ -2,29 +2,43 @@
 #include <CH32X035_USBSerial.h>
 using namespace wch::usbcdc;
 
-void printAddr (volatile uint32_t* addr, String name = "", int base = 16) {
-    USBSerial.print(name);
-    USBSerial.print(" @ 0x");
-    USBSerial.println((uint32_t)addr, HEX);
+#define DUMP_SYNC 0xA5
 
-    if (base == 2) {
-        USBSerial.print("0b");
-        for (int8_t i = 31; i >= 0; i--) {
-            USBSerial.print(((*addr >> i) & 0x1) ? '1' : '0');
-            if (i % 4 == 0) USBSerial.print(' ');
-        }
-    } else if (base == 16) {    
-        USBSerial.print("0x");
-        for (uint32_t i = 8; i; i--) {
-            USBSerial.print(((*addr >> ((i - 1) * 4)) & 0xF), HEX);
-        }
-        USBSerial.println();
-    } else
-        USBSerial.println(*addr, base);
+/**
+ * @brief Send a block of memory over USBSerial as one binary record.
+ *
+ * Record layout: DUMP_SYNC, tag, length, the payload bytes as they are in memory (little
+ * endian), then the XOR of every byte before it. A host script can resync on DUMP_SYNC
+ * and drop records whose checksum does not match.
+ *
+ * @param tag Identifies the payload to the receiver.
+ * @param data Bytes to send.
+ * @param length Number of bytes, at most 255.
+ */
+void dumpBinary(uint8_t tag, const void *data, uint8_t length)
+{
+    const uint8_t header[3] = {DUMP_SYNC, tag, length};
+    uint8_t check = DUMP_SYNC ^ tag ^ length;
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (uint8_t i = 0; i < length; i++)
+        check ^= bytes[i];
 
-    USBSerial.println();
+    USBSerial.write(header, sizeof(header));
+    USBSerial.write(bytes, length);
+    USBSerial.write(check);
 }
 
-void printAddr (volatile uint16_t* addr, String name = "", int base = 16) {
-    printAddr((volatile uint32_t*)addr, name, base);
-}
\ No newline at end of file
+/**
+ * @brief Dump a peripheral register as a record holding its address and value.
+ */
+void dumpRegister(uint8_t tag, volatile uint32_t *addr)
+{
+    const uint32_t record[2] = {(uint32_t)(uintptr_t)addr, *addr};
+    dumpBinary(tag, record, sizeof(record));
+}
+
+void dumpRegister(uint8_t tag, volatile uint16_t *addr)
+{
+    const uint32_t record[2] = {(uint32_t)(uintptr_t)addr, *addr};
+    dumpBinary(tag, record, sizeof(record));
+}
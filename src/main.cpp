@@ -1,15 +1,33 @@
 #include <Arduino.h>
 #include "LEDSPI.h"
 #include "FixedPoint.cpp"
+#include "Plasma.cpp"
+#include "FrameScheduler.cpp"
+#include "LEDTiming.h"
 
 //#define SERIAL_ENABLE
+// Show frames streamed from a PC (Adalight or TPM2, see StreamReceiver.cpp) instead of the plasma
+//#define STREAM_ENABLE
 #define LED_NUM 21
 
 #ifdef SERIAL_ENABLE
 #include "debug.cpp"
 #endif
 
-LED_SPI_CH32 LED_SPI(LED_NUM, 3);
+#ifdef STREAM_ENABLE
+#include <CH32X035_USBSerial.h>
+#include "StreamReceiver.cpp"
+using namespace wch::usbcdc;
+#endif
+
+LED_SPI_CH32_Static<LED_NUM, 3> LED_SPI;
+// Does not build unless the strip shows at least 60 full dither cycles per second
+template struct LED_SPI_Timing<LED_NUM, 3, LED_SPI_BUFFERED, 60>;
+LED_SPI_FrameScheduler scheduler(LED_SPI, 100);
+PlasmaEffect<LED_NUM> plasma;
+#ifdef STREAM_ENABLE
+LED_SPI_StreamReceiver receiver(LED_SPI);
+#endif
 
 void setup()
 {
@@ -21,41 +39,44 @@ void setup()
     // if (!USBSerial.waitForPC(20))
     //   USBSerial.end();
     USBSerial.println("Starting up...");
+#elif defined(STREAM_ENABLE)
+    USBSerial.begin(128);
 #endif
 }
 
 int t;
-uint32_t lastTickTime = micros();
 void loop()
 {
-    // Delay until 10 milliseconds have passed since the last draw call
-    while (micros() - lastTickTime < 10000) {}
-    lastTickTime = micros();
+#ifdef STREAM_ENABLE
+    // Hand the receiver what has arrived, one CDC packet at a time. It calls show() itself,
+    // so frames go out as fast as the PC sends them.
+    uint8_t chunk[64];
+    size_t length = 0;
+    while (length < sizeof(chunk) && USBSerial.available())
+        chunk[length++] = USBSerial.read();
+    receiver.receive(chunk, length);
+    return;
+#endif
 
-    for (int i = 0; i < LED_NUM; i++)
-    {   
-        const Fixed8 R = 256 * LED_NUM;
-        const Fixed8 x = 256 * i;
-        const Fixed8 radiusR = sqrtFP(mult(R , R) - 2 * mult(x,  mult(R, sinFP(t * 15 / 256))) + mult(x, x));
-        const Fixed8 radiusG = sqrtFP(mult(R , R) - 2 * mult(x,  mult(R, sinFP(t * 16 / 256 + FP_2PI / 3))) + mult(x, x));
-        const Fixed8 radiusB = sqrtFP(mult(R , R) - 2 * mult(x,  mult(R, sinFP(t * 17 / 256 - FP_2PI / 3))) + mult(x, x));
+    // Sleep until the first frame boundary after the next 10 ms slot
+    scheduler.wait();
+#ifdef SERIAL_ENABLE
+    uint32_t renderStart = micros();
+#endif
 
-        LED_SPI.setLED(i, 
-        sinFP(7 * t + radiusR * 54 / 256) + 120,
-        sinFP(3 * t + radiusG * 116 / 256) + 120,
-        sinFP(2 * t + radiusB * 73 / 256) + 120);
-    }
+    plasma.draw(LED_SPI, LED_NUM, t);
+    LED_SPI.show();
     t++;
 
 #ifdef SERIAL_ENABLE
-    USBSerial.println(micros() - lastTickTime);
+    USBSerial.println(micros() - renderStart);
     return;
 
     for (int i = 0; i < LED_NUM; i++)
     {
         USBSerial.print(i);
         USBSerial.print(": ");
-        USBSerial.print(LED_SPI._LEDColors[i * 3 + 1], BIN);
+        USBSerial.print(LED_SPI._LEDColors[i * LED_CHANNELS + 1], BIN);
         USBSerial.println();
     }
     /* for (size_t i = 0; i < LED_SPI._DMABufferSize; i++)
@@ -0,0 +1,173 @@
+#pragma once
+
+// Host side of LED_FlashAnimation: encodes RGB frames with the driver itself, on the
+// simulator, so the symbols are exactly what the firmware would send, then compresses
+// the frames that have to be and writes them out as a header of const data.
+
+#include <Arduino.h>
+#include "LEDSPI.h"
+#include "FlashAnimation.cpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+/// A frame as it will be stored: its encoding and the bytes at LED_FlashFrame::data.
+struct LED_EncodedFrame
+{
+    uint8_t encoding;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief SPI symbols of every frame, as LED_SPI_CH32 encodes them without dithering.
+ *
+ * @param rgb frameCount * numLEDs colors, frame after frame.
+ */
+inline std::vector<std::vector<uint8_t>> LED_EncodeSymbols(const RGB *rgb, size_t numLEDs, size_t frameCount)
+{
+    // Never started, so show() encodes and swaps the buffers at once
+    LED_SPI_CH32 leds(numLEDs);
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t frame = 0; frame < frameCount; frame++, rgb += numLEDs)
+    {
+        leds.setPixels(rgb, numLEDs);
+        leds.show();
+        frames.emplace_back(leds._DMABuffer, leds._DMABuffer + leds._DMABufferSize);
+    }
+    return frames;
+}
+
+/**
+ * @brief Run-length code bytes, or their XOR with previous, in the LED_FRAME_RLE format.
+ *
+ * Runs of three or more equal bytes are repeats, everything else goes in literals.
+ */
+inline std::vector<uint8_t> LED_CompressRLE(const uint8_t *bytes, size_t size, const uint8_t *previous)
+{
+    auto at = [&](size_t i) -> uint8_t { return previous ? bytes[i] ^ previous[i] : bytes[i]; };
+    std::vector<uint8_t> out;
+    size_t i = 0, literal = 0; // literal: start of the pending literal bytes
+    auto flushLiteral = [&](size_t end) {
+        while (literal < end)
+        {
+            size_t count = std::min<size_t>(end - literal, LED_RLE_MAX_LITERAL);
+            out.push_back(count - 1);
+            for (size_t k = 0; k < count; k++)
+                out.push_back(at(literal + k));
+            literal += count;
+        }
+    };
+    while (i < size)
+    {
+        size_t run = 1;
+        while (i + run < size && run < LED_RLE_MAX_REPEAT && at(i + run) == at(i))
+            run++;
+        if (run >= 3)
+        {
+            flushLiteral(i);
+            out.push_back(run + LED_RLE_REPEAT_BIAS);
+            out.push_back(at(i));
+            literal = i + run;
+        }
+        i += run;
+    }
+    flushLiteral(size);
+    return out;
+}
+
+/**
+ * @brief Choose how each frame is stored.
+ *
+ * Frames stay LED_FRAME_RAW, sent straight from flash, while the animation fits in
+ * flashBudget bytes. Past it, the frames that shrink the most are stored compressed, as
+ * LED_FRAME_RLE or LED_FRAME_DELTA, whichever is smaller. With compressAll every frame
+ * that gets smaller is compressed.
+ *
+ * @return The frames, or an empty vector if they do not fit even compressed.
+ */
+inline std::vector<LED_EncodedFrame> LED_ChooseFrameEncodings(const std::vector<std::vector<uint8_t>> &symbols,
+                                                              size_t flashBudget, bool compressAll)
+{
+    std::vector<LED_EncodedFrame> raw, packed;
+    size_t total = 0;
+    for (size_t i = 0; i < symbols.size(); i++)
+    {
+        const std::vector<uint8_t> &frame = symbols[i];
+        raw.push_back({LED_FRAME_RAW, frame});
+        LED_EncodedFrame best = {LED_FRAME_RLE, LED_CompressRLE(frame.data(), frame.size(), nullptr)};
+        // The first frame has nothing before it once playback loops or restarts
+        if (i)
+        {
+            std::vector<uint8_t> delta = LED_CompressRLE(frame.data(), frame.size(), symbols[i - 1].data());
+            if (delta.size() < best.data.size())
+                best = {LED_FRAME_DELTA, delta};
+        }
+        packed.push_back(best);
+        total += frame.size();
+    }
+
+    // Bytes each frame saves compressed, 0 for the frames that do not shrink
+    std::vector<size_t> savings(symbols.size()), order(symbols.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        savings[i] = raw[i].data.size() > packed[i].data.size() ? raw[i].data.size() - packed[i].data.size() : 0;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return savings[a] > savings[b]; });
+
+    std::vector<LED_EncodedFrame> frames = raw;
+    for (size_t i : order)
+    {
+        if (!savings[i] || (!compressAll && total <= flashBudget))
+            break;
+        total -= savings[i];
+        frames[i] = packed[i];
+    }
+    return total <= flashBudget ? frames : std::vector<LED_EncodedFrame>();
+}
+
+/// Flash bytes the frames take, data and LED_FlashFrame table.
+inline size_t LED_FlashBytes(const std::vector<LED_EncodedFrame> &frames)
+{
+    size_t bytes = sizeof(LED_FlashAnimation);
+    for (const LED_EncodedFrame &frame : frames)
+        bytes += frame.data.size() + sizeof(LED_FlashFrame);
+    return bytes;
+}
+
+/**
+ * @brief Write the frames as a header defining the LED_FlashAnimation name.
+ *
+ * The header only compiles with the symbol and color settings the frames were encoded with,
+ * including LED_SPI_GLOBAL_BRIGHTNESS: APA102 frames carry it in every LED header byte.
+ * The gamma is written with all 17 digits, so the check compares the exact same double.
+ */
+inline void LED_WriteAnimationHeader(FILE *out, const char *name, const char *source, size_t numLEDs,
+                                     const std::vector<LED_EncodedFrame> &frames)
+{
+    static const char *ENCODINGS[] = {"LED_FRAME_RAW", "LED_FRAME_RLE", "LED_FRAME_DELTA"};
+    fprintf(out, "// Generated by tools/encode_animation.cpp from %s, do not edit.\n", source);
+    fprintf(out, "// %zu frames of %zu LEDs, %zu bytes of flash.\n", frames.size(), numLEDs, LED_FlashBytes(frames));
+    fprintf(out, "#pragma once\n#include \"FlashAnimation.cpp\"\n\n");
+    fprintf(out,
+            "static_assert(BITS_PER_SIGNAL == %d && LED_SPI_PROTOCOL == %d && MAX_BRIGHTNESS == %d && LED_SPI_GAMMA == %.17g &&\n"
+            "              LED_SPI_WHITE_R == %d && LED_SPI_WHITE_G == %d && LED_SPI_WHITE_B == %d && LED_SPI_WHITE_W == %d &&\n"
+            "              LED_SPI_GLOBAL_BRIGHTNESS == %d,\n"
+            "              \"%s was encoded with other LED settings, run tools/encode_animation.cpp again\");\n\n",
+            BITS_PER_SIGNAL, LED_SPI_PROTOCOL, MAX_BRIGHTNESS, (double)LED_SPI_GAMMA, LED_SPI_WHITE_R,
+            LED_SPI_WHITE_G, LED_SPI_WHITE_B, LED_SPI_WHITE_W, LED_SPI_GLOBAL_BRIGHTNESS, name);
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        fprintf(out, "static const uint8_t %s_frame%zu[] = {", name, i);
+        for (size_t k = 0; k < frames[i].data.size(); k++)
+            fprintf(out, "%s0x%02X,", k % 16 ? " " : "\n    ", frames[i].data[k]);
+        fprintf(out, "\n};\n");
+    }
+    fprintf(out, "\nstatic const LED_FlashFrame %s_frames[] = {\n", name);
+    for (size_t i = 0; i < frames.size(); i++)
+        fprintf(out, "    {%s_frame%zu, %zu, %s},\n", name, i, frames[i].data.size(), ENCODINGS[frames[i].encoding]);
+    fprintf(out, "};\n\nconst LED_FlashAnimation %s = {%zu, %zu, %zu, %s_frames};\n", name, numLEDs, frames.size(),
+            numLEDs * LED_BYTES_PER_LED, name);
+}
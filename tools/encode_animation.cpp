@@ -0,0 +1,81 @@
+// Encode an animation into a header of pre-encoded SPI frames for LED_FlashPlayer
+// ([env:animation_tool] in platformio.ini).
+//
+//   pio run -e animation_tool
+//   .pio/build/animation_tool/program <numLEDs> <frames.rgb|-> <name> [--budget BYTES] [--compress] > name.h
+//
+// The input is raw 8-bit RGB, numLEDs * 3 bytes per frame, frame after frame (for example
+// ffmpeg -f rawvideo -pix_fmt rgb24). Build the tool with the same LED_SPI_PROTOCOL,
+// BITS_PER_SIGNAL, MAX_BRIGHTNESS and color settings as the firmware: the header checks it.
+
+#include "AnimationEncoder.h"
+
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "usage: %s <numLEDs> <frames.rgb|-> <name> [--budget BYTES] [--compress]\n", argv[0]);
+        return 2;
+    }
+    size_t numLEDs = strtoul(argv[1], nullptr, 0);
+    const char *path = argv[2], *name = argv[3];
+    size_t budget = SIZE_MAX;
+    bool compressAll = false;
+    for (int i = 4; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--budget") && i + 1 < argc)
+            budget = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--compress"))
+            compressAll = true;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!numLEDs || numLEDs > MAX_SUPPORTED_LEDS)
+    {
+        fprintf(stderr, "numLEDs must be 1 to %d\n", MAX_SUPPORTED_LEDS);
+        return 2;
+    }
+
+    FILE *in = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+    if (!in)
+    {
+        perror(path);
+        return 1;
+    }
+    std::vector<RGB> rgb;
+    RGB color;
+    while (fread(&color, sizeof(color), 1, in) == 1)
+        rgb.push_back(color);
+    if (in != stdin)
+        fclose(in);
+    size_t frameCount = rgb.size() / numLEDs;
+    if (!frameCount || frameCount > UINT16_MAX)
+    {
+        fprintf(stderr, "%s: need 1 to %u frames of %zu LEDs\n", path, UINT16_MAX, numLEDs);
+        return 1;
+    }
+    if (rgb.size() % numLEDs)
+        fprintf(stderr, "%s: ignoring %zu bytes after the last whole frame\n", path, rgb.size() % numLEDs * sizeof(RGB));
+
+    std::vector<LED_EncodedFrame> frames =
+        LED_ChooseFrameEncodings(LED_EncodeSymbols(rgb.data(), numLEDs, frameCount), budget, compressAll);
+    if (frames.empty())
+    {
+        fprintf(stderr, "%zu frames do not fit in %zu bytes even compressed\n", frameCount, budget);
+        return 1;
+    }
+    LED_WriteAnimationHeader(stdout, name, path, numLEDs, frames);
+
+    size_t compressed = 0;
+    for (const LED_EncodedFrame &frame : frames)
+        compressed += frame.encoding != LED_FRAME_RAW;
+    fprintf(stderr, "%zu frames, %zu compressed, %zu bytes of flash, %zu bytes of RAM to play\n", frameCount,
+            compressed, LED_FlashBytes(frames), compressed ? 2 * numLEDs * LED_BYTES_PER_LED : 0);
+    return 0;
+}